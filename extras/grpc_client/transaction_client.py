@@ -81,6 +81,41 @@ class TransactionClient:
     def sender_thread(self, total_transactions = -1):
         self.stub.SendTransaction(self.transaction_iterator(total_transactions))
 
+    def verdict_thread(self, total_transactions):
+        """Envia pelo StreamTransactions e mede a latência de decisão de cada transação"""
+        sent_at = {}
+
+        def tracked_iterator():
+            for transaction in self.transaction_iterator(total_transactions):
+                sent_at[transaction.id_transacao] = transaction.timestamp_envio
+                yield transaction
+
+        latencies = []
+        approved = 0
+        dropped = 0
+        duplicated = 0
+        for batch in self.stub.StreamTransactions(tracked_iterator()):
+            received = int(time.time() * 1000)
+            for verdict in batch.verdicts:
+                if verdict.aprovacao == -2:  # id_transacao já recebido antes
+                    duplicated += 1
+                    continue
+                if verdict.aprovacao < 0:  # descartada pelo servidor sobrecarregado
+                    dropped += 1
+                    continue
+                latencies.append(received - sent_at[verdict.id_transacao])
+                approved += verdict.aprovacao
+
+        if dropped:
+            print(f"Transações descartadas pelo servidor: {dropped}")
+        if duplicated:
+            print(f"Transações repetidas ignoradas pelo servidor: {duplicated}")
+        if latencies:
+            p50, p95, p99 = np.percentile(latencies, [50, 95, 99])
+            print(f"Vereditos: {len(latencies)} ({approved} aprovadas) - "
+                  f"latência p50 {p50:.0f}ms | p95 {p95:.0f}ms | p99 {p99:.0f}ms | máx {max(latencies)}ms")
+        return latencies
+
     #ANTIGO - PARA TRANSAÇÃO SEM STREAM
     def send_transaction(self, transaction):
         """Envia uma transação para o servidor via gRPC"""
@@ -129,6 +164,8 @@ def main():
                         help='Número máximo de workers paralelos (padrão: 10)')
     parser.add_argument('--seed', type=int, default=42,
                         help='Semente para o gerador de números aleatórios (padrão: 42)')
+    parser.add_argument('--verdicts', action='store_true',
+                        help='Usa o StreamTransactions e mede a latência até o veredito de cada transação')
     
     args = parser.parse_args()
     
@@ -139,7 +176,10 @@ def main():
         seed=args.seed
     )
     # client.run(max_workers=args.workers)
-    client.sender_thread()
+    if args.verdicts:
+        client.verdict_thread(args.transactions)
+    else:
+        client.sender_thread()
 
 
 if __name__ == "__main__":
@@ -0,0 +1,45 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+// Execução da pipeline abortada (cancel ou prazo vencido). O orquestrador a lança depois que todas
+// as threads da execução saíram e as tasks voltaram ao estado inicial.
+class PipelineCancelled : public std::runtime_error {
+public:
+    explicit PipelineCancelled(const std::string& reason) : std::runtime_error(reason) {}
+};
+
+// Pedido de cancelamento cooperativo de uma execução (ou de uma task dentro dela): as threads
+// consultam isCancelled() entre partes do trabalho e saem cedo. Vence também por prazo, e uma
+// token filha fica cancelada quando a mãe fica. Thread-safe.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit CancellationToken(std::shared_ptr<CancellationToken> parent = nullptr,
+                               Clock::time_point deadline = Clock::time_point::max());
+
+    // Cancela com o motivo dado (só o primeiro motivo é guardado)
+    void cancel(const std::string& reason);
+    // Cancelada, com prazo vencido ou com a mãe cancelada
+    bool isCancelled();
+    // Motivo do cancelamento ("" se não cancelada)
+    std::string getReason() const;
+    Clock::time_point getDeadline() const { return deadline; }
+
+private:
+    std::shared_ptr<CancellationToken> parent;
+    Clock::time_point deadline;
+    std::atomic<bool> cancelled{false};
+    mutable std::mutex reasonMutex;
+    std::string reason;
+    bool cancelledUpstream() const; // esta ou alguma ancestral já marcada, sem olhar prazos
+};
+
+#endif
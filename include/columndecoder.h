@@ -0,0 +1,104 @@
+#ifndef COLUMNDECODER_H
+#define COLUMNDECODER_H
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <stdexcept>
+#include <string>
+
+#include "dataframe.h"
+
+// Tipo de retorno de um getter const (ex.: const std::string& (Transaction::*)() const)
+template <typename Getter>
+struct GetterTraits;
+
+template <typename C, typename R>
+struct GetterTraits<R (C::*)() const> {
+    using Value = std::decay_t<R>;
+};
+
+template <typename C, typename R>
+struct GetterTraits<R (C::*)() const noexcept> {
+    using Value = std::decay_t<R>;
+};
+
+// Campo de uma mensagem lido pelo getter Getter e guardado numa Column<T>.
+// T pode diferir do tipo do getter quando a coluna usa outro tipo equivalente (ex.: int64 -> long long).
+template <auto Getter, typename T = typename GetterTraits<decltype(Getter)>::Value>
+struct Field {
+    using Value = T;
+
+    template <typename Message>
+    static T read(const Message& message) {
+        return static_cast<T>((message.*Getter)());
+    }
+};
+
+// Decodifica mensagens (por exemplo, protobuf) direto para as colunas tipadas de um DataFrame:
+// cada campo é copiado do getter para o vetor da sua Column<T>, sem células genéricas (VarCell/any)
+// nem chamadas virtuais por valor. Os campos são dados na ordem das colunas do schema.
+//
+//     ColumnDecoder<Field<&Msg::id>, Field<&Msg::valor>> decoder(schema);
+//     decoder.append(msg);                 // por mensagem
+//     auto batch = decoder.flush();        // DataFrame com as linhas decodificadas
+template <typename... Fields>
+class ColumnDecoder {
+public:
+    // schema: DataFrame (normalmente vazio) com as colunas de destino, na mesma ordem e tipos dos campos
+    explicit ColumnDecoder(const DataFrame& schema) {
+        for (size_t i = 0; i < sizeof...(Fields); ++i) {
+            prototypes.push_back(schema.getColumn(i));
+        }
+        reset(std::index_sequence_for<Fields...>{});
+    }
+
+    template <typename Message>
+    void append(const Message& message) {
+        append(message, std::index_sequence_for<Fields...>{});
+        rows++;
+    }
+
+    void reserve(size_t n) {
+        std::apply([n](auto&... column) { (column->reserve(n), ...); }, columns);
+    }
+
+    size_t size() const { return rows; }
+    bool empty() const { return rows == 0; }
+
+    // Entrega as linhas decodificadas como DataFrame e recomeça com colunas vazias
+    std::shared_ptr<DataFrame> flush() {
+        auto df = std::make_shared<DataFrame>();
+        std::apply([&df](auto&... column) { (df->addColumn(column), ...); }, columns);
+        reset(std::index_sequence_for<Fields...>{});
+        return df;
+    }
+
+private:
+    std::vector<std::shared_ptr<BaseColumn>> prototypes;
+    std::tuple<std::shared_ptr<Column<typename Fields::Value>>...> columns;
+    size_t rows = 0;
+
+    template <size_t... I>
+    void reset(std::index_sequence<I...>) {
+        columns = std::make_tuple(makeColumn<typename Fields::Value>(I)...);
+        rows = 0;
+    }
+
+    template <typename T>
+    std::shared_ptr<Column<T>> makeColumn(size_t i) const {
+        auto column = std::dynamic_pointer_cast<Column<T>>(prototypes[i]->cloneEmpty());
+        if (!column) {
+            throw std::invalid_argument("ColumnDecoder: type of column " + prototypes[i]->getIdentifier() + " differs from its field.");
+        }
+        return column;
+    }
+
+    template <typename Message, size_t... I>
+    void append(const Message& message, std::index_sequence<I...>) {
+        (std::get<I>(columns)->addValue(Fields::read(message)), ...);
+    }
+};
+
+#endif
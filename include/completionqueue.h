@@ -0,0 +1,41 @@
+#ifndef COMPLETIONQUEUE_H
+#define COMPLETIONQUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <semaphore>
+#include <exception>
+#include "mpscring.h"
+
+// Fila de término das threads das tasks, consumida pelo orquestrador.
+// Cada thread, ao terminar, publica (grupo, slot) numa MpscRing e libera uma unidade do semáforo;
+// o orquestrador dorme no semáforo e trata apenas os eventos publicados, sem varrer as flags de
+// todas as threads em execução nem disputar um mutex com elas. O custo por acordada é proporcional
+// ao número de eventos, não ao de threads ativas.
+class CompletionQueue {
+public:
+    struct Event {
+        uint32_t group = 0; // identificador da execução da task, dado pelo orquestrador
+        uint32_t slot = 0;  // índice da thread dentro da execução
+        std::exception_ptr error; // exceção que encerrou a thread (nula se ela terminou normalmente)
+    };
+
+    // capacity: máximo de eventos não consumidos (no orquestrador, o número de threads)
+    explicit CompletionQueue(size_t capacity);
+
+    // Threads das tasks
+    void push(uint32_t group, uint32_t slot, std::exception_ptr error = nullptr);
+
+    // Orquestrador (uma única thread): espera o próximo evento
+    Event pop();
+    // Orquestrador: false se não há evento
+    bool tryPop(Event& event);
+
+private:
+    MpscRing<Event> ring;
+    std::counting_semaphore<> available{0};
+
+    Event take();
+};
+
+#endif
@@ -8,6 +8,9 @@
 #include <stdexcept>
 #include <memory>
 #include <typeinfo>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
 
 #include <unordered_map> // para identificação da posição das colunas
 // tomar cuidado com isso caso a gente implemente uma função de remover colunas
@@ -17,6 +20,7 @@
 
 #include "utils.h"
 #include "types.h"
+#include "hashindex.h"
 
 class BaseColumn {
 protected:
@@ -43,6 +47,18 @@ public:
     virtual void addAny(const std::string& value) = 0;
     virtual void addAny(const VarCell& value) = 0;
     virtual void appendNA() {};
+    virtual void reserve(size_t n) {};
+    // Acrescenta todos os valores de outra coluna do mesmo tipo (lança std::bad_cast se o tipo diferir)
+    virtual void appendColumn(const BaseColumn& other) = 0;
+    // Acrescenta só os valores de 'rows' de outra coluna do mesmo tipo, nessa ordem
+    virtual void appendRows(const BaseColumn& other, const std::vector<size_t>& rows) = 0;
+    // Formato binário dos valores (ex.: log de ingestão): tipos numéricos como bytes contíguos,
+    // strings com o tamanho (uint32) antes de cada uma. readBinary acrescenta 'rows' valores lidos
+    // de data e retorna quantos bytes consumiu (std::runtime_error se os bytes não bastarem).
+    virtual void writeBinary(std::string& out) const = 0;
+    virtual size_t readBinary(const char* data, size_t len, size_t rows) = 0;
+    // Memória ocupada pelos valores (capacidade do vetor e, em strings, o conteúdo fora do objeto)
+    virtual size_t memoryBytes() const = 0;
 
     virtual std::shared_ptr<BaseColumn> cloneEmpty() const = 0;
 };
@@ -57,6 +73,7 @@ public:
     Column(const std::string &id, int pos = -1, T NAValue = NullValue<T>::value());
 
     void addValue(const T &value);
+    void addValue(T &&value) { data.push_back(std::move(value)); }
 
     void addAny(const std::any& value) override {
         data.push_back(std::any_cast<T>(value));
@@ -84,6 +101,64 @@ public:
     const std::vector<T>& getData() const { return data; }
     
     void appendNA() override;
+    void reserve(size_t n) override { data.reserve(n); }
+    void appendColumn(const BaseColumn& other) override {
+        const auto& values = dynamic_cast<const Column<T>&>(other).data;
+        data.insert(data.end(), values.begin(), values.end());
+    }
+    void appendRows(const BaseColumn& other, const std::vector<size_t>& rows) override {
+        const auto& values = dynamic_cast<const Column<T>&>(other).data;
+        data.reserve(data.size() + rows.size());
+        for (size_t r : rows) data.push_back(values[r]);
+    }
+
+    void writeBinary(std::string& out) const override {
+        if constexpr (std::is_same_v<T, std::string>) {
+            for (const auto& value : data) {
+                uint32_t n = static_cast<uint32_t>(value.size());
+                out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+                out.append(value);
+            }
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>, "Column::writeBinary: type without binary format.");
+            out.append(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+        }
+    }
+
+    size_t readBinary(const char* bytes, size_t len, size_t rows) override {
+        size_t used = 0;
+        data.reserve(data.size() + rows);
+        if constexpr (std::is_same_v<T, std::string>) {
+            for (size_t r = 0; r < rows; r++) {
+                uint32_t n;
+                if (len - used < sizeof(n)) throw std::runtime_error("Column::readBinary: truncated data.");
+                std::memcpy(&n, bytes + used, sizeof(n));
+                used += sizeof(n);
+                if (len - used < n) throw std::runtime_error("Column::readBinary: truncated data.");
+                data.emplace_back(bytes + used, n);
+                used += n;
+            }
+        } else {
+            used = rows * sizeof(T);
+            if (len < used) throw std::runtime_error("Column::readBinary: truncated data.");
+            size_t start = data.size();
+            data.resize(start + rows);
+            std::memcpy(data.data() + start, bytes, used);
+        }
+        return used;
+    }
+
+    size_t memoryBytes() const override {
+        size_t bytes = data.capacity() * sizeof(T);
+        if constexpr (std::is_same_v<T, std::string>) {
+            // Strings curtas ficam dentro do próprio objeto (SSO)
+            static const size_t inlineCapacity = std::string().capacity();
+            for (const auto& value : data) {
+                if (value.capacity() > inlineCapacity) bytes += value.capacity() + 1;
+            }
+        }
+        return bytes;
+    }
 
     std::shared_ptr<BaseColumn> cloneEmpty() const override {
         return std::make_shared<Column<T>>(identifier, position, NAValue);
@@ -91,11 +166,17 @@ public:
 };
 
 
+class KeyIndex;
+
 class DataFrame {
 private:
     size_t dataFrameSize = 0;
     std::vector<std::shared_ptr<BaseColumn>> columns;
     std::unordered_map<std::string, int> columnMap;
+    std::shared_ptr<const KeyIndex> keyIndex;
+    std::string version;
+
+    void checkSameColumns(const DataFrame &other, const char* caller) const;
 
 public:
     void addColumn(std::shared_ptr<BaseColumn> column);
@@ -121,9 +202,55 @@ public:
     void addRow(const std::vector<std::any> &row);
     void addRow(const std::vector<std::string> &row);
     void addRow(const std::vector<VarCell> &row);
+    // Acrescenta as linhas de outro DataFrame com as mesmas colunas (mesma ordem e tipos),
+    // coluna a coluna, sem passar por células genéricas
+    void append(const DataFrame &other);
+    // Idem, só com as linhas 'rows' de other (ex.: para dividir um batch entre partições)
+    void append(const DataFrame &other, const std::vector<size_t> &rows);
+
+    // Linhas em formato binário, coluna a coluna (número de linhas e de colunas, depois os valores)
+    void writeBinary(std::string &out);
+    // Acrescenta as linhas gravadas por writeBinary de um DataFrame com as mesmas colunas
+    void appendBinary(const char *data, size_t len);
+    // Memória ocupada pelas colunas (O(linhas) com colunas de string)
+    size_t memoryBytes() const;
 
     std::shared_ptr<DataFrame> emptyCopy();
     std::shared_ptr<DataFrame> emptyCopy(std::vector<std::string> colNames);
+
+    // Índice opcional chave -> linha sobre uma coluna de strings (ex.: id_usuario do cadastro).
+    // Reflete as linhas existentes quando foi construído; não é copiado pelo emptyCopy.
+    void buildKeyIndex(const std::string& columnName);
+    // Retorna nullptr se não há índice construído para essa coluna
+    std::shared_ptr<const KeyIndex> getKeyIndex(const std::string& columnName) const;
+
+    // Versão opcional do conteúdo (ex.: a versão da fonte de onde foi extraído): dois DataFrames com
+    // a mesma versão não vazia têm o mesmo conteúdo. Usada pela memoização dos tratadores. Quem altera
+    // as linhas depois de dar uma versão deve trocá-la (ou limpá-la); não é copiada pelo emptyCopy.
+    void setVersion(const std::string& newVersion) { version = newVersion; }
+    const std::string& getVersion() const { return version; }
+    // Hash de 64 bits do conteúdo (nomes e tipos das colunas e valores), O(linhas)
+    uint64_t contentFingerprint() const;
+};
+
+class KeyIndex {
+public:
+    static constexpr size_t npos = FlatHashIndex<std::string>::npos;
+
+    KeyIndex(const DataFrame& df, const std::string& columnName);
+
+    // Linha da chave (a última, se a chave se repete) ou npos
+    size_t findRow(const std::string& key) const {
+        size_t id = keys.find(key);
+        return id == npos ? npos : rows[id];
+    }
+    const std::string& getColumnName() const { return columnName; }
+    size_t size() const { return keys.size(); }
+
+private:
+    std::string columnName;
+    FlatHashIndex<std::string> keys;
+    std::vector<size_t> rows;
 };
 
 
@@ -6,6 +6,7 @@
 #include <fstream>
 #include <stdexcept>
 #include <memory>
+#include <mutex>
 
 #include <sqlite3.h>
 
@@ -31,6 +32,10 @@ public:
     virtual std::string serializeBatch(const std::vector<StrRow>& data) { return ""; };
 
     virtual bool hasNext() const = 0;
+
+    // Identifica o estado atual da fonte (ex.: data de modificação do arquivo), para saber se
+    // um dado já extraído ainda é válido. Vazio se a fonte não sabe informar.
+    virtual std::string getVersion() { return ""; };
     
     virtual void resetReader() {};
     virtual void clear() {};
@@ -51,6 +56,9 @@ private:
     
     std::ifstream inFile;
     std::ofstream outFile;
+    // Compartilhado por todos os repositórios que escrevem no mesmo arquivo (ex.: instâncias
+    // concorrentes da mesma pipeline): cada append vai inteiro para o arquivo, sem intercalar linhas
+    std::shared_ptr<std::mutex> writeMutex;
     size_t currentReadLine;
     size_t totalLines;
     std::string currLine;
@@ -81,9 +89,16 @@ public:
 
     bool hasNext() const override { return hasNextLine; }
 
+    std::string getVersion() override;
+
     void resetReader() override;
     void close() override;
     void clear() override;
+
+    // Passa a ler outro arquivo, do início (sem abri-lo para escrita): usado para apontar o extrator
+    // para cada arquivo novo que chega numa pasta
+    void setFile(const std::string& fname);
+    const std::string& getFileName() const { return fileName; }
 };
 
 
@@ -132,6 +147,8 @@ public:
 
     bool hasNext() const override { return !done; }
 
+    std::string getVersion() override;
+
     void resetReader() override;
     void clear() override;
     void close() override;
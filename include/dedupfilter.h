@@ -0,0 +1,102 @@
+#ifndef DEDUPFILTER_H
+#define DEDUPFILTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+
+/*
+Filtro de ids já vistos (por exemplo id_transacao), para que reenvios do cliente ou replays não
+sejam processados duas vezes.
+
+  - Cada id é guardado como uma impressão de 64 bits (hash do id) numa tabela de endereçamento aberto,
+    8 bytes por slot: dezenas de milhões de ids cabem em algumas centenas de MB. Dois ids diferentes
+    com a mesma impressão são tratados como repetidos; com 50 milhões de ids na janela a chance de
+    isso acontecer alguma vez é da ordem de 1e-4.
+  - O filtro é dividido em shards pelos bits altos da impressão, cada um com seu mutex, então threads
+    que inserem ids diferentes quase nunca disputam o mesmo lock.
+  - Expiração por janela de tempo em duas gerações: cada shard tem a geração atual e a anterior, e a
+    cada 'window' a anterior é descartada inteira e a atual passa a ser a anterior. Um id é lembrado
+    por pelo menos 'window' e no máximo 2 * window, sem custo de expiração por id.
+
+Uso:
+    DedupFilter filtro;
+    if (filtro.insert(transacao.id_transacao())) { ... processa ... } // false: repetida
+*/
+class DedupFilter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::chrono::seconds window{600}; // tempo mínimo em que um id é lembrado
+        size_t expectedIds = 1 << 20;     // ids por janela, para dimensionar as tabelas de início
+        size_t numShards = 64;            // arredondado para potência de 2
+    };
+
+    struct Stats {
+        uint64_t checked = 0;    // chamadas de insert
+        uint64_t duplicates = 0; // ids recusados por já terem sido vistos
+        size_t size = 0;         // ids lembrados agora (nas duas gerações)
+        size_t memoryBytes = 0;  // memória das tabelas
+    };
+
+    DedupFilter();
+    explicit DedupFilter(Options options);
+
+    DedupFilter(const DedupFilter&) = delete;
+    DedupFilter& operator=(const DedupFilter&) = delete;
+
+    // Registra o id e retorna true se ele não foi visto dentro da janela; false se é repetido.
+    // Thread-safe.
+    bool insert(std::string_view id);
+    bool insert(std::string_view id, Clock::time_point now);
+    // Só consulta, sem registrar
+    bool contains(std::string_view id) const;
+    // Esquece o id, por exemplo quando o batch em que ele veio foi recusado e o cliente vai
+    // reenviá-lo. Retorna false se ele não estava no filtro.
+    bool erase(std::string_view id);
+
+    Stats getStats() const;
+
+private:
+    // Conjunto de impressões com sondagem linear (0 marca slot vazio)
+    class FingerprintSet {
+    public:
+        explicit FingerprintSet(size_t expected);
+        bool insert(uint64_t fingerprint);        // false se já estava
+        bool contains(uint64_t fingerprint) const;
+        bool erase(uint64_t fingerprint);         // false se não estava
+        void clear();
+        size_t size() const { return count; }
+        size_t memoryBytes() const { return slots.size() * sizeof(uint64_t); }
+    private:
+        std::vector<uint64_t> slots;
+        size_t count = 0;
+        size_t mask = 0;
+        void grow();
+    };
+
+    // Contadores também por shard, sob o mesmo lock, para não criar um ponto de disputa global
+    struct alignas(64) Shard {
+        mutable std::mutex mtx;
+        std::unique_ptr<FingerprintSet> current;
+        std::unique_ptr<FingerprintSet> previous;
+        Clock::time_point generationStart;
+        uint64_t checked = 0;
+        uint64_t duplicates = 0;
+        void rotate(Clock::time_point now, Clock::duration window);
+    };
+
+    Options options;
+    std::vector<Shard> shards;
+    int shardShift = 64; // impressão >> shardShift = shard
+
+    static uint64_t fingerprint(std::string_view id);
+    size_t shardIndex(uint64_t fingerprint) const;
+};
+
+#endif
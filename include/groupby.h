@@ -0,0 +1,314 @@
+#ifndef GROUPBY_H
+#define GROUPBY_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <typeinfo>
+
+#include "dataframe.h"
+#include "hashindex.h"
+
+// Operador de agregação por chave (group-by) sobre colunas de um DataFrame.
+//
+// A execução paralela tem duas fases:
+//   1) cada thread percorre um bloco contíguo de linhas e pré-agrega em tabelas locais,
+//      uma por partição (a partição é escolhida pelos bits altos do hash da chave);
+//   2) cada thread junta, em ordem de bloco, a mesma partição de todas as tabelas locais.
+// Como as partições são disjuntas, a fase de junção não precisa de nenhum lock.
+//
+// Exemplo (média de valor por usuário):
+//   auto res = GroupBy<std::string>(df, "id_usuario_pagador")
+//                  .agg("valor_transacao", AggOp::Mean, "media")
+//                  .execute(numThreads);
+//   double m = res->get(res->findGroup(uid), res->aggIndex("media"));
+
+enum class AggOp { Sum, Count, Mean, Min, Max, First, Last };
+
+// Estado parcial de uma agregação para um grupo. Guarda tudo que qualquer AggOp precisa,
+// assim duas parciais sempre podem ser combinadas.
+struct AggState {
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double first = 0.0;
+    double last = 0.0;
+    long long count = 0;
+
+    void add(double v) {
+        if (count == 0) first = v;
+        last = v;
+        sum += v;
+        if (v < min) min = v;
+        if (v > max) max = v;
+        count++;
+    }
+
+    // 'other' deve vir depois de *this na ordem das linhas
+    void merge(const AggState& other) {
+        if (other.count == 0) return;
+        if (count == 0) first = other.first;
+        last = other.last;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        count += other.count;
+    }
+
+    double value(AggOp op) const {
+        switch (op) {
+            case AggOp::Sum:   return sum;
+            case AggOp::Count: return static_cast<double>(count);
+            case AggOp::Mean:  return count > 0 ? sum / count : 0.0;
+            case AggOp::Min:   return min;
+            case AggOp::Max:   return max;
+            case AggOp::First: return first;
+            case AggOp::Last:  return last;
+        }
+        return 0.0;
+    }
+};
+
+template <typename K>
+class GroupBy;
+
+template <typename K>
+class GroupByResult {
+public:
+    static constexpr size_t npos = FlatHashIndex<K>::npos;
+
+    size_t numGroups() const { return offsets.empty() ? 0 : offsets.back(); }
+
+    // Id global do grupo da chave, ou npos se a chave não apareceu
+    size_t findGroup(const K& key) const {
+        size_t h = FlatHashIndex<K>::hashOf(key);
+        size_t p = partitionOf(h, partitions.size());
+        size_t local = partitions[p].index.find(key, h);
+        return local == npos ? npos : offsets[p] + local;
+    }
+
+    const K& getKey(size_t group) const {
+        auto [p, local] = locate(group);
+        return partitions[p].index.getKey(local);
+    }
+
+    size_t aggIndex(const std::string& alias) const {
+        for (size_t a = 0; a < aliases.size(); a++) {
+            if (aliases[a] == alias) return a;
+        }
+        throw std::out_of_range("Aggregation not in GroupByResult.");
+    }
+
+    double get(size_t group, size_t aggIdx) const {
+        auto [p, local] = locate(group);
+        return partitions[p].states[local * ops.size() + aggIdx].value(ops[aggIdx]);
+    }
+
+    double get(const K& key, const std::string& alias, double defaultValue = 0.0) const {
+        size_t group = findGroup(key);
+        return group == npos ? defaultValue : get(group, aggIndex(alias));
+    }
+
+    // Materializa o resultado como DataFrame: coluna da chave seguida de uma coluna por agregação
+    std::shared_ptr<DataFrame> toDataFrame(const std::string& keyColumn) const {
+        auto keyCol = std::make_shared<Column<K>>(keyColumn, 0);
+        std::vector<std::shared_ptr<Column<double>>> aggCols;
+        for (size_t a = 0; a < aliases.size(); a++) {
+            aggCols.push_back(std::make_shared<Column<double>>(aliases[a], a + 1));
+        }
+        for (const auto& part : partitions) {
+            for (size_t local = 0; local < part.index.size(); local++) {
+                keyCol->addValue(part.index.getKey(local));
+                for (size_t a = 0; a < ops.size(); a++) {
+                    aggCols[a]->addValue(part.states[local * ops.size() + a].value(ops[a]));
+                }
+            }
+        }
+        auto df = std::make_shared<DataFrame>();
+        df->addColumn(keyCol);
+        for (auto& col : aggCols) df->addColumn(col);
+        return df;
+    }
+
+private:
+    friend class GroupBy<K>;
+
+    struct Partition {
+        FlatHashIndex<K> index;
+        std::vector<AggState> states; // numGroups * numAggs, agrupado por grupo
+    };
+
+    std::vector<Partition> partitions;
+    std::vector<size_t> offsets; // offsets[p] = id global do primeiro grupo da partição p
+    std::vector<AggOp> ops;
+    std::vector<std::string> aliases;
+
+    static size_t partitionOf(size_t h, size_t numPartitions) {
+        return numPartitions == 1 ? 0 : (h >> 40) % numPartitions;
+    }
+
+    std::pair<size_t, size_t> locate(size_t group) const {
+        size_t p = std::upper_bound(offsets.begin(), offsets.end(), group) - offsets.begin() - 1;
+        return {p, group - offsets[p]};
+    }
+};
+
+template <typename K>
+class GroupBy {
+public:
+    GroupBy(std::shared_ptr<DataFrame> df, const std::string& keyColumn) : df(df) {
+        auto col = std::dynamic_pointer_cast<Column<K>>(df->getColumn(keyColumn));
+        if (!col) {
+            throw std::bad_cast();
+        }
+        keys = &col->getData();
+    }
+
+    // Restringe a agregação a um subconjunto de linhas (por padrão usa todas). Os índices são
+    // guardados pelo GroupBy, então um vetor temporário pode ser passado
+    GroupBy& onRows(std::vector<int> indexes) {
+        rows = std::move(indexes);
+        allRows = false;
+        return *this;
+    }
+
+    GroupBy& agg(const std::string& valueColumn, AggOp op, std::string alias = "") {
+        if (alias.empty()) alias = valueColumn;
+        return addAgg(columnAsDouble(valueColumn), op, alias);
+    }
+
+    // Agrega um vetor de valores já calculado (indexado pela linha do DataFrame)
+    GroupBy& agg(std::vector<double> values, AggOp op, const std::string& alias) {
+        if (values.size() != keys->size()) {
+            throw std::invalid_argument("Aggregated values must have the DataFrame number of rows.");
+        }
+        owned.push_back(std::make_shared<std::vector<double>>(std::move(values)));
+        return addAgg(owned.back().get(), op, alias);
+    }
+
+    GroupBy& count(const std::string& alias = "count") {
+        return addAgg(nullptr, AggOp::Count, alias);
+    }
+
+    std::shared_ptr<GroupByResult<K>> execute(int numThreads = 1) const {
+        const size_t n = allRows ? keys->size() : rows.size();
+        // Não compensa criar threads para poucos dados
+        const size_t minRowsPerThread = 4096;
+        size_t nThreads = std::max<size_t>(1, std::min<size_t>(numThreads, n / minRowsPerThread));
+
+        auto result = std::make_shared<GroupByResult<K>>();
+        result->ops = ops;
+        result->aliases = aliases;
+        result->partitions.resize(nThreads);
+
+        if (nThreads == 1) {
+            aggregateRange(0, n, result->partitions);
+        } else {
+            // Fase 1: pré-agregação local, particionada
+            std::vector<std::vector<typename GroupByResult<K>::Partition>> locals(nThreads);
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < nThreads; t++) {
+                size_t begin = t * (n / nThreads);
+                size_t end = (t == nThreads - 1) ? n : (t + 1) * (n / nThreads);
+                locals[t].resize(nThreads);
+                threads.emplace_back(&GroupBy::aggregateRange, this, begin, end, std::ref(locals[t]));
+            }
+            for (auto& th : threads) th.join();
+            threads.clear();
+
+            // Fase 2: cada thread junta uma partição, na ordem dos blocos (mantém first/last)
+            for (size_t p = 0; p < nThreads; p++) {
+                threads.emplace_back([this, p, &locals, &result]() {
+                    mergePartition(result->partitions[p], locals, p);
+                });
+            }
+            for (auto& th : threads) th.join();
+        }
+
+        result->offsets.resize(nThreads + 1, 0);
+        for (size_t p = 0; p < nThreads; p++) {
+            result->offsets[p + 1] = result->offsets[p] + result->partitions[p].index.size();
+        }
+        return result;
+    }
+
+private:
+    std::shared_ptr<DataFrame> df;
+    const std::vector<K>* keys = nullptr;
+    std::vector<int> rows;
+    bool allRows = true;
+
+    std::vector<const std::vector<double>*> values; // nullptr = só contagem
+    std::vector<AggOp> ops;
+    std::vector<std::string> aliases;
+    std::vector<std::shared_ptr<std::vector<double>>> owned;
+
+    GroupBy& addAgg(const std::vector<double>* vals, AggOp op, const std::string& alias) {
+        values.push_back(vals);
+        ops.push_back(op);
+        aliases.push_back(alias);
+        return *this;
+    }
+
+    // Colunas double são lidas direto; int e long long são convertidas uma vez
+    const std::vector<double>* columnAsDouble(const std::string& name) {
+        auto col = df->getColumn(name);
+        if (auto dcol = std::dynamic_pointer_cast<Column<double>>(col)) {
+            return &dcol->getData();
+        }
+        auto converted = std::make_shared<std::vector<double>>();
+        if (auto icol = std::dynamic_pointer_cast<Column<int>>(col)) {
+            converted->assign(icol->getData().begin(), icol->getData().end());
+        } else if (auto lcol = std::dynamic_pointer_cast<Column<long long int>>(col)) {
+            converted->assign(lcol->getData().begin(), lcol->getData().end());
+        } else {
+            throw std::bad_cast();
+        }
+        owned.push_back(converted);
+        return converted.get();
+    }
+
+    void aggregateRange(size_t begin, size_t end,
+                        std::vector<typename GroupByResult<K>::Partition>& parts) const {
+        const size_t numAggs = ops.size();
+        const size_t numParts = parts.size();
+        for (size_t i = begin; i < end; i++) {
+            size_t row = allRows ? i : static_cast<size_t>(rows[i]);
+            const K& key = (*keys)[row];
+            size_t h = FlatHashIndex<K>::hashOf(key);
+            auto& part = parts[GroupByResult<K>::partitionOf(h, numParts)];
+            auto [id, inserted] = part.index.insert(key, h);
+            if (inserted) {
+                part.states.resize(part.states.size() + numAggs);
+            }
+            AggState* st = &part.states[id * numAggs];
+            for (size_t a = 0; a < numAggs; a++) {
+                st[a].add(values[a] ? (*values[a])[row] : 0.0);
+            }
+        }
+    }
+
+    void mergePartition(typename GroupByResult<K>::Partition& target,
+                        const std::vector<std::vector<typename GroupByResult<K>::Partition>>& locals,
+                        size_t p) const {
+        const size_t numAggs = ops.size();
+        for (const auto& local : locals) {
+            const auto& src = local[p];
+            for (size_t id = 0; id < src.index.size(); id++) {
+                auto [gid, inserted] = target.index.insert(src.index.getKey(id), src.index.getHash(id));
+                if (inserted) {
+                    target.states.resize(target.states.size() + numAggs);
+                }
+                for (size_t a = 0; a < numAggs; a++) {
+                    target.states[gid * numAggs + a].merge(src.states[id * numAggs + a]);
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Tabela hash de endereçamento aberto (sondagem linear) que associa cada chave a um id denso
+// (0, 1, 2, ...) na ordem de inserção. Chaves e hashes ficam em vetores contíguos e a tabela de
+// slots guarda só índices de 32 bits, então não há uma alocação por chave como nos nós da
+// std::unordered_map, e o hash de cada chave é calculado uma única vez.
+template <typename K, typename Hash = std::hash<K>>
+class FlatHashIndex {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    explicit FlatHashIndex(size_t expectedKeys = 16) { reserve(expectedKeys); }
+
+    // Hash já "misturado": std::hash<int> é a identidade, então os bits altos (usados para
+    // particionar) e os baixos (usados para o slot) precisam ser espalhados.
+    static size_t hashOf(const K& key) {
+        uint64_t h = static_cast<uint64_t>(Hash{}(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    size_t find(const K& key) const { return find(key, hashOf(key)); }
+
+    size_t find(const K& key, size_t h) const {
+        if (keys.empty()) return npos;
+        const size_t mask = slots.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            uint32_t slot = slots[i];
+            if (slot == 0) return npos;
+            size_t id = slot - 1;
+            if (hashes[id] == h && keys[id] == key) return id;
+        }
+    }
+
+    // Retorna o id da chave e se ela foi inserida agora
+    std::pair<size_t, bool> insert(const K& key) { return insert(key, hashOf(key)); }
+
+    std::pair<size_t, bool> insert(const K& key, size_t h) {
+        // Mantém o fator de carga abaixo de 1/2 para sondagens curtas
+        if ((keys.size() + 1) * 2 > slots.size()) {
+            rehash(slots.size() * 2);
+        }
+        const size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        for (; ; i = (i + 1) & mask) {
+            uint32_t slot = slots[i];
+            if (slot == 0) break;
+            size_t id = slot - 1;
+            if (hashes[id] == h && keys[id] == key) return {id, false};
+        }
+        keys.push_back(key);
+        hashes.push_back(h);
+        slots[i] = static_cast<uint32_t>(keys.size());
+        return {keys.size() - 1, true};
+    }
+
+    void reserve(size_t expectedKeys) {
+        size_t capacity = 16;
+        while (capacity < expectedKeys * 2) capacity <<= 1;
+        keys.reserve(expectedKeys);
+        hashes.reserve(expectedKeys);
+        if (capacity > slots.size()) rehash(capacity);
+    }
+
+    void clear() {
+        keys.clear();
+        hashes.clear();
+        std::fill(slots.begin(), slots.end(), 0);
+    }
+
+    size_t size() const { return keys.size(); }
+    const K& getKey(size_t id) const { return keys[id]; }
+    size_t getHash(size_t id) const { return hashes[id]; }
+    const std::vector<K>& getKeys() const { return keys; }
+
+private:
+    std::vector<K> keys;
+    std::vector<size_t> hashes;
+    std::vector<uint32_t> slots; // 0 = vazio, senão id + 1
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, 0);
+        const size_t mask = capacity - 1;
+        for (size_t id = 0; id < keys.size(); id++) {
+            size_t i = hashes[id] & mask;
+            while (slots[i] != 0) i = (i + 1) & mask;
+            slots[i] = static_cast<uint32_t>(id + 1);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef MPSCRING_H
+#define MPSCRING_H
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Fila circular limitada, sem locks, para vários produtores e um único consumidor (por exemplo,
+// threads do servidor entregando batches para a thread do PipelineManager).
+// Cada slot tem um número de sequência que diz de quem é a vez: o produtor reserva uma posição
+// com um CAS sobre 'tail', escreve o valor e publica o slot; o consumidor só lê slots publicados.
+// Não há mutex nem chamada ao sistema: um produtor só repete o CAS quando outro pegou a mesma
+// posição, e nenhum produtor bloqueia o consumidor.
+template <typename T>
+class MpscRing {
+public:
+    // capacity é arredondada para a próxima potência de 2, no mínimo 2 (com um slot só, o número de
+    // sequência de um slot publicado seria igual ao da próxima posição e o produtor o sobrescreveria)
+    explicit MpscRing(size_t capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("MpscRing: capacity must be positive.");
+        }
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        mask = n - 1;
+        slots = std::make_unique<Slot[]>(n);
+        for (size_t i = 0; i < n; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Produtores: false se a fila está cheia (o valor não é consumido)
+    bool tryPush(T&& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // Slot livre nesta volta: tenta reservá-lo
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // o consumidor ainda não liberou o slot da volta anterior
+            } else {
+                pos = tail.load(std::memory_order_relaxed); // outro produtor pegou esta posição
+            }
+        }
+    }
+
+    // Consumidor (uma única thread): false se não há valor publicado
+    bool tryPop(T& value) {
+        Slot& slot = slots[head & mask];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        if (seq != head + 1) return false;
+        value = std::move(slot.value);
+        slot.value = T();
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Consumidor: há um valor publicado pronto para tryPop
+    bool readable() const {
+        return slots[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    // Linhas de cache separadas: mask e slots (só lidos depois da construção, por todos), tail
+    // (disputado pelos produtores) e head (escrito a cada pop, só pelo consumidor). Com mask e slots
+    // na linha de head, cada pop invalidaria a linha que todo push lê. O alinhamento da classe
+    // arredonda seu tamanho para múltiplos de 64, então o que vier depois do anel não divide a linha de head.
+    alignas(64) size_t mask = 0;
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0;
+};
+
+#endif
@@ -2,16 +2,20 @@
 #define PIPELINEMANAGER_HPP
 
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <memory>
+#include <functional>
+#include <cstdint>
+#include <deque>
 
-#include "types.h" // Para DataBatch, VarRow, etc.
 #include "dataframe.h" // Para DataFrame
 #include "trigger.hpp" // Para IPipelineExecutor
+#include "triggerpolicy.hpp" // Para TriggerPolicy
+#include "mpscring.h" // Para a fila de entrada dos batches
+#include "ingestlog.h" // Para o log de ingestão
 
 class PipelineManager {
 public:
@@ -29,6 +33,16 @@ public:
                     DataFrame empty_dataframe, 
                     size_t pipelineNumThreads=8, 
                     size_t df_trigger_size=1);
+    /*
+    Construtor com várias instâncias da mesma pipeline (cada uma com seu próprio DAG):
+      - pipeline_triggers: as instâncias. Cada disparo vai para uma instância livre, então até
+                           pipeline_triggers.size() execuções rodam ao mesmo tempo, cada uma com
+                           pipelineNumThreads threads.
+    */
+    PipelineManager(std::vector<ServerTrigger*> pipeline_triggers,
+                    DataFrame empty_dataframe,
+                    size_t pipelineNumThreads=8,
+                    size_t df_trigger_size=1);
     ~PipelineManager();
 
     // Impede cópia e atribuição para simplificar o gerenciamento da thread e mutexes.
@@ -37,9 +51,48 @@ public:
     PipelineManager(PipelineManager&&) = delete;
     PipelineManager& operator=(PipelineManager&&) = delete;
 
-    // Método para o servidor gRPC submeter um batch.
-    // Este é o principal ponto de entrada de dados no PipelineManager. É thread-safe.
-    void submitDataBatch(DataBatch batch);
+    // Método para o servidor gRPC submeter um batch, já em colunas (mesmas colunas de empty_dataframe).
+    // Este é o principal ponto de entrada de dados no PipelineManager. É thread-safe e não usa
+    // locks: os produtores só disputam a posição na fila de entrada (MpscRing).
+    // Retorna false se o batch foi descartado (manager parado ou acima de maxPendingRows).
+    bool submitDataBatch(std::shared_ptr<DataFrame> batch);
+
+    // Limites da ingestão, em linhas recebidas e ainda não entregues à pipeline (fila + acumulado).
+    // 0 desliga o limite correspondente (padrão: sem limites).
+    //  - highWatermark: ao ser atingido, isAccepting() passa a false e os produtores devem parar de ler;
+    //  - lowWatermark: quando as pendentes voltam a ele, isAccepting() volta a true e os callbacks
+    //    registrados em whenAccepting() são chamados;
+    //  - maxPendingRows: batches que passariam desse total são descartados.
+    // Chamar antes de start().
+    void setIngestLimits(size_t lowWatermark, size_t highWatermark, size_t maxPendingRows);
+    bool isAccepting() const { return accepting.load(); };
+    // Chama callback quando a ingestão sair da pausa (na hora, se não estiver em pausa). O callback
+    // roda na thread do manager e não deve bloquear.
+    void whenAccepting(std::function<void()> callback);
+
+    struct IngestStats {
+        size_t pendingRows = 0;
+        size_t peakPendingRows = 0;
+        uint64_t pauses = 0;          // vezes que o highWatermark foi atingido
+        double pausedMs = 0.0;        // tempo total em pausa (produtores atrasados)
+        uint64_t droppedBatches = 0;
+        uint64_t droppedRows = 0;
+        uint64_t ingressFullWaits = 0; // submits que encontraram a fila de entrada cheia
+    };
+    IngestStats getIngestStats() const;
+
+    // Grava cada batch aceito no log antes de entregá-lo à pipeline e o confirma quando a execução
+    // que o processou é confirmada (nullptr: sem log). Os batches de uma execução que falhou não são
+    // confirmados: voltam no recover() da próxima inicialização, e até lá a marca contígua do log
+    // (e os segmentos a partir deles) fica parada neles. O log já deve ter sido iniciado. Chamar antes de start().
+    void setIngestLog(IngestLog* log);
+
+    // Chamado na thread do manager com o DataFrame de cada execução que falhou ou foi cancelada (o
+    // estado do batch foi desfeito), para avisar quem espera pelas suas linhas. Chamar antes de start().
+    void setOnRunFailed(std::function<void(DataFrame&)> callback);
+
+    // Troca o critério de disparo (padrão: SizeTriggerPolicy(df_trigger_size)). Chamar antes de start().
+    void setTriggerPolicy(std::unique_ptr<TriggerPolicy> policy);
 
     // Inicia a thread de processamento interna do PipelineManager.
     void start();
@@ -50,21 +103,83 @@ public:
 private:
     // Loop principal executado pela thread interna do PipelineManager.
     void processingLoop();
+    // Índice de uma instância livre, ou -1 se todas estiverem executando
+    int freeInstance() const;
+    void releasePending(size_t rows);
+    size_t clampedPending() const;
+    // Batch recusado por maxPendingRows
+    void dropBatch(size_t rows);
+
+    std::vector<ServerTrigger*> pipeline_triggers; // Instâncias da pipeline concreta
+
+    // Estado para o critério de disparo no momento atual
+    TriggerState currentState() const;
+
+    struct QueuedBatch {
+        std::shared_ptr<DataFrame> rows;
+        TriggerPolicy::Clock::time_point arrival;
+        uint64_t sequence = 0; // no log de ingestão (0: não gravado)
+    };
+    // Fila de entrada dos batches: muitos produtores, consumida só pela worker_thread
+    static constexpr size_t ingressCapacity = 4096;
+    MpscRing<QueuedBatch> ingress{ingressCapacity};
+    // A worker_thread vai dormir na CV: só então os produtores precisam travar queue_mutex para acordá-la
+    std::atomic<bool> consumer_sleeping{false};
+    void wakeConsumer();
+
+    struct FinishedRun {
+        size_t instance;
+        size_t rows;
+        double elapsedMs;
+        bool committed;   // false: a execução falhou ou foi cancelada
+    };
+    std::vector<FinishedRun> finished_runs; // execuções terminadas desde a última volta do loop
+    std::mutex queue_mutex;             // Mutex para proteger finished_runs e o sono da worker_thread
+    std::condition_variable queue_cv;   // CV para sinalizar novos dados na fila ou execuções terminadas
+
+    // Ingestão limitada. Limites fixados antes de start(); no caminho do submit só pending_rows é
+    // escrito (um fetch_add), os demais contadores só na recusa ou pela worker_thread.
+    size_t low_watermark = 0;
+    size_t high_watermark = 0;
+    size_t max_pending_rows = 0;
+    std::atomic<size_t> pending_rows{0};
+    std::atomic<size_t> peak_pending_rows{0};
+    std::atomic<uint64_t> dropped_batches{0};
+    std::atomic<uint64_t> dropped_rows{0};
+    std::atomic<uint64_t> ingress_full_waits{0};
+    std::atomic<bool> accepting{true};
+    // Pausa (caminho raro), protegida por ingest_mutex
+    mutable std::mutex ingest_mutex;
+    bool paused = false;
+    TriggerPolicy::Clock::time_point paused_since;
+    std::vector<std::function<void()>> resume_listeners;
+    uint64_t pauses = 0;
+    double paused_ms = 0.0;
+    void pauseIfAbove();
+
+    // Log de ingestão: sequências das linhas acumuladas e, por instância, das execuções em
+    // andamento (em ordem de disparo; as execuções de uma instância terminam nessa ordem)
+    IngestLog* ingest_log = nullptr;
+    std::vector<uint64_t> waiting_sequences;
+    std::vector<std::deque<std::vector<uint64_t>>> running_sequences;
 
-    ServerTrigger& pipeline_trigger; // Referência ao trigger da pipeline concreta
+    // DataFrame das execuções em andamento de cada instância, guardado só com on_run_failed
+    std::function<void(DataFrame&)> on_run_failed;
+    std::vector<std::deque<std::shared_ptr<DataFrame>>> running_batches;
 
-    std::queue<DataBatch> batchs_queue; // Fila para os batches que chegam
-    std::mutex queue_mutex;             // Mutex para proteger batchs_queue
-    std::condition_variable queue_cv;   // CV para sinalizar novos dados na fila
+    std::unique_ptr<TriggerPolicy> trigger_policy; // Decide quando disparar (usado só pela worker_thread)
+    TriggerPolicy::Clock::time_point oldest_pending; // Chegada do batch mais antigo em waiting_dataframe
 
-    DataFrame waiting_dataframe, running_dataframe; // Onde os batches são acumulados
+    // Onde os batches são acumulados. No disparo o ponteiro é entregue à pipeline e trocado por um
+    // DataFrame vazio, então a passagem custa O(colunas) e nenhuma linha é copiada.
+    std::shared_ptr<DataFrame> waiting_dataframe;
 
     std::thread worker_thread;      // A thread que executa processingLoop()
-    std::thread orchestratorThread; // A thread que executa a pipeline (orquestrador)
+    std::vector<std::thread> orchestratorThreads; // Thread do orquestrador de cada instância
 
     std::atomic<bool> running{false};  // Sinalizador para controlar o loop da thread
 
-    size_t df_trigger_size; // Critério para disparar a pipeline
+    size_t df_trigger_size; // Critério da política padrão para disparar a pipeline
     size_t pipelineNumThreads; // Número de threads que a pipeline pode usar
 };
 
@@ -0,0 +1,55 @@
+#ifndef PIPELINETRACE_H
+#define PIPELINETRACE_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Registro de uma execução da pipeline feito pelo orquestrador: para cada task, quando ela ficou
+// pronta (dependências concluídas), quando suas threads foram disparadas, quando cada thread
+// terminou, as linhas que recebeu e produziu e a memória das suas saídas.
+// Pode ser exportado no formato de trace do Chrome (chrome://tracing ou ui.perfetto.dev), com uma
+// linha do tempo por thread e a espera de cada task na fila do orquestrador.
+class PipelineTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct TaskSpan {
+        std::string task;
+        Clock::time_point ready;  // entrou na fila do orquestrador
+        Clock::time_point start;  // threads disparadas
+        Clock::time_point end;    // threads terminadas e finishExecution concluído
+        std::vector<Clock::time_point> threadEnds; // fim de cada thread (vazio: a task não criou threads)
+        size_t rowsIn = 0;   // linhas das saídas das tasks anteriores
+        size_t rowsOut = 0;  // linhas das saídas da task
+        size_t bytesOut = 0; // memória das saídas da task
+    };
+
+    explicit PipelineTrace(uint64_t runId = 0, int maxThreads = 1);
+
+    // Chamados pelo orquestrador (uma única thread por execução)
+    void begin();
+    void add(TaskSpan span);
+    void finish();
+
+    uint64_t getRunId() const { return runId; }
+    int getMaxThreads() const { return maxThreads; }
+    double totalMs() const;
+    const std::vector<TaskSpan>& getSpans() const { return spans; }
+
+    // JSON no formato de trace do Chrome/Perfetto
+    std::string toChromeJson() const;
+    void writeChromeJson(const std::string& path) const;
+    // Uma linha por task: espera na fila, duração, threads, linhas e memória
+    std::string summary() const;
+
+private:
+    uint64_t runId;
+    int maxThreads;
+    Clock::time_point runStart;
+    Clock::time_point runEnd;
+    std::vector<TaskSpan> spans;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef QUANTILE_H
+#define QUANTILE_H
+
+#include <vector>
+#include <cstddef>
+
+// Operadores de quantil em O(n) sobre vetores de double (por exemplo, os dados de uma Column<double>).
+//
+// O modo exato é uma seleção por histograma: uma passada paralela acha mínimo e máximo, outra conta
+// quantos valores caem em cada faixa, e só os valores da(s) faixa(s) que contêm a ordem procurada
+// são copiados e passados para um nth_element. O vetor de entrada nunca é ordenado nem copiado.
+// O modo aproximado para no histograma e interpola dentro da faixa (erro máximo de uma faixa).
+//
+// Os quantis seguem a mesma definição da mediana "de livro": posição q*(n-1) com interpolação linear
+// entre as duas ordens vizinhas. Valores NaN são ignorados.
+
+enum class QuantileMode { Exact, Approximate };
+
+double quantile(const std::vector<double>& values, double q, int numThreads = 1,
+                QuantileMode mode = QuantileMode::Exact);
+
+// Vários quantis com as mesmas passadas de mínimo/máximo e histograma
+std::vector<double> quantiles(const std::vector<double>& values, const std::vector<double>& qs,
+                              int numThreads = 1, QuantileMode mode = QuantileMode::Exact);
+
+inline double median(const std::vector<double>& values, int numThreads = 1,
+                     QuantileMode mode = QuantileMode::Exact) {
+    return quantile(values, 0.5, numThreads, mode);
+}
+
+// Sketch de quantis baseado em histograma de faixas iguais num intervalo fixo [lo, hi].
+// Pode ser alimentado em partes (por thread ou por batch) e depois juntado com merge.
+// Valores fora do intervalo são contados na primeira/última faixa.
+class QuantileSketch {
+public:
+    QuantileSketch(double lo, double hi, size_t numBins = 4096);
+
+    void add(double value);
+    void add(const std::vector<double>& values, size_t begin, size_t end);
+    void merge(const QuantileSketch& other);
+
+    double quantile(double q) const;
+    size_t count() const { return total; }
+
+private:
+    double lo, hi, scale;
+    std::vector<size_t> bins;
+    size_t total = 0;
+
+    size_t binOf(double value) const;
+    double valueAtRank(double rank) const;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include "taskprofile.h"
+
+// Políticas de escalonamento do orquestrador multi-thread:
+//  - Weights: a heurística original (prioridade por finalWeight; threads pela razão entre o peso da
+//    task e o da próxima da fila);
+//  - CriticalPath: lista por caminho crítico (estilo HEFT) com threads planejadas pelo algoritmo
+//    CPA (Critical Path and Area) a partir do modelo de escalabilidade medido de cada task.
+enum class SchedulingPolicy { Weights, CriticalPath };
+
+// Uma task do DAG como o escalonador a vê
+struct ScheduleTask {
+    std::string name;
+    std::vector<size_t> next;  // índices das próximas tasks
+    bool parallel = false;
+    double maxThreadsProportion = 1.0; // fração máxima das threads que a task pode usar
+    ScalingModel model;        // tempo previsto por número de threads
+    double finalWeight = 1.0;  // peso da política Weights
+};
+
+// Threads e prioridades planejadas para cada task (mesma ordem do DAG)
+struct SchedulePlan {
+    std::vector<int> threads;
+    std::vector<double> rank;  // tempo previsto do início da task até o fim da pipeline
+    double criticalPathMs = 0.0;
+    double areaMs = 0.0;       // trabalho total previsto dividido pelas threads
+};
+
+// Parte de uma thread por task e, enquanto o caminho crítico for maior que a área, dá mais uma thread
+// à task do caminho crítico com que o makespan simulado mais diminui (para quando nenhuma diminui)
+SchedulePlan planCriticalPath(const std::vector<ScheduleTask>& dag, int maxThreads);
+
+// Threads da política Weights para a task disparada (a regra de orchestratePipelineMultiThread3)
+int weightedThreads(bool parallel, double maxThreadsProportion, double weight,
+                    bool hasNext, double nextWeight, int availableThreads);
+
+struct SimulationResult {
+    double makespanMs = 0.0;
+    std::vector<std::string> tasks; // na ordem do DAG
+    std::vector<double> startMs, endMs;
+    std::vector<int> threads;
+};
+
+// Executa o orquestrador em tempo simulado: sem rodar nada, dispara as tasks pela política e usa
+// os modelos para saber quando cada uma termina. Serve para comparar políticas com perfis gravados.
+SimulationResult simulateSchedule(const std::vector<ScheduleTask>& dag, int maxThreads, SchedulingPolicy policy);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SHARDEDPIPELINEMANAGER_HPP
+#define SHARDEDPIPELINEMANAGER_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "dataframe.h"
+#include "pipelinemanager.hpp"
+
+/*
+Divide a ingestão entre vários PipelineManagers independentes (shards) pelo hash de uma coluna
+chave (ex.: id_usuario_pagador). Cada shard tem sua thread de processamento, suas instâncias da
+pipeline e seu próprio estado, e todas as linhas de uma mesma chave vão sempre para o mesmo
+shard: a lógica por chave (saldo, limites) continua correta sem coordenação entre shards, e a
+vazão cresce com o número de shards.
+*/
+class ShardedPipelineManager {
+public:
+    // shards: managers já construídos (o ShardedPipelineManager passa a ser o dono deles)
+    ShardedPipelineManager(std::vector<PipelineManager*> shards, std::string keyColumn);
+    ~ShardedPipelineManager();
+
+    ShardedPipelineManager(const ShardedPipelineManager&) = delete;
+    ShardedPipelineManager& operator=(const ShardedPipelineManager&) = delete;
+
+    size_t numShards() const { return shards.size(); };
+    size_t shardOf(const std::string& key) const { return std::hash<std::string>{}(key) % shards.size(); };
+    PipelineManager& shard(size_t i) { return *shards.at(i); };
+    const std::string& getKeyColumn() const { return keyColumn; };
+
+    // Divide o batch pela coluna chave e entrega cada parte ao seu shard. Produtores que já
+    // separam as linhas por shardOf() devem chamar shard(i).submitDataBatch direto.
+    // Retorna false se alguma parte foi descartada.
+    bool submitDataBatch(std::shared_ptr<DataFrame> batch);
+
+    // Aplicados a cada shard
+    void setIngestLimits(size_t lowWatermark, size_t highWatermark, size_t maxPendingRows);
+    void setTriggerPolicy(const std::function<std::unique_ptr<TriggerPolicy>()>& makePolicy);
+    void setOnRunFailed(const std::function<void(DataFrame&)>& callback);
+    void start();
+    void stop();
+
+    // Algum shard acima do highWatermark (nullptr se todos aceitam): o produtor deve esperar por ele
+    PipelineManager* pausedShard() const;
+    // Soma dos contadores dos shards (o pico é o maior entre eles)
+    PipelineManager::IngestStats getIngestStats() const;
+
+private:
+    std::vector<PipelineManager*> shards;
+    std::string keyColumn;
+};
+
+#endif // SHARDEDPIPELINEMANAGER_HPP
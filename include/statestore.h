@@ -0,0 +1,185 @@
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <set>
+#include <cstdint>
+#include <stdexcept>
+
+#include "hashindex.h"
+
+// Estado que sobrevive entre execuções da pipeline e é atualizado de forma transacional:
+// o trigger chama begin() antes de cada execução e commit() (ou rollback()) ao final.
+class TransactionalState {
+public:
+    virtual ~TransactionalState() = default;
+    virtual void begin() = 0;
+    virtual void commit() = 0;
+    virtual void rollback() = 0;
+};
+
+// Store chave -> valor em memória (por exemplo, id do usuário -> saldo, limites e agregados
+// acumulados). Durante uma transação as escritas ficam numa área separada, visível para quem
+// lê o store, e só passam para o estado confirmado no commit; um rollback simplesmente as descarta.
+// Assim o custo de cada batch é proporcional ao número de chaves que ele toca, não ao tamanho do store.
+// Fora de uma transação, put() escreve direto no estado confirmado.
+//
+// Com várias instâncias da pipeline rodando ao mesmo tempo, cada instância usa sua própria Session.
+// Cada transação recebe uma senha em begin() (a ordem dos batches, se begin é chamado por quem os
+// despacha) e, no primeiro acesso, espera até que todas as transações de senha menor tenham
+// terminado (commit ou rollback), passando então a ser dona do store até o seu fim. As partes das
+// execuções que não tocam o estado rodam em paralelo, e as que tocam são serializadas na ordem dos
+// batches: o batch N+1 sempre vê o commit do batch N, mesmo que chegue antes dele ao estado.
+template <typename K, typename V>
+class StateStore : public TransactionalState {
+public:
+    class Session : public TransactionalState {
+    public:
+        explicit Session(StateStore& store) : store(store) {}
+
+        bool get(const K& key, V& value) const {
+            std::unique_lock<std::mutex> lk(store.mtx);
+            acquire(lk);
+            size_t h = FlatHashIndex<K>::hashOf(key);
+            if (active) {
+                size_t id = stagedIndex.find(key, h);
+                if (id != stagedIndex.npos) {
+                    value = stagedValues[id];
+                    return true;
+                }
+            }
+            size_t id = store.index.find(key, h);
+            if (id == store.index.npos) return false;
+            value = store.values[id];
+            return true;
+        }
+
+        V getOr(const K& key, const V& defaultValue) const {
+            V value;
+            return get(key, value) ? value : defaultValue;
+        }
+
+        bool contains(const K& key) const {
+            V value;
+            return get(key, value);
+        }
+
+        void put(const K& key, const V& value) {
+            std::unique_lock<std::mutex> lk(store.mtx);
+            if (active) {
+                acquire(lk);
+                write(stagedIndex, stagedValues, key, value);
+            } else {
+                store.ownerCv.wait(lk, [this] { return store.owner == nullptr; });
+                write(store.index, store.values, key, value);
+            }
+        }
+
+        void begin() override {
+            std::lock_guard<std::mutex> lk(store.mtx);
+            if (active) {
+                throw std::logic_error("StateStore: transaction already active.");
+            }
+            active = true;
+            ticket = store.nextTicket++;
+        }
+
+        void commit() override {
+            std::lock_guard<std::mutex> lk(store.mtx);
+            for (size_t id = 0; id < stagedIndex.size(); id++) {
+                write(store.index, store.values, stagedIndex.getKey(id), stagedValues[id]);
+            }
+            finish();
+        }
+
+        void rollback() override {
+            std::lock_guard<std::mutex> lk(store.mtx);
+            finish();
+        }
+
+        bool inTransaction() const {
+            std::lock_guard<std::mutex> lk(store.mtx);
+            return active;
+        }
+
+    private:
+        StateStore& store;
+        FlatHashIndex<K> stagedIndex;
+        std::vector<V> stagedValues;
+        bool active = false;
+        uint64_t ticket = 0;
+
+        // Em transação, espera a vez da sua senha e até ser a dona do store (chamado com store.mtx travado)
+        void acquire(std::unique_lock<std::mutex>& lk) const {
+            if (!active || store.owner == this) return;
+            store.ownerCv.wait(lk, [this] { return store.owner == nullptr && store.turn == ticket; });
+            store.owner = this;
+        }
+
+        void finish() {
+            // Recria em vez de clear(): a tabela de slots de um batch grande não fica presa à sessão
+            stagedIndex = FlatHashIndex<K>();
+            stagedValues.clear();
+            if (!active) return;
+            active = false;
+            if (store.owner == this) store.owner = nullptr;
+            // A vez passa para a próxima senha ainda não terminada (transações que nunca tocaram o
+            // estado podem terminar antes das anteriores)
+            store.finishedTickets.insert(ticket);
+            while (!store.finishedTickets.empty() && *store.finishedTickets.begin() == store.turn) {
+                store.finishedTickets.erase(store.finishedTickets.begin());
+                store.turn++;
+            }
+            store.ownerCv.notify_all();
+        }
+    };
+
+    StateStore() : defaultSession(*this) {}
+
+    // Sessão para uma instância da pipeline (registrar no trigger da instância)
+    std::shared_ptr<Session> openSession() {
+        return std::make_shared<Session>(*this);
+    }
+
+    // Acesso direto ao store, pela sessão padrão (uso com uma única pipeline)
+    bool get(const K& key, V& value) const { return defaultSession.get(key, value); }
+    V getOr(const K& key, const V& defaultValue) const { return defaultSession.getOr(key, defaultValue); }
+    bool contains(const K& key) const { return defaultSession.contains(key); }
+    void put(const K& key, const V& value) { defaultSession.put(key, value); }
+    void begin() override { defaultSession.begin(); }
+    void commit() override { defaultSession.commit(); }
+    void rollback() override { defaultSession.rollback(); }
+    bool inTransaction() const { return defaultSession.inTransaction(); }
+
+    // Número de chaves confirmadas
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return index.size();
+    }
+
+private:
+    mutable std::mutex mtx;
+    mutable std::condition_variable ownerCv;
+    mutable const Session* owner = nullptr;
+    uint64_t nextTicket = 0;            // senha da próxima transação
+    uint64_t turn = 0;                  // menor senha cuja transação não terminou
+    std::set<uint64_t> finishedTickets; // transações terminadas fora de ordem
+    FlatHashIndex<K> index;
+    std::vector<V> values;
+    Session defaultSession;
+
+    static void write(FlatHashIndex<K>& idx, std::vector<V>& vals, const K& key, const V& value) {
+        auto [id, inserted] = idx.insert(key);
+        if (inserted) {
+            vals.push_back(value);
+        } else {
+            vals[id] = value;
+        }
+    }
+};
+
+#endif
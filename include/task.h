@@ -10,12 +10,23 @@
 #include <queue>
 #include <condition_variable>
 #include <atomic>
+#include <future>
+#include <chrono>
 #include "dataframe.h"
 #include "datarepository.h"
 #include "types.h"
+#include "completionqueue.h"
+#include "cancellation.h"
 
 using DataFrameWithIndexes = std::pair<std::vector<int>, std::shared_ptr<DataFrame>>;
 
+//Memoização de um tratador: com as entradas iguais às da última execução completa, a execução é pulada
+//e as saídas dela são reutilizadas
+// - Off: sempre executa;
+// - Versions: compara só as versões das entradas (DataFrame::setVersion); entrada sem versão executa;
+// - Content: entradas sem versão são comparadas pelo hash do conteúdo (O(linhas) a cada execução).
+enum class Memoization { Off, Versions, Content };
+
 class Task : public std::enable_shared_from_this<Task>{
 public:
     virtual ~Task() = default;
@@ -32,20 +43,32 @@ public:
     //Funções para gerenciar as pendencias antes de executar a task
     void incrementExecutedPreviousTasks();
     const bool checkPreviousTasks() const;
+    //Muda a cada addNext ou addOutput em qualquer task: os triggers recompilam o DAG quando ela muda
+    static uint64_t graphGeneration() {return generation.load();};
 
     //----------Métodos abstratos---------//
 
     //método abstrato comum para todos os blocos do etl que deverá executar eles.
     //o primeiro deve simplesmente executar sem mexer em nenhuma interface de threading
     virtual void executeMonoThread() {};
-    //e o segundo deverá enfileirar threads para trabalhar e retornar elas
-    virtual std::vector<std::thread> executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                        std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) = 0;
+    //e o segundo deverá enfileirar threads para trabalhar e retornar elas. Cada thread, ao terminar,
+    //publica (group, índice da thread) em completions
+    virtual std::vector<std::thread> executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group) = 0;
     //método abstrato para gerenciar o uso dos dataframes de saída da task (chamado por tasks posteriores)
     virtual void decreaseConsumingCounter() {};
     //método abstrato que faz devidas limpezas após o final do funcionamento do bloco
     virtual void finishExecution() {};
 
+    //Elasticidade (opcional): durante uma executeMultiThread, a task pode receber threads extras que
+    //pegam as partes ainda não processadas e devolvê-las antes do fim, se outra task precisar delas.
+    //Partes ainda não pegas por nenhuma thread (0 se a task não aceita threads extras)
+    virtual size_t pendingMorsels() const {return 0;};
+    //Dispara até numThreads threads extras, com índices a partir de firstSlot (publicados em completions
+    //como os das threads iniciais), e as retorna
+    virtual std::vector<std::thread> addWorkers(int numThreads, CompletionQueue& completions, uint32_t group, int firstSlot) {return {};};
+    //Pede que até numThreads threads terminem ao fim da parte atual (uma sempre fica até acabar)
+    virtual void releaseWorkers(int numThreads) {};
+
     // Heurística para decidir o número de threads
     // void setWeight(int w);
     // int getWeight() const;
@@ -65,6 +88,25 @@ public:
 
     void setBaseWeight(int newBaseWeight);
     int getBaseWeight() const;
+
+    //Cancelamento: o orquestrador dá a cada execução da task uma token (filha da token da execução da
+    //pipeline, com o prazo da task) que as threads consultam entre partes do trabalho
+    void setCancellation(std::shared_ptr<CancellationToken> token) {cancellation = std::move(token);};
+    std::shared_ptr<CancellationToken> getCancellation() const {return cancellation;};
+    //Prazo de cada execução da task, contado do disparo (0: sem prazo); vencido, cancela a execução da pipeline
+    void setDeadline(std::chrono::milliseconds limit) {deadline = limit;};
+    std::chrono::milliseconds getDeadline() const {return deadline;};
+    //Volta ao estado de antes da execução, no lugar do finishExecution, quando a execução da pipeline
+    //é cancelada (as threads da task já terminaram ou nem começaram)
+    virtual void resetExecution();
+
+    //A última execução reutilizou as saídas de uma anterior, sem processar nada (memoização)
+    bool outputsReused() const {return reusedOutputs;};
+
+    //Instrumentação: o orquestrador reserva um horário de fim por thread antes de disparar a task
+    //e cada thread marca o seu ao terminar (lido depois que o término da thread é recebido)
+    void resetThreadFinishTimes(int numThreads);
+    const std::vector<std::chrono::steady_clock::time_point>& getThreadFinishTimes() const {return threadFinishTimes;};
 protected:
     //Vetores com as saídas e relacionamentos
     std::vector<std::shared_ptr<Task>> nextTasks;
@@ -84,9 +126,21 @@ protected:
     // int taskLevel = 0;
     int baseWeight = 1;
 
+    std::vector<std::chrono::steady_clock::time_point> threadFinishTimes;
+
+    std::shared_ptr<CancellationToken> cancellation;
+    std::chrono::milliseconds deadline{0};
+    bool reusedOutputs = false;
+    //Para as implementações (inclusive transform e prepare) pararem cedo numa execução cancelada
+    bool isCancelled() const {return cancellation && cancellation->isCancelled();};
+
+    static inline std::atomic<uint64_t> generation{0};
+
     //Função auxiliar para retornar uma thread executando a operação versão monothread do bloco
-    void executeMonoThreadSpecial(std::vector<std::atomic<bool>>& completedList, int tIndex,
-                                  std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
+    void executeMonoThreadSpecial(CompletionQueue& completions, uint32_t group, int tIndex);
+    //Fim de uma thread da task: marca o horário e publica o término para o orquestrador, com a
+    //exceção que encerrou a thread, se houve uma (o orquestrador a relança)
+    void signalThreadFinished(CompletionQueue& completions, uint32_t group, int tIndex, std::exception_ptr error = nullptr);
 };
 
 class Transformer : public Task {
@@ -94,34 +148,114 @@ public:
     Transformer(): consumingCounterMutex() {};
     virtual ~Transformer() = default;
 
-    //Função virtual que qualquer transformer deve implementar - no caso, o usuário
+    //Função virtual que qualquer transformer deve implementar - no caso, o usuário.
+    //Cada chamada recebe um pedaço das entradas divididas (as não divididas vêm inteiras); a mesma
+    //execução chama transform várias vezes, em pedaços disjuntos, e cada thread pode pegar vários
+    //(também na execução mono-thread, que processa os pedaços em sequência).
     virtual void transform(std::vector<std::shared_ptr<DataFrame>>& outputs,
                            const std::vector<DataFrameWithIndexes>& inputs) {};
+    //Função opcional chamada uma única vez por execução, antes de qualquer transform, com as entradas
+    //completas. Serve para cálculos globais (agregações, medianas) que não devem ser repetidos por thread.
+    //numThreads é o número de threads reservadas para a task, que podem ser usadas pelos operadores.
+    virtual void prepare(std::vector<std::shared_ptr<DataFrame>>& outputs,
+                         const std::vector<DataFrameWithIndexes>& inputs, int numThreads) {};
 
     //Implementação específica do transformer para o executes
     void executeMonoThread() override;
-    std::vector<std::thread> executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) override;
+    std::vector<std::thread> executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group) override;
 
     //Implementação específica para os métodos de pós execução e contagem
     void decreaseConsumingCounter() override;
     void finishExecution() override;
+    void resetExecution() override;
+
+    //As entradas divididas são repartidas em partes (morsels) de até rows linhas, pegas uma a uma
+    //pelas threads, que assim podem entrar e sair no meio da execução. Com 0, cada thread recebe uma
+    //única parte fixa (uma por thread) e a task não aceita threads extras. Execuções em uma thread só
+    //(mono-thread ou blockParallel) não são repartidas: o transform recebe a entrada inteira.
+    void setMorselRows(size_t rows) {morselRows = rows;};
+    size_t pendingMorsels() const override;
+    std::vector<std::thread> addWorkers(int numThreads, CompletionQueue& completions, uint32_t group, int firstSlot) override;
+    void releaseWorkers(int numThreads) override;
+
+    //Memoização (desligada por padrão), só para tratadores puros: saídas que dependem apenas das entradas,
+    //sem estado entre execuções nem efeitos fora delas. As saídas da última execução completa ficam
+    //guardadas e recebem versões derivadas das entradas, então os tratadores seguintes com memoização
+    //também podem ser pulados. As saídas reutilizadas são compartilhadas: as tasks seguintes não devem alterá-las.
+    void setMemoization(Memoization mode);
+    Memoization getMemoization() const {return memoization;};
+    //Descarta as saídas guardadas (ex.: depois de mudar um parâmetro do tratador)
+    void invalidateMemo();
 
 private:
+    //Entradas completas do prepare e a sinalização de que ele terminou, compartilhadas entre as threads
+    struct PrepareStep {
+        std::vector<DataFrameWithIndexes> inputs;
+        int numThreads = 1;
+        std::promise<void> done;
+        std::shared_future<void> ready;
+    };
+    //Partes de uma execução, distribuídas sob demanda entre as threads (iniciais e extras)
+    struct MorselPool {
+        std::shared_ptr<PrepareStep> prepareStep;
+        std::vector<bool> split; //quais entradas de prepareStep->inputs são divididas
+        size_t numMorsels = 1;
+        bool elastic = false;    //há partes a mais do que threads para repartir
+        std::atomic<size_t> next{0};
+        std::atomic<int> releaseRequests{0};
+        std::mutex workersMutex;
+        int activeWorkers = 0;   //protegido por workersMutex
+        //Entradas do transform para a parte m
+        std::vector<DataFrameWithIndexes> morselInputs(size_t m) const;
+        //Uma thread pedida de volta sai, se não for a última
+        bool tryRelease();
+    };
+    size_t morselRows = 2048;
+    std::shared_ptr<MorselPool> morselPool; //da execução em andamento
     //Método privado para facilitar o gerenciamento do que fazer
-    std::vector<std::thread> executeWithThreading(int numThreads, std::vector<std::atomic<bool>>& completedList,
-                                                  std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
-    //Wrapper que chama a função definida do usuário e faz limpezas de thread depois
-    void transformThread(std::vector<std::shared_ptr<DataFrame>>& outputs,
-                         const std::vector<DataFrameWithIndexes>& inputs,
-                         std::vector<std::atomic<bool>>& completedList, int tIndex,
-                         std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
+    std::vector<std::thread> executeWithThreading(int numThreads, CompletionQueue& completions, uint32_t group);
+    //Entradas completas e partes da execução, para numThreads threads (com rowsPerMorsel 0, uma parte por thread)
+    std::shared_ptr<MorselPool> buildMorselPool(int numThreads, size_t rowsPerMorsel);
+    //Thread da task: pega partes até acabarem (ou até ser pedida de volta) e publica o término
+    void morselWorker(std::shared_ptr<MorselPool> pool, CompletionQueue& completions, uint32_t group, int tIndex);
+    //Execução em sequência por uma thread: prepare e transform sobre a entrada inteira
+    void processSequential();
+    //Thread única da task com blockParallel
+    void sequentialWorker(CompletionQueue& completions, uint32_t group, int tIndex);
+
+    Memoization memoization = Memoization::Off;
+    std::string memoKey;    //entradas da última execução completa ("" se nenhuma guardada)
+    std::string pendingKey; //entradas da execução em andamento
+    std::vector<std::shared_ptr<DataFrame>> memoOutputs;
+    //Chave das entradas atuais ("" se alguma não tem versão e o modo não compara conteúdo)
+    std::string inputsKey() const;
+    //Decide, uma vez por execução, se as saídas guardadas servem; se sim, elas passam a ser as saídas
+    bool reuseMemo();
 
 protected:
     std::mutex consumingCounterMutex;
 };
 
 
+//Fonte de referência em cache, que pode ser compartilhada entre extratores de instâncias diferentes
+//da mesma pipeline: a fonte é lida por apenas um deles a cada versão e os demais recebem o mesmo
+//DataFrame (somente leitura). O repositório passa a pertencer ao cache.
+class SourceCache {
+public:
+    SourceCache(DataRepository* repo, const std::string& keyColumn = "") : repository(repo), keyColumn(keyColumn) {};
+
+private:
+    friend class Extractor;
+    DataRepository* repository;
+    std::string keyColumn;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::shared_ptr<DataFrame> df;
+    std::string version;
+    bool loaded = false;
+    bool loading = false;
+};
+
 class Extractor : public Task {
 public:
     Extractor(): buffer(), bufferMutex(), dfMutex(), consumingCounterMutex(), cv(), endProduction(false), readAgain(true) {};
@@ -130,21 +264,33 @@ public:
     void addOutput(std::shared_ptr<DataFrame> outputDF);
     //Setter específico do extractor
     void addRepo(DataRepository* repo){ repository = repo;};
+    DataRepository* getRepo() const {return repository;};
 
     //Implementação específica do extractor para o execute
     virtual void executeMonoThread() override;
-    virtual std::vector<std::thread> executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                        std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) override;
+    virtual std::vector<std::thread> executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group) override;
 
     //Implementação específica para os métodos de pós execução e contagem
     void decreaseConsumingCounter() override;
     void finishExecution() override;
+    void resetExecution() override;
     void blockReadAgain() {readAgain = false;}
+    //Modo de fonte em cache, para dados de referência (cadastro, regiões): a fonte é extraída uma vez
+    //e as execuções seguintes recebem o mesmo DataFrame sem nenhuma extração (nem threads), até que
+    //a versão informada pelo repositório mude. Se keyColumn for dada, o DataFrame ganha um índice
+    //chave -> linha por essa coluna a cada carga. Deve ser chamado depois de addRepo.
+    void cacheSource(const std::string& keyColumn = "");
+    //Mesmo modo, usando um cache compartilhado com outros extratores (o repositório é o do cache)
+    void cacheSource(std::shared_ptr<SourceCache> sharedCache);
 
 protected:
     std::shared_ptr<DataFrame> dfOutput;
 private:
     DataRepository* repository;
+    std::shared_ptr<SourceCache> cache;
+    bool loadingCache = false;
+    std::string loadingVersion;
+    bool cacheNeedsLoad();
     std::queue<std::string> buffer;
     size_t maxBufferSize;
     std::mutex bufferMutex;
@@ -154,10 +300,10 @@ private:
     std::atomic<bool> endProduction;
     bool readAgain;
     //Funções para execução com multithreading
-    void producer(std::vector<std::atomic<bool>>& completedList, int tIndex,
-                  std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
-    void consumer(std::vector<std::atomic<bool>>& completedList, int tIndex,
-                  std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
+    void producer(CompletionQueue& completions, uint32_t group, int tIndex);
+    void consumer(CompletionQueue& completions, uint32_t group, int tIndex);
+    //Laço do consumidor: converte os lotes do buffer até a produção acabar
+    void consumeBuffer();
 };
 
 class ExtractorFile : public Extractor {
@@ -192,6 +338,8 @@ public:
     virtual void executeMonoThread() override;
 
     void finishExecution() override;
+    //A saída é o batch recebido, que continua até o próximo addOutput
+    void resetExecution() override {Task::resetExecution();};
 
 private:
     MemoryRepository* repository;
@@ -205,14 +353,17 @@ public:
 
     //Setter específico do loader
     void addRepo(DataRepository* repo){ repository = repo;};
+    DataRepository* getRepo() const {return repository;};
+    //Saída da task anterior que é gravada
+    int getInputIndex() const {return inputIndex;};
 
     //Implementação específica do loader para o execute
     virtual void executeMonoThread() override;
-    virtual std::vector<std::thread> executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                        std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) override;
+    virtual std::vector<std::thread> executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group) override;
 
     //Implementação específica para os métodos de pós execução e contagem
     void finishExecution() override;
+    void resetExecution() override;
 
 protected:
     DataRepository* repository;
@@ -222,14 +373,13 @@ protected:
     int inputIndex;
     bool clearRepo;
 
-    void addRows(DataFrameWithIndexes pair, std::vector<std::atomic<bool>>& completedList, int tIndex,
-                 std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex);
+    void addRows(DataFrameWithIndexes pair, CompletionQueue& completions, uint32_t group, int tIndex);
 
 };
 
 class LoaderFile : public Loader {
 public: 
-    LoaderFile(int inputDFIndex, bool clearRepository)
+    LoaderFile(int inputDFIndex, bool clearRepository = true)
         : Loader(inputDFIndex, clearRepository){};
     virtual ~LoaderFile() = default;
 
@@ -242,7 +392,7 @@ private:
     
 class LoaderSQLite : public Loader {
 public: 
-    LoaderSQLite(int inputDFIndex, bool clearRepository)
+    LoaderSQLite(int inputDFIndex, bool clearRepository = true)
         : Loader(inputDFIndex, clearRepository){};
     virtual ~LoaderSQLite() = default;
 
@@ -255,7 +405,7 @@ private:
 
 class LoaderMemory : public Loader {
 public: 
-    LoaderMemory(int inputDFIndex, bool clearRepository)
+    LoaderMemory(int inputDFIndex, bool clearRepository = true)
         : Loader(inputDFIndex, clearRepository){};
     virtual ~LoaderMemory() = default;
 
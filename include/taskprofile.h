@@ -0,0 +1,88 @@
+#ifndef TASKPROFILE_H
+#define TASKPROFILE_H
+
+#include <string>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+// Modelo de escalabilidade de uma task (lei de Amdahl): com n threads, a execução leva
+// t1Ms * (serialFraction + (1 - serialFraction) / n)
+struct ScalingModel {
+    double t1Ms = 1.0;
+    double serialFraction = 1.0;
+    double predictMs(int threads) const;
+};
+
+// Perfil de custo das tasks aprendido nas execuções, usado pelo Trigger como peso de cada task no
+// cálculo do caminho crítico e na divisão das threads (no lugar de getBaseWeight).
+//
+// Para cada nome de task guarda médias móveis exponenciais (EWMA) do trabalho por linha
+// (tempo da task * threads usadas / linhas) e das linhas por execução; o peso é o trabalho esperado
+// por execução, em ms. Pode ser compartilhado por várias instâncias da mesma pipeline (thread-safe)
+// e salvo em arquivo, para que o processo já comece calibrado.
+class TaskProfile {
+public:
+    struct Entry {
+        double msPerRow = 0.0; // trabalho por linha (ms * threads)
+        double rows = 0.0;     // linhas por execução
+        uint64_t samples = 0;
+        std::map<int, double> wallMsPerRow; // tempo de parede por linha, por número de threads
+    };
+
+    // alpha: peso da execução mais recente nas médias (0 < alpha <= 1)
+    explicit TaskProfile(double alpha = 0.2);
+    ~TaskProfile(); // grava o que faltar (com autosave) e para a thread de gravação
+
+    // Uma execução da task: tempo de parede, linhas processadas (entrada, ou saída nos extratores)
+    // e threads usadas. Tasks sem nome, com espaços no nome ou começando com '#' não são medidas
+    // (ficam com getBaseWeight no Trigger): o perfil é por nome e o arquivo separa os campos por espaço
+    void record(const std::string& task, double elapsedMs, size_t rows, int threads);
+
+    // Trabalho esperado por execução da task, em ms; false se a task ainda não foi medida
+    bool expectedMs(const std::string& task, double& ms) const;
+    // Média do trabalho esperado das tasks medidas (0 se nenhuma), para pôr tasks novas na mesma escala
+    double meanExpectedMs() const;
+    std::map<std::string, Entry> getEntries() const;
+    // Ajusta o modelo de Amdahl aos tempos medidos com números diferentes de threads (mínimos
+    // quadrados em 1/n); medida com um só número de threads, supõe defaultSerialFraction (1 se a
+    // task não paraleliza). false se a task ainda não foi medida
+    bool scalingModel(const std::string& task, bool parallel, ScalingModel& model) const;
+    static constexpr double defaultSerialFraction = 0.1;
+    // Muda a cada record/load: o Trigger só recalcula os pesos quando ela muda
+    uint64_t getVersion() const { return version.load(); }
+
+    // Arquivo texto, uma task por linha: nome, ms por linha, linhas, amostras e pares
+    // threads:ms_por_linha do tempo de parede
+    bool load(const std::string& path);
+    // Grava uma cópia das entradas, sem segurar o mutex do perfil durante a escrita
+    void save(const std::string& path) const;
+    // Passa a salvar em path, por uma thread que grava a cada interval se houve record desde a última vez
+    void autosave(const std::string& path, std::chrono::milliseconds interval);
+
+private:
+    double alpha;
+    mutable std::mutex mtx;
+    std::map<std::string, Entry> entries;
+    std::atomic<uint64_t> version{0};
+
+    std::string autosavePath;
+    std::chrono::milliseconds autosaveInterval{0};
+    bool dirty = false;    // record desde a última gravação automática
+    bool stopping = false;
+    std::condition_variable saverCv;
+    std::thread saver;
+    mutable std::mutex fileMtx;     // serializa as gravações do arquivo
+    std::set<std::string> ignored;  // nomes inválidos já avisados (protegido por mtx)
+
+    static bool validName(const std::string& task);
+    void write(const std::string& path, const std::map<std::string, Entry>& snapshot) const;
+    void saverLoop();
+};
+
+#endif
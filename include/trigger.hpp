@@ -7,21 +7,33 @@
 #include <memory>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
 #include "task.h"  // Inclui a definição de Task e Transformer
+#include "statestore.h"
+#include "pipelinetrace.h"
+#include "taskprofile.h"
+#include "scheduler.h"
 
 struct taskNode {
     std::shared_ptr<Task> task;
-    int level = 0;
-    int cpWeight = 0;
-    int sumWeight = 0;
+    int level = 0;          // maior distância até um extrator
+    double cpWeight = 0.0;
+    double sumWeight = 0.0;
     double finalWeight = 0.0; // alpha * cpWeight + (1-alpha) * (sumWeight / numChild)
-    int auxOrquestrador = 0;
     int numChild = 0;
+    double priority = 0.0;  // ordem de disparo: finalWeight ou rank do caminho crítico, conforme a política
+    int plannedThreads = 1; // threads planejadas (política CriticalPath)
+    int nameRank = 0;       // posição do nome em ordem alfabética: desempate da ordem de disparo
 
     taskNode() = default;
     taskNode(std::shared_ptr<Task> task) : task(task) {};
 };
 
+struct ExecGroup; // task em execução no orchestratePipelineMultiThread3
+
 // Classe abstrata Trigger
 class Trigger {
 public:
@@ -32,6 +44,17 @@ public:
     void setExtractors(const std::vector<std::shared_ptr<Task>>& vExtractors);
     void addExtractor(std::shared_ptr<Task> extractor);
     void clearExtractors();
+
+    // Valida o DAG alcançável pelos extratores e o compila para a execução: ids densos na ordem
+    // topológica, arestas e número de tasks anteriores em vetores, para que os orquestradores trabalhem
+    // por índice. Lança std::invalid_argument com todos os problemas encontrados: ciclos, nomes de task
+    // repetidos, splitDFs de tamanho diferente das saídas da task anterior, Loader sem entrada ou com
+    // inputIndex fora das saídas, e tasks que dependem de outras fora do DAG (nunca seriam disparadas).
+    // É chamado na primeira execução e sempre que o DAG muda; chamado antes, acha os erros sem executar.
+    // Não deve ser chamado durante uma execução.
+    void compile();
+    // Nomes das tasks do DAG compilado, na ordem topológica (a ordem de execução com uma thread)
+    std::vector<std::string> getTopologicalOrder() const;
     
     // Método virtual para iniciar o trigger
     virtual void start(int numThreads) = 0;
@@ -41,11 +64,63 @@ public:
     double getAlpha() const;
     void setAlpha(double alpha);
 
+    // Instrumentação: cada execução grava um PipelineTrace (espera na fila, início e fim de cada
+    // task e de cada thread, linhas e memória das saídas). Com traceDir, a cada 'every' execuções
+    // o trace também vai para traceDir/trace-<execução>.json, no formato do Chrome/Perfetto.
+    // Pode ser ligada sem mudar o código pelas variáveis de ambiente PIPELINE_TRACE_DIR e
+    // PIPELINE_TRACE_EVERY, lidas na construção do trigger.
+    void enableProfiling(const std::string& traceDir = "", unsigned every = 1);
+    void disableProfiling();
+    // Trace da última execução instrumentada (nullptr se nenhuma)
+    std::shared_ptr<const PipelineTrace> getLastTrace() const;
+
+    // Calibração: com um perfil, o tempo de cada task (por linha, EWMA) é registrado a cada execução
+    // e o trabalho esperado substitui getBaseWeight no caminho crítico e na divisão das threads.
+    // O mesmo perfil pode ser compartilhado por várias instâncias da pipeline.
+    void setTaskProfile(std::shared_ptr<TaskProfile> profile);
+    std::shared_ptr<TaskProfile> getTaskProfile() const {return taskProfile;};
+    // finalWeight de cada task no último cálculo da distribuição
+    std::map<std::string, double> getTaskWeights() const;
+
+    // Política usada por orchestratePipelineMultiThread3 para ordenar as tasks e dividir as threads
+    void setSchedulingPolicy(SchedulingPolicy policy);
+    SchedulingPolicy getSchedulingPolicy() const {return schedulingPolicy;};
+    // Threads planejadas para cada task no último cálculo (1 em todas na política Weights)
+    std::map<std::string, int> getPlannedThreads() const;
+    // Simula a pipeline com maxThreads e a política dada, com os tempos previstos pelo perfil
+    // (ou pelos pesos base, nas tasks sem medidas), sem executar nada
+    SimulationResult simulate(int maxThreads, SchedulingPolicy policy);
+
+    // Com a fila vazia, threads livres são emprestadas às tasks em execução que ainda têm partes por
+    // processar (Transformers com entradas divididas) e pedidas de volta quando outra task fica pronta.
+    // Ligado por padrão.
+    void setElasticThreads(bool enabled);
+    bool getElasticThreads() const {return elasticThreads;};
+
+    // Cancelamento cooperativo: cancel() aborta a execução em andamento (chamado de outra thread).
+    // As threads das tasks param na próxima parte do trabalho, nenhuma task nova é disparada, as
+    // tasks voltam ao estado de antes da execução e o orquestrador lança PipelineCancelled.
+    // Com setRunDeadline, cada execução é cancelada ao passar do prazo (0: sem prazo); o prazo de
+    // cada task é dado por Task::setDeadline.
+    void cancel(const std::string& reason = "cancelada");
+    void setRunDeadline(std::chrono::milliseconds limit) {runDeadline = limit;};
+    std::chrono::milliseconds getRunDeadline() const {return runDeadline;};
+
 protected:
+    Trigger();
+
     // Vetor de tasks que serão os pontos de partida da pipeline
     std::vector<std::shared_ptr<Task>> vExtractors;
-    // Mapa de tarefas com seus respectivos nós
-    std::map<std::string, taskNode> taskMap;
+    // DAG compilado: nós por id (ordem topológica, extratores primeiro); as próximas do id i são
+    // nextIds[nextOffsets[i] .. nextOffsets[i + 1]) e fanIn[i] é o número de anteriores
+    std::vector<taskNode> taskNodes;
+    std::vector<size_t> nextOffsets;
+    std::vector<int> nextIds;
+    std::vector<int> fanIn;
+    bool compiled = false;
+    uint64_t compiledGeneration = 0;    // Task::graphGeneration() no último compile
+    // Compila se ainda não compilou ou se o DAG mudou desde então
+    void ensureCompiled();
     // Variáveis para controle da heurística de distribuição de threads
     double alpha=2.0/3.0;
 
@@ -57,6 +132,48 @@ protected:
     void orchestratePipelineMultiThread3(int numThreads);
     bool calculateThreadsDistribution(int numThreads);
     bool isBusy = false;
+
+    std::shared_ptr<TaskProfile> taskProfile;
+    bool weightsReady = false;
+    uint64_t weightsVersion = 0; // versão do perfil usada no último cálculo dos pesos
+    SchedulingPolicy schedulingPolicy = SchedulingPolicy::Weights;
+    int plannedMaxThreads = 0;   // threads usadas no último cálculo do plano
+    bool elasticThreads = true;
+    void lendIdleThreads(std::map<uint32_t, ExecGroup>& activeGroups, CompletionQueue& completions,
+                         int maxThreads, int& usedThreads);
+
+    // Token da execução que começa (com o prazo da execução) e a de uma task dentro dela
+    std::shared_ptr<CancellationToken> beginRun();
+    void endRun();
+    std::shared_ptr<CancellationToken> taskToken(const std::shared_ptr<CancellationToken>& run, const std::shared_ptr<Task>& task);
+    // Execução cancelada, sem threads das tasks rodando: devolve as tasks ao estado inicial e lança PipelineCancelled
+    [[noreturn]] void abortRun(const std::shared_ptr<CancellationToken>& run);
+    // Exceção de uma task, sem threads das tasks rodando: devolve as tasks ao estado inicial e relança a exceção
+    [[noreturn]] void failRun(std::exception_ptr error);
+    void computeTaskWeights();
+    void planSchedule(int maxThreads);
+    // O DAG (na ordem dos ids) com o modelo de escalabilidade de cada task
+    std::vector<ScheduleTask> buildScheduleDag();
+    size_t inputRows(const std::shared_ptr<Task>& task) const;
+    // Registra no perfil uma execução da task (antes do finishExecution, com as saídas ainda prontas)
+    void recordTaskRuntime(const std::shared_ptr<Task>& task, double elapsedMs, size_t rowsIn, int threads);
+
+    // Trace da execução em andamento (nullptr: instrumentação desligada), usado pelos orquestradores
+    std::shared_ptr<PipelineTrace> currentTrace;
+    void beginTrace(int maxThreads);
+    void endTrace();
+    PipelineTrace::TaskSpan startSpan(const std::shared_ptr<Task>& task, PipelineTrace::Clock::time_point ready);
+    void measureSpan(const std::shared_ptr<Task>& task, PipelineTrace::TaskSpan& span, size_t launchedThreads);
+
+private:
+    std::atomic<bool> profiling{false};
+    std::string traceDir;
+    unsigned traceEvery = 1;
+    mutable std::mutex traceMutex; // protege traceDir, traceEvery e lastTrace
+    std::shared_ptr<const PipelineTrace> lastTrace;
+    std::chrono::milliseconds runDeadline{0};
+    std::mutex runMutex; // protege runToken
+    std::shared_ptr<CancellationToken> runToken; // da execução em andamento
 };
 
 // Trigger que executa a pipeline apenas uma vez
@@ -65,20 +182,79 @@ public:
     void start(int numThreads = 1) override;
 };
 
+// O que o TimerTrigger faz com os disparos perdidos enquanto uma execução passou do intervalo:
+//  - Skip: descarta-os e espera o próximo horário da grade (início + k * intervalo);
+//  - Coalesce: junta-os numa única execução imediata e depois volta à grade.
+enum class MissedTickPolicy { Skip, Coalesce };
+
+// Estatísticas de um TimerTrigger desde o último start
+struct TimerStats {
+    uint64_t runs = 0;
+    uint64_t overruns = 0;    // execuções que terminaram depois do disparo seguinte
+    uint64_t missedTicks = 0; // disparos da grade que não viraram execução
+    uint64_t cancelled = 0;   // execuções canceladas (cancel ou prazo vencido)
+    uint64_t failed = 0;      // execuções interrompidas por uma exceção de alguma task
+    double lastRunMs = 0.0;
+    double maxRunMs = 0.0;
+    double meanRunMs = 0.0;
+    double maxLatenessMs = 0.0; // maior atraso do início de uma execução em relação ao seu horário
+};
+
 // Trigger que executa a pipeline repetidamente a cada intervalo definido
 class TimerTrigger : public Trigger {
 public:
     // O construtor recebe o intervalo em milissegundos
-    TimerTrigger(unsigned int intervaloMs);
+    TimerTrigger(unsigned int intervaloMs, MissedTickPolicy policy = MissedTickPolicy::Skip);
     ~TimerTrigger();
     
+    // Os disparos seguem horários absolutos (início + k * intervalo), sem acumular o tempo de cada
+    // execução; com numThreads > 1 cada execução usa o orquestrador multi-thread
     void start(int numThreads = 1) override;
     void stop();
+    TimerStats getStats() const;
     
 private:
     unsigned int intervalo;          // Intervalo entre execuções (em milissegundos)
-    std::atomic<bool> stopFlag;      // Sinaliza quando deve parar o loop
+    MissedTickPolicy policy;
+    bool stopFlag = false;           // Sinaliza quando deve parar o loop (protegido por mtx)
+    mutable std::mutex mtx;          // protege stopFlag e stats
+    std::condition_variable stopCv;  // acorda a espera pelo próximo disparo no stop
+    TimerStats stats;
     std::thread timerThread;         // Thread responsável pela execução periódica
+    void run(int numThreads);
+};
+
+// Trigger que executa a pipeline a cada arquivo que chega numa pasta, avisado pelo inotify (Linux),
+// sem varrer a pasta. Arquivos cujo nome casa com pattern (glob, ex.: "*.csv") e que foram fechados
+// após escrita ou movidos para a pasta disparam uma execução cada, em ordem de chegada, com o
+// FileRepository do extrator alvo apontado para o arquivo. Para que um arquivo ainda sendo escrito
+// não dispare, o produtor deve escrevê-lo de uma vez ou com outro nome e renomeá-lo ao final.
+class FileWatchTrigger : public Trigger {
+public:
+    // target deve ter um FileRepository (addRepo) e fazer parte dos extratores da pipeline
+    FileWatchTrigger(const std::string& directory, const std::string& pattern, std::shared_ptr<Extractor> target);
+    ~FileWatchTrigger();
+
+    // Começa a observar a pasta (lança std::runtime_error se não conseguir) e retorna
+    void start(int numThreads = 1) override;
+    void stop();
+    // Chamado pela thread do trigger ao fim de cada execução, com o arquivo e o tempo desde o aviso
+    // do inotify até o fim da execução
+    void setOnFile(std::function<void(const std::string&, double)> callback) {onFile = std::move(callback);};
+    uint64_t getRunCount() const {return runs.load();};
+
+private:
+    std::string directory;
+    std::string pattern;
+    std::shared_ptr<Extractor> target;
+    FileRepository* repository;
+    int inotifyFd = -1;
+    int stopFd = -1; // eventfd que acorda a thread no stop
+    std::thread watchThread;
+    std::atomic<uint64_t> runs{0};
+    std::function<void(const std::string&, double)> onFile;
+    void watch(int numThreads);
+    void runFile(const std::string& path, std::chrono::steady_clock::time_point noticed, int numThreads);
 };
 
 // Similar ao RequestTrigger, mas um método para verificar se a pipeline está ocupada
@@ -89,8 +265,16 @@ public:
     std::thread start(int numThreads = 1, std::shared_ptr<DataFrame> df = nullptr); // TODO: usar df
     bool isBusy() const;
     void setExtractorIndex(int index) {eIndex = index;};
+    // Estados mantidos entre batches: cada execução da pipeline é uma transação sobre eles
+    void addStateStore(std::shared_ptr<TransactionalState> store) {stateStores.push_back(store);};
+    // Chamado pela thread do orquestrador ao fim de cada execução, já com a pipeline livre,
+    // com o número de linhas recebidas, o tempo da execução e se ela foi confirmada (false: a
+    // execução falhou ou foi cancelada e o estado do batch foi desfeito)
+    void setOnFinish(std::function<void(size_t, double, bool)> callback) {onFinish = std::move(callback);};
 private:
     int eIndex;
+    std::vector<std::shared_ptr<TransactionalState>> stateStores;
+    std::function<void(size_t, double, bool)> onFinish;
     std::atomic<bool> busy{false}; // Sinalizador para indicar se a pipeline está ocupada
 };
 
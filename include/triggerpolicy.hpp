@@ -0,0 +1,86 @@
+#ifndef TRIGGERPOLICY_HPP
+#define TRIGGERPOLICY_HPP
+
+#include <chrono>
+#include <cstddef>
+
+// Situação do PipelineManager no momento de decidir um disparo
+struct TriggerState {
+    using Clock = std::chrono::steady_clock;
+    size_t pendingRows = 0;        // linhas acumuladas esperando disparo
+    size_t freeInstances = 0;      // instâncias da pipeline livres
+    size_t totalInstances = 0;
+    Clock::time_point oldestArrival; // chegada do batch mais antigo entre as linhas pendentes
+    Clock::time_point now;
+};
+
+// Decide quando o PipelineManager entrega as linhas acumuladas para a pipeline.
+// Todos os métodos são chamados pela thread de processamento do PipelineManager.
+class TriggerPolicy {
+public:
+    using Clock = TriggerState::Clock;
+    virtual ~TriggerPolicy() = default;
+
+    // Um batch com 'rows' linhas chegou em 'when'
+    virtual void onArrival(size_t rows, Clock::time_point when) {};
+    // Uma execução da pipeline com 'rows' linhas levou 'elapsedMs'
+    virtual void onRunFinished(size_t rows, double elapsedMs) {};
+    // Dispara agora? Só é disparado se houver instância livre e linhas pendentes.
+    virtual bool shouldTrigger(const TriggerState& state) = 0;
+    // Instante em que a decisão deve ser reavaliada mesmo sem novos eventos
+    // (Clock::time_point::max(): só quando chegar um batch ou uma execução terminar)
+    virtual Clock::time_point nextCheck(const TriggerState& state) { return Clock::time_point::max(); };
+};
+
+// Critério original: dispara assim que houver mais de minRows linhas e uma instância livre
+class SizeTriggerPolicy : public TriggerPolicy {
+public:
+    explicit SizeTriggerPolicy(size_t minRows = 1): minRows(minRows) {};
+    bool shouldTrigger(const TriggerState& state) override;
+private:
+    size_t minRows;
+};
+
+// Dispara buscando uma latência ponta a ponta alvo (da chegada do batch ao fim da execução).
+// Mantém, a partir das execuções observadas, um modelo do tempo de execução (custo fixo +
+// custo por linha) e uma taxa de chegada de linhas com decaimento exponencial:
+//  - com pouca carga o batch alvo é pequeno e as linhas saem assim que chegam;
+//  - com muita carga o batch alvo cresce até o tamanho em que o tempo de executar um batch
+//    equivale ao tempo de acumular o próximo, amortizando o custo fixo de cada execução;
+//  - independentemente disso, dispara quando esperar mais estouraria a latência alvo.
+class LatencySLOTriggerPolicy : public TriggerPolicy {
+public:
+    LatencySLOTriggerPolicy(double targetLatencyMs, size_t minRows = 1, size_t maxRows = 1000000);
+
+    void onArrival(size_t rows, Clock::time_point when) override;
+    void onRunFinished(size_t rows, double elapsedMs) override;
+    bool shouldTrigger(const TriggerState& state) override;
+    Clock::time_point nextCheck(const TriggerState& state) override;
+
+    // Estimativas atuais (para logs e testes)
+    double predictRunMs(size_t rows) const;
+    double arrivalRatePerMs(Clock::time_point now) const;
+    size_t targetBatchRows(size_t totalInstances, Clock::time_point now) const;
+
+private:
+    double targetMs;
+    size_t minRows;
+    size_t maxRows;
+
+    // Taxa de chegada em linhas/ms, com janela exponencial de rateWindowMs
+    static constexpr double rateWindowMs = 1000.0;
+    double ratePerMs = 0.0;
+    Clock::time_point lastArrival;
+    bool hasArrival = false;
+
+    // Mínimos quadrados com esquecimento sobre (linhas, ms) das execuções: tempo = fixedMs + perRowMs * linhas
+    static constexpr double forgetting = 0.9;
+    double sumW = 0.0, sumN = 0.0, sumT = 0.0, sumNN = 0.0, sumNT = 0.0;
+    double fixedMs = 0.0;
+    double perRowMs = 0.0;
+
+    // Folga mantida em relação ao alvo, para absorver o erro do modelo
+    double slackMs() const { return targetMs * 0.1; };
+};
+
+#endif // TRIGGERPOLICY_HPP
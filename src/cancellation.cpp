@@ -0,0 +1,38 @@
+#include "cancellation.h"
+
+CancellationToken::CancellationToken(std::shared_ptr<CancellationToken> parent, Clock::time_point deadline)
+    : parent(std::move(parent)), deadline(deadline) {
+    if (this->parent && this->parent->deadline < this->deadline) {
+        this->deadline = this->parent->deadline;
+    }
+}
+
+void CancellationToken::cancel(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(reasonMutex);
+    if (cancelled.load()) return;
+    this->reason = reason;
+    cancelled.store(true);
+}
+
+// A token herda o prazo da mãe (no construtor), então basta olhar o relógio uma vez
+bool CancellationToken::isCancelled() {
+    if (cancelled.load(std::memory_order_relaxed)) return true;
+    if (parent && parent->cancelledUpstream()) {
+        cancel(parent->getReason());
+        return true;
+    }
+    if (deadline != Clock::time_point::max() && Clock::now() >= deadline) {
+        cancel("prazo vencido");
+        return true;
+    }
+    return false;
+}
+
+bool CancellationToken::cancelledUpstream() const {
+    return cancelled.load(std::memory_order_relaxed) || (parent && parent->cancelledUpstream());
+}
+
+std::string CancellationToken::getReason() const {
+    std::lock_guard<std::mutex> lock(reasonMutex);
+    return reason;
+}
@@ -0,0 +1,34 @@
+#include "completionqueue.h"
+
+#include <thread>
+
+CompletionQueue::CompletionQueue(size_t capacity) : ring(capacity) {}
+
+void CompletionQueue::push(uint32_t group, uint32_t slot, std::exception_ptr error) {
+    // A fila comporta todas as threads em execução; só enche se houver mais produtores que capacity
+    while (!ring.tryPush(Event{group, slot, error})) {
+        std::this_thread::yield();
+    }
+    available.release();
+}
+
+CompletionQueue::Event CompletionQueue::pop() {
+    available.acquire();
+    return take();
+}
+
+bool CompletionQueue::tryPop(Event& event) {
+    if (!available.try_acquire()) return false;
+    event = take();
+    return true;
+}
+
+// Com o semáforo adquirido há um evento publicado, mas um produtor que reservou uma posição
+// anterior da fila pode ainda estar escrevendo o dele: espera esse instante
+CompletionQueue::Event CompletionQueue::take() {
+    Event event;
+    while (!ring.tryPop(event)) {
+        std::this_thread::yield();
+    }
+    return event;
+}
@@ -1,6 +1,8 @@
 #include <iomanip>
 #include "dataframe.h"
 #include <exception>
+#include <functional>
+#include <string_view>
 
 
 BaseColumn::BaseColumn(const std::string &id, int pos, const std::string &dt)
@@ -80,6 +82,101 @@ void DataFrame::addRow(const std::vector<VarCell> &row) {
 
 
 
+// Valida tudo antes de acrescentar, para não deixar colunas com tamanhos diferentes
+void DataFrame::checkSameColumns(const DataFrame &other, const char* caller) const {
+    if (other.columns.size() != columns.size()) {
+        throw std::invalid_argument(std::string(caller) + ": number of columns differs.");
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i]->getTypeName() != other.columns[i]->getTypeName()) {
+            throw std::invalid_argument(std::string(caller) + ": type of column " + columns[i]->getIdentifier() + " differs.");
+        }
+    }
+}
+
+void DataFrame::append(const DataFrame &other) {
+    checkSameColumns(other, "DataFrame::append");
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i]->appendColumn(*other.columns[i]);
+    }
+    dataFrameSize += other.dataFrameSize;
+}
+
+void DataFrame::append(const DataFrame &other, const std::vector<size_t> &rows) {
+    checkSameColumns(other, "DataFrame::append");
+    for (size_t r : rows) {
+        if (r >= other.dataFrameSize) {
+            throw std::out_of_range("DataFrame::append: row out of bounds.");
+        }
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i]->appendRows(*other.columns[i], rows);
+    }
+    dataFrameSize += rows.size();
+}
+
+size_t DataFrame::memoryBytes() const {
+    size_t bytes = 0;
+    for (const auto& column : columns) {
+        bytes += column->memoryBytes();
+    }
+    return bytes;
+}
+
+// Combina o hash de cada coluna no formato binário (strings levam o tamanho antes, então
+// valores diferentes não geram os mesmos bytes); uma coluna serializada por vez
+uint64_t DataFrame::contentFingerprint() const {
+    std::hash<std::string_view> hasher;
+    uint64_t hash = dataFrameSize;
+    auto mix = [&hash](uint64_t value) {
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    std::string bytes;
+    for (const auto& column : columns) {
+        mix(hasher(column->getIdentifier()));
+        mix(hasher(column->getTypeName()));
+        bytes.clear();
+        column->writeBinary(bytes);
+        mix(hasher(bytes));
+    }
+    return hash;
+}
+
+void DataFrame::writeBinary(std::string &out) {
+    uint64_t rows = dataFrameSize;
+    uint32_t ncols = static_cast<uint32_t>(columns.size());
+    out.append(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    out.append(reinterpret_cast<const char*>(&ncols), sizeof(ncols));
+    for (const auto& column : columns) {
+        column->writeBinary(out);
+    }
+}
+
+void DataFrame::appendBinary(const char *data, size_t len) {
+    uint64_t rows;
+    uint32_t ncols;
+    if (len < sizeof(rows) + sizeof(ncols)) {
+        throw std::runtime_error("DataFrame::appendBinary: truncated data.");
+    }
+    std::memcpy(&rows, data, sizeof(rows));
+    std::memcpy(&ncols, data + sizeof(rows), sizeof(ncols));
+    if (ncols != columns.size()) {
+        throw std::invalid_argument("DataFrame::appendBinary: number of columns differs.");
+    }
+    // Lê em colunas novas e só as junta no fim, para um erro no meio não deixar tamanhos diferentes
+    size_t used = sizeof(rows) + sizeof(ncols);
+    std::vector<std::shared_ptr<BaseColumn>> read;
+    for (const auto& column : columns) {
+        auto fresh = column->cloneEmpty();
+        used += fresh->readBinary(data + used, len - used, rows);
+        read.push_back(fresh);
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i]->appendColumn(*read[i]);
+    }
+    dataFrameSize += rows;
+}
+
 std::shared_ptr<BaseColumn> DataFrame::getColumn(size_t index) const {
     if (index >= columns.size()) {
         throw std::out_of_range("BaseColumn index out of DataFrame bounds.");
@@ -171,3 +268,33 @@ std::shared_ptr<DataFrame> DataFrame::emptyCopy(std::vector<std::string> colName
     }
     return df;
 }
+
+void DataFrame::buildKeyIndex(const std::string& columnName) {
+    keyIndex = std::make_shared<const KeyIndex>(*this, columnName);
+}
+
+std::shared_ptr<const KeyIndex> DataFrame::getKeyIndex(const std::string& columnName) const {
+    if (keyIndex && keyIndex->getColumnName() == columnName) {
+        return keyIndex;
+    }
+    return nullptr;
+}
+
+// ###############################################################################################
+// ###############################################################################################
+// Métodos da classe KeyIndex
+
+KeyIndex::KeyIndex(const DataFrame& df, const std::string& columnName)
+    : columnName(columnName) {
+    const auto& data = df.getColumnData<std::string>(df.getColumn(columnName)->getPosition());
+    keys.reserve(data.size());
+    rows.reserve(data.size());
+    for (size_t r = 0; r < data.size(); ++r) {
+        auto [id, inserted] = keys.insert(data[r]);
+        if (inserted) {
+            rows.push_back(r);
+        } else {
+            rows[id] = r;
+        }
+    }
+}
@@ -0,0 +1,260 @@
+#include "quantile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Abaixo disso não compensa criar threads
+const size_t minValuesPerThread = 16384;
+
+size_t effectiveThreads(size_t n, int numThreads) {
+    return std::max<size_t>(1, std::min<size_t>(std::max(numThreads, 1), n / minValuesPerThread));
+}
+
+// Executa fn(t, begin, end) em nThreads blocos contíguos de [0, n)
+template <typename Fn>
+void parallelFor(size_t n, size_t nThreads, Fn fn) {
+    if (nThreads == 1) {
+        fn(0, 0, n);
+        return;
+    }
+    std::vector<std::thread> threads;
+    size_t block = n / nThreads;
+    for (size_t t = 0; t < nThreads; t++) {
+        size_t begin = t * block;
+        size_t end = (t == nThreads - 1) ? n : begin + block;
+        threads.emplace_back(fn, t, begin, end);
+    }
+    for (auto& th : threads) th.join();
+}
+
+struct Range {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    size_t count = 0; // valores não-NaN
+};
+
+Range findRange(const std::vector<double>& values, size_t nThreads) {
+    std::vector<Range> partial(nThreads);
+    parallelFor(values.size(), nThreads, [&](size_t t, size_t begin, size_t end) {
+        Range r;
+        for (size_t i = begin; i < end; i++) {
+            double v = values[i];
+            if (std::isnan(v)) continue;
+            if (v < r.min) r.min = v;
+            if (v > r.max) r.max = v;
+            r.count++;
+        }
+        partial[t] = r;
+    });
+    Range total;
+    for (const auto& r : partial) {
+        total.min = std::min(total.min, r.min);
+        total.max = std::max(total.max, r.max);
+        total.count += r.count;
+    }
+    return total;
+}
+
+// Posição (fracionária) do quantil q entre n valores ordenados
+std::pair<size_t, size_t> neighbourRanks(double q, size_t n, double& frac) {
+    if (q < 0.0 || q > 1.0) {
+        throw std::invalid_argument("Quantile must be between 0 and 1.");
+    }
+    double pos = q * static_cast<double>(n - 1);
+    size_t lo = static_cast<size_t>(std::floor(pos));
+    size_t hi = std::min(lo + 1, n - 1);
+    frac = pos - static_cast<double>(lo);
+    return {lo, hi};
+}
+
+std::vector<double> exactQuantiles(const std::vector<double>& values, const std::vector<double>& qs,
+                                   const Range& range, size_t nThreads) {
+    const size_t n = range.count;
+    const size_t numBins = std::clamp<size_t>(n / 32, 1024, 1 << 16);
+    double width = range.max - range.min;
+    const double scale = (width > 0 && std::isfinite(width)) ? numBins / width : 0.0;
+    auto binOf = [&](double v) {
+        double x = (v - range.min) * scale;
+        // !(x < numBins) também cobre o NaN de valores infinitos
+        return !(x < numBins) ? numBins - 1 : static_cast<size_t>(x);
+    };
+
+    // 1) histograma, com um vetor de contagens por thread
+    std::vector<std::vector<size_t>> partial(nThreads, std::vector<size_t>(numBins, 0));
+    parallelFor(values.size(), nThreads, [&](size_t t, size_t begin, size_t end) {
+        auto& counts = partial[t];
+        for (size_t i = begin; i < end; i++) {
+            if (!std::isnan(values[i])) counts[binOf(values[i])]++;
+        }
+    });
+    std::vector<size_t> before(numBins + 1, 0); // before[b] = valores nas faixas anteriores a b
+    for (size_t b = 0; b < numBins; b++) {
+        size_t c = 0;
+        for (size_t t = 0; t < nThreads; t++) c += partial[t][b];
+        before[b + 1] = before[b] + c;
+    }
+
+    // 2) faixas que contêm alguma das ordens procuradas
+    std::vector<std::pair<size_t, size_t>> ranks;
+    std::vector<double> fracs;
+    std::vector<char> wanted(numBins, 0);
+    auto binOfRank = [&](size_t rank) {
+        return static_cast<size_t>(std::upper_bound(before.begin(), before.end(), rank) - before.begin() - 1);
+    };
+    for (double q : qs) {
+        double frac;
+        auto r = neighbourRanks(q, n, frac);
+        ranks.push_back(r);
+        fracs.push_back(frac);
+        wanted[binOfRank(r.first)] = 1;
+        wanted[binOfRank(r.second)] = 1;
+    }
+
+    // 3) copia apenas os candidatos dessas faixas
+    std::vector<std::vector<std::vector<double>>> gathered(nThreads, std::vector<std::vector<double>>(numBins));
+    parallelFor(values.size(), nThreads, [&](size_t t, size_t begin, size_t end) {
+        auto& local = gathered[t];
+        for (size_t i = begin; i < end; i++) {
+            double v = values[i];
+            if (std::isnan(v)) continue;
+            size_t b = binOf(v);
+            if (wanted[b]) local[b].push_back(v);
+        }
+    });
+    std::vector<std::vector<double>> candidates(numBins);
+    for (size_t b = 0; b < numBins; b++) {
+        if (!wanted[b]) continue;
+        for (size_t t = 0; t < nThreads; t++) {
+            candidates[b].insert(candidates[b].end(), gathered[t][b].begin(), gathered[t][b].end());
+        }
+    }
+
+    // 4) seleção dentro da faixa
+    auto select = [&](size_t rank) {
+        size_t b = binOfRank(rank);
+        auto& cand = candidates[b];
+        auto nth = cand.begin() + (rank - before[b]);
+        std::nth_element(cand.begin(), nth, cand.end());
+        return *nth;
+    };
+    std::vector<double> result;
+    for (size_t i = 0; i < qs.size(); i++) {
+        double vlo = select(ranks[i].first);
+        double vhi = (ranks[i].second == ranks[i].first) ? vlo : select(ranks[i].second);
+        result.push_back(vlo + fracs[i] * (vhi - vlo));
+    }
+    return result;
+}
+
+std::vector<double> approximateQuantiles(const std::vector<double>& values, const std::vector<double>& qs,
+                                         const Range& range, size_t nThreads) {
+    std::vector<QuantileSketch> sketches(nThreads, QuantileSketch(range.min, range.max));
+    parallelFor(values.size(), nThreads, [&](size_t t, size_t begin, size_t end) {
+        sketches[t].add(values, begin, end);
+    });
+    for (size_t t = 1; t < nThreads; t++) {
+        sketches[0].merge(sketches[t]);
+    }
+    std::vector<double> result;
+    for (double q : qs) {
+        result.push_back(sketches[0].quantile(q));
+    }
+    return result;
+}
+
+} // namespace
+
+std::vector<double> quantiles(const std::vector<double>& values, const std::vector<double>& qs,
+                              int numThreads, QuantileMode mode) {
+    size_t nThreads = effectiveThreads(values.size(), numThreads);
+    Range range = findRange(values, nThreads);
+    if (range.count == 0) {
+        return std::vector<double>(qs.size(), std::numeric_limits<double>::quiet_NaN());
+    }
+    if (range.min == range.max) {
+        return std::vector<double>(qs.size(), range.min);
+    }
+    if (mode == QuantileMode::Approximate) {
+        return approximateQuantiles(values, qs, range, nThreads);
+    }
+    return exactQuantiles(values, qs, range, nThreads);
+}
+
+double quantile(const std::vector<double>& values, double q, int numThreads, QuantileMode mode) {
+    return quantiles(values, {q}, numThreads, mode).front();
+}
+
+// ###############################################################################################
+// ###############################################################################################
+// Métodos da classe QuantileSketch
+
+QuantileSketch::QuantileSketch(double lo, double hi, size_t numBins)
+    : lo(lo), hi(hi), bins(std::max<size_t>(numBins, 1), 0) {
+    double width = hi - lo;
+    scale = (width > 0 && std::isfinite(width)) ? bins.size() / width : 0.0;
+}
+
+size_t QuantileSketch::binOf(double value) const {
+    if (value <= lo) return 0;
+    size_t b = static_cast<size_t>((value - lo) * scale);
+    return b < bins.size() ? b : bins.size() - 1;
+}
+
+void QuantileSketch::add(double value) {
+    if (std::isnan(value)) return;
+    bins[binOf(value)]++;
+    total++;
+}
+
+void QuantileSketch::add(const std::vector<double>& values, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        add(values[i]);
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.bins.size() != bins.size() || other.lo != lo || other.hi != hi) {
+        throw std::invalid_argument("QuantileSketch merge requires the same range and number of bins.");
+    }
+    for (size_t b = 0; b < bins.size(); b++) {
+        bins[b] += other.bins[b];
+    }
+    total += other.total;
+}
+
+// Valor estimado da ordem 'rank' (0-based), supondo valores uniformes dentro de cada faixa
+double QuantileSketch::valueAtRank(double rank) const {
+    double width = (hi - lo) / bins.size();
+    double seen = 0;
+    for (size_t b = 0; b < bins.size(); b++) {
+        if (bins[b] == 0) continue;
+        if (rank < seen + bins[b]) {
+            double within = (rank - seen + 0.5) / bins[b];
+            return std::min(hi, lo + (b + within) * width);
+        }
+        seen += bins[b];
+    }
+    return hi;
+}
+
+double QuantileSketch::quantile(double q) const {
+    if (total == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (q < 0.0 || q > 1.0) {
+        throw std::invalid_argument("Quantile must be between 0 and 1.");
+    }
+    double pos = q * static_cast<double>(total - 1);
+    double rlo = std::floor(pos);
+    double rhi = std::min(rlo + 1, static_cast<double>(total - 1));
+    double frac = pos - rlo;
+    double vlo = valueAtRank(rlo);
+    double vhi = valueAtRank(rhi);
+    return vlo + frac * (vhi - vlo);
+}
@@ -1,14 +1,29 @@
 #include <iostream>
+#include <filesystem>
+#include <unordered_map>
 
 #include "types.h"
 #include "datarepository.h"
 
+namespace {
+std::shared_ptr<std::mutex> fileWriteMutex(const std::string& fileName) {
+    static std::mutex registryMutex;
+    static std::unordered_map<std::string, std::shared_ptr<std::mutex>> registry;
+    std::string key = std::filesystem::absolute(fileName).lexically_normal().string();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto& m = registry[key];
+    if (!m) m = std::make_shared<std::mutex>();
+    return m;
+}
+}
+
 FileRepository::FileRepository(const std::string& fname,
                                const std::string& sep,
                                bool hasHeader)
                                : fileName(fname),
                                  separator(sep),
                                  hasHeader(hasHeader),
+                                 writeMutex(fileWriteMutex(fname)),
                                  currentReadLine(0),
                                  totalLines(0) {
 
@@ -84,7 +99,9 @@ void FileRepository::appendStr(const std::string& data) {
     if (!outFile.is_open()) {
         throw std::runtime_error("Failed opening file: " + fileName);
     }
+    std::lock_guard<std::mutex> lock(*writeMutex);
     outFile << data << "\n";
+    outFile.flush();
 }
 
 void FileRepository::appendRow(const std::vector<std::string>& data) {
@@ -92,11 +109,12 @@ void FileRepository::appendRow(const std::vector<std::string>& data) {
         throw std::runtime_error("Failed opening file: " + fileName);
     }
     // outFile.clear(); 
+    std::string line;
     for (size_t i=0; i < data.size(); ++i) {
-        if (i)  outFile << ",";
-        outFile << data[i];
+        if (i)  line += ",";
+        line += data[i];
     }
-    outFile << "\n";
+    appendStr(line);
 }
 
 void FileRepository::appendHeader(const std::vector<std::string>& data) {
@@ -158,12 +176,45 @@ void FileRepository::close() {
     }
 }
 
+// Só para leitura: abrir o arquivo para escrita faria o seu fechamento aparecer como uma nova
+// escrita para quem observa a pasta
+void FileRepository::setFile(const std::string& fname) {
+    close();
+    fileName = fname;
+    writeMutex = fileWriteMutex(fname);
+    totalLines = 0;
+    inFile.open(fileName);
+    if (!inFile.is_open()) {
+        throw std::runtime_error("Failed opening file: " + fileName);
+    }
+    currentReadLine = 0;
+    hasNextLine = true;
+    if (hasHeader) {
+        std::getline(inFile, currLine);
+    }
+}
+
 void FileRepository::resetReader() {
     if (inFile.is_open()) {
         inFile.close();
     }
     inFile.open(fileName);
     currentReadLine = 0;
+    hasNextLine = true;
+    if (hasHeader) {
+        std::getline(inFile, currLine);
+    }
+}
+
+// Data de modificação e tamanho do arquivo
+std::string FileRepository::getVersion() {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(fileName, ec);
+    if (ec) {
+        return "";
+    }
+    auto size = std::filesystem::file_size(fileName, ec);
+    return std::to_string(mtime.time_since_epoch().count()) + ":" + std::to_string(ec ? 0 : size);
 }
 
 void FileRepository::clear() {
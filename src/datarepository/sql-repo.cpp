@@ -149,8 +149,26 @@ std::string SQLiteRepository::serializeBatch(const std::vector<StrRow>& data) {
 void SQLiteRepository::resetReader() {
     if (stmt) {
         sqlite3_finalize(stmt);
+        stmt = nullptr;
     }
     prepareSelect();
+    done = false;
+}
+
+// PRAGMA data_version muda quando outra conexão confirma escritas no banco; as escritas feitas
+// por esta conexão são contadas por sqlite3_total_changes
+std::string SQLiteRepository::getVersion() {
+    if (!db) {
+        return "";
+    }
+    sqlite3_stmt* pragma = nullptr;
+    std::string version;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &pragma, nullptr) == SQLITE_OK &&
+        sqlite3_step(pragma) == SQLITE_ROW) {
+        version = std::to_string(sqlite3_column_int64(pragma, 0)) + ":" + std::to_string(sqlite3_total_changes(db));
+    }
+    sqlite3_finalize(pragma);
+    return version;
 }
 
 void SQLiteRepository::clear() {
@@ -164,8 +182,10 @@ void SQLiteRepository::clear() {
 void SQLiteRepository::close() {
     if (stmt) {
         sqlite3_finalize(stmt);
+        stmt = nullptr;
     }
     if (db) {
         sqlite3_close(db);
+        db = nullptr;
     }
 }
@@ -0,0 +1,176 @@
+#include "dedupfilter.h"
+
+#include <algorithm>
+#include <functional>
+
+// ###############################################################################################
+// ###############################################################################################
+// Tabela de impressões
+
+DedupFilter::FingerprintSet::FingerprintSet(size_t expected) {
+    // Carga de no máximo 1/2 com os ids esperados
+    size_t n = 16;
+    while (n < expected * 2) n <<= 1;
+    slots.assign(n, 0);
+    mask = n - 1;
+}
+
+bool DedupFilter::FingerprintSet::insert(uint64_t fingerprint) {
+    // Acima de 70% de ocupação a sondagem linear fica longa demais: dobra a tabela
+    if ((count + 1) * 10 > slots.size() * 7) grow();
+    size_t i = fingerprint & mask;
+    while (slots[i] != 0) {
+        if (slots[i] == fingerprint) return false;
+        i = (i + 1) & mask;
+    }
+    slots[i] = fingerprint;
+    count++;
+    return true;
+}
+
+bool DedupFilter::FingerprintSet::contains(uint64_t fingerprint) const {
+    if (count == 0) return false; // geração vazia: evita uma falta de cache
+    size_t i = fingerprint & mask;
+    while (slots[i] != 0) {
+        if (slots[i] == fingerprint) return true;
+        i = (i + 1) & mask;
+    }
+    return false;
+}
+
+bool DedupFilter::FingerprintSet::erase(uint64_t fingerprint) {
+    if (count == 0) return false;
+    size_t i = fingerprint & mask;
+    while (slots[i] != fingerprint) {
+        if (slots[i] == 0) return false;
+        i = (i + 1) & mask;
+    }
+    // Sem lápides: puxa para o buraco as impressões seguintes da sequência que ficariam
+    // inalcançáveis, para que a sondagem linear continue parando no primeiro slot vazio
+    size_t hole = i;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (slots[j] == 0) break;
+        size_t home = slots[j] & mask;
+        // Pode ir para o buraco se a posição ideal não está entre o buraco e j (circularmente)
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            slots[hole] = slots[j];
+            hole = j;
+        }
+    }
+    slots[hole] = 0;
+    count--;
+    return true;
+}
+
+void DedupFilter::FingerprintSet::clear() {
+    std::fill(slots.begin(), slots.end(), 0);
+    count = 0;
+}
+
+void DedupFilter::FingerprintSet::grow() {
+    std::vector<uint64_t> old;
+    old.swap(slots);
+    slots.assign(old.size() * 2, 0);
+    mask = slots.size() - 1;
+    for (uint64_t fingerprint : old) {
+        if (fingerprint == 0) continue;
+        size_t i = fingerprint & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = fingerprint;
+    }
+}
+
+// ###############################################################################################
+// ###############################################################################################
+// Métodos da classe DedupFilter
+
+DedupFilter::DedupFilter() : DedupFilter(Options()) {}
+
+DedupFilter::DedupFilter(Options options) : options(options) {
+    size_t n = 1;
+    int bits = 0;
+    while (n < std::max<size_t>(options.numShards, 1)) {
+        n <<= 1;
+        bits++;
+    }
+    shardShift = 64 - bits;
+    shards = std::vector<Shard>(n);
+    auto now = Clock::now();
+    for (auto& shard : shards) {
+        shard.current = std::make_unique<FingerprintSet>(options.expectedIds / n);
+        shard.previous = std::make_unique<FingerprintSet>(options.expectedIds / n);
+        shard.generationStart = now;
+    }
+}
+
+// Troca de geração quando a janela da atual acabou. Depois de duas janelas sem uso as duas
+// gerações já expiraram.
+void DedupFilter::Shard::rotate(Clock::time_point now, Clock::duration window) {
+    if (now - generationStart < window) return;
+    if (now - generationStart >= 2 * window) {
+        current->clear();
+    }
+    previous.swap(current);
+    current->clear();
+    generationStart = now;
+}
+
+uint64_t DedupFilter::fingerprint(std::string_view id) {
+    uint64_t h = std::hash<std::string_view>{}(id);
+    return h == 0 ? 1 : h; // 0 marca slot vazio
+}
+
+size_t DedupFilter::shardIndex(uint64_t fingerprint) const {
+    // Bits altos para o shard, bits baixos para a posição na tabela
+    return shardShift >= 64 ? 0 : static_cast<size_t>(fingerprint >> shardShift);
+}
+
+bool DedupFilter::insert(std::string_view id) {
+    return insert(id, Clock::now());
+}
+
+bool DedupFilter::insert(std::string_view id, Clock::time_point now) {
+    uint64_t fp = fingerprint(id);
+    Shard& shard = shards[shardIndex(fp)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.rotate(now, options.window);
+    shard.checked++;
+    if (shard.previous->contains(fp) || !shard.current->insert(fp)) {
+        shard.duplicates++;
+        return false;
+    }
+    return true;
+}
+
+bool DedupFilter::contains(std::string_view id) const {
+    uint64_t fp = fingerprint(id);
+    const Shard& shard = shards[shardIndex(fp)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    // Como em rotate, mas sem trocar as gerações
+    auto age = Clock::now() - shard.generationStart;
+    if (age >= 2 * options.window) return false;
+    if (age >= options.window) return shard.current->contains(fp);
+    return shard.current->contains(fp) || shard.previous->contains(fp);
+}
+
+bool DedupFilter::erase(std::string_view id) {
+    uint64_t fp = fingerprint(id);
+    Shard& shard = shards[shardIndex(fp)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    bool erased = shard.current->erase(fp);
+    return shard.previous->erase(fp) || erased;
+}
+
+DedupFilter::Stats DedupFilter::getStats() const {
+    Stats stats;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        stats.checked += shard.checked;
+        stats.duplicates += shard.duplicates;
+        stats.size += shard.current->size() + shard.previous->size();
+        stats.memoryBytes += shard.current->memoryBytes() + shard.previous->memoryBytes();
+    }
+    return stats;
+}
@@ -2,12 +2,38 @@
 #include "datarepository.h"
 #include "task.h"
 #include "trigger.hpp"
+#include "groupby.h"
+#include "quantile.h"
+#include "statestore.h"
+#include "triggerpolicy.hpp"
+#include "columndecoder.h"
+#include "pipelinemanager.hpp"
+#include "shardedpipelinemanager.hpp"
+#include "mpscring.h"
+#include "ingestlog.h"
+#include "dedupfilter.h"
+#include "pipelinetrace.h"
+#include "taskprofile.h"
+#include "scheduler.h"
+#include "completionqueue.h"
 
 #include <iostream>
 #include <vector>
 #include <any>
 #include <unordered_map>
-
+#include <atomic>
+#include <thread>
+#include <queue>
+#include <condition_variable>
+#include <filesystem>
+#include <set>
+#include <sstream>
+#include <cmath>
+#include <fstream>
+#include <csignal>
+
+#include <sys/resource.h>
+#include <time.h>
 
 using namespace std;
 
@@ -1175,6 +1201,1930 @@ void testeBatch() {
     std::cout << df2->toString() << std::endl;
 }
 
+void testeGroupBy(int nThreads = 4) {
+    //DataFrame sintético com chaves repetidas para comparar com a agregação serial
+    auto df = std::make_shared<DataFrame>();
+    df->addColumn<string>("usuario");
+    df->addColumn<double>("valor");
+    df->addColumn<int>("quantidade");
+    for (int i = 0; i < 200000; i++) {
+        vector<any> row {string("u") + to_string((i * 7919) % 5003), (i % 97) * 1.5, i % 5};
+        df->addRow(row);
+    }
+
+    std::unordered_map<string, double> soma, minimo, maximo, ultimo;
+    std::unordered_map<string, int> contagem, quantidade, contagemPares;
+    for (size_t r = 0; r < df->size(); r++) {
+        string u = df->getElement<string>(r, 0);
+        double v = df->getElement<double>(r, 1);
+        if (contagem[u] == 0) { minimo[u] = v; maximo[u] = v; }
+        soma[u] += v;
+        quantidade[u] += df->getElement<int>(r, 2);
+        if (r % 2 == 0) contagemPares[u]++;
+        minimo[u] = std::min(minimo[u], v);
+        maximo[u] = std::max(maximo[u], v);
+        ultimo[u] = v;
+        contagem[u]++;
+    }
+
+    for (int t : {1, nThreads}) {
+        auto res = GroupBy<string>(df, "usuario")
+                       .agg("valor", AggOp::Sum, "soma")
+                       .agg("valor", AggOp::Mean, "media")
+                       .agg("valor", AggOp::Min, "min")
+                       .agg("valor", AggOp::Max, "max")
+                       .agg("valor", AggOp::Last, "ultimo")
+                       .agg("quantidade", AggOp::Sum, "quantidade")
+                       .count()
+                       .execute(t);
+        bool ok = res->numGroups() == contagem.size();
+        for (auto& kv : contagem) {
+            const string& u = kv.first;
+            size_t g = res->findGroup(u);
+            ok = ok && g != res->npos
+                    && std::abs(res->get(g, res->aggIndex("soma")) - soma[u]) < 1e-6
+                    && std::abs(res->get(g, res->aggIndex("media")) - soma[u] / kv.second) < 1e-6
+                    && res->get(g, res->aggIndex("min")) == minimo[u]
+                    && res->get(g, res->aggIndex("max")) == maximo[u]
+                    && res->get(g, res->aggIndex("ultimo")) == ultimo[u]
+                    && res->get(g, res->aggIndex("quantidade")) == quantidade[u]
+                    && res->get(g, res->aggIndex("count")) == kv.second;
+        }
+        ok = ok && res->findGroup("inexistente") == res->npos;
+
+        //Só as linhas pares, num vetor que já não existe quando execute é chamado
+        GroupBy<string> soPares(df, "usuario");
+        {
+            vector<int> pares;
+            for (int r = 0; r < static_cast<int>(df->size()); r += 2) pares.push_back(r);
+            soPares.onRows(pares).count();
+        }
+        auto parcial = soPares.execute(t);
+        ok = ok && parcial->numGroups() == contagemPares.size();
+        for (auto& kv : contagemPares) {
+            size_t g = parcial->findGroup(kv.first);
+            ok = ok && g != parcial->npos && parcial->get(g, parcial->aggIndex("count")) == kv.second;
+        }
+        cout << "[testeGroupBy] " << t << " thread(s): " << res->numGroups() << " grupos - "
+             << (ok ? "OK" : "FALHOU") << endl;
+    }
+}
+
+void testeQuantile(int nThreads = 4) {
+    //Valores com muitas repetições e alguns NaN, comparados com a ordenação completa
+    vector<double> valores;
+    for (int i = 0; i < 300000; i++) {
+        valores.push_back(((i * 7919LL) % 100003) / 7.0 - (i % 3) * 1000.0);
+    }
+    valores.push_back(std::nan(""));
+
+    vector<double> ordenados;
+    for (double v : valores) {
+        if (!std::isnan(v)) ordenados.push_back(v);
+    }
+    std::sort(ordenados.begin(), ordenados.end());
+    auto esperado = [&](double q) {
+        double pos = q * (ordenados.size() - 1);
+        size_t lo = static_cast<size_t>(pos);
+        size_t hi = std::min(lo + 1, ordenados.size() - 1);
+        return ordenados[lo] + (pos - lo) * (ordenados[hi] - ordenados[lo]);
+    };
+
+    vector<double> qs {0.0, 0.01, 0.25, 0.5, 0.75, 0.999, 1.0};
+    double faixa = (ordenados.back() - ordenados.front()) / 4096;
+    for (int t : {1, nThreads}) {
+        auto exatos = quantiles(valores, qs, t);
+        auto aproximados = quantiles(valores, qs, t, QuantileMode::Approximate);
+        bool ok = true;
+        for (size_t i = 0; i < qs.size(); i++) {
+            ok = ok && std::abs(exatos[i] - esperado(qs[i])) < 1e-9
+                    && std::abs(aproximados[i] - esperado(qs[i])) <= faixa;
+        }
+        ok = ok && median(vector<double>{3, 1, 2, 10}, t) == 2.5
+                && median(vector<double>(10, 4.0), t) == 4.0;
+        cout << "[testeQuantile] " << t << " thread(s): mediana " << median(valores, t) << " - "
+             << (ok ? "OK" : "FALHOU") << endl;
+    }
+}
+
+void testeStateStore() {
+    //Escritas de uma transação só aparecem no estado confirmado depois do commit
+    StateStore<string, double> saldos;
+    saldos.put("a", 100.0);
+
+    saldos.begin();
+    saldos.put("a", saldos.getOr("a", 0.0) - 30.0);
+    saldos.put("b", 50.0);
+    bool ok = saldos.getOr("a", 0.0) == 70.0 && saldos.contains("b") && saldos.size() == 1;
+    saldos.rollback();
+    ok = ok && saldos.getOr("a", 0.0) == 100.0 && !saldos.contains("b") && !saldos.inTransaction();
+
+    saldos.begin();
+    saldos.put("a", saldos.getOr("a", 0.0) - 30.0);
+    saldos.put("b", 50.0);
+    saldos.commit();
+    ok = ok && saldos.getOr("a", 0.0) == 70.0 && saldos.getOr("b", 0.0) == 50.0 && saldos.size() == 2;
+
+    cout << "[testeStateStore] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeStateSession(int nSessoes = 4) {
+    //Sessões concorrentes (uma por instância da pipeline) não perdem atualizações umas das outras
+    StateStore<string, double> contadores;
+    const int incrementos = 1000;
+    vector<thread> threads;
+    for (int s = 0; s < nSessoes; s++) {
+        threads.emplace_back([&contadores, s] {
+            auto sessao = contadores.openSession();
+            sessao->begin();
+            for (int i = 0; i < incrementos; i++) {
+                sessao->put("total", sessao->getOr("total", 0.0) + 1.0);
+            }
+            //A primeira sessão desfaz suas escritas
+            if (s == 0) sessao->rollback();
+            else sessao->commit();
+        });
+    }
+    for (auto& t : threads) t.join();
+    bool ok = contadores.getOr("total", 0.0) == (nSessoes - 1) * incrementos && !contadores.inTransaction();
+
+    //Ordem dos batches: a segunda transação chega antes ao estado, mas espera o commit da primeira
+    StateStore<string, double> ordem;
+    auto primeira = ordem.openSession();
+    auto segunda = ordem.openSession();
+    auto semEstado = ordem.openSession();
+    primeira->begin();
+    segunda->begin();
+    semEstado->begin();
+    semEstado->commit(); //termina antes das anteriores sem tocar o estado
+    std::atomic<bool> segundaLeu{false};
+    double vistoPelaSegunda = -1.0;
+    thread tardia([&] {
+        vistoPelaSegunda = segunda->getOr("x", 0.0);
+        segundaLeu = true;
+        segunda->put("x", vistoPelaSegunda + 10.0);
+        segunda->commit();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ok = ok && !segundaLeu.load();
+    primeira->put("x", 1.0);
+    primeira->commit();
+    tardia.join();
+    ok = ok && vistoPelaSegunda == 1.0 && ordem.getOr("x", 0.0) == 11.0;
+    //Todas as senhas anteriores terminaram: a próxima transação não espera
+    ordem.begin();
+    ordem.put("x", 12.0);
+    ordem.commit();
+    ok = ok && ordem.getOr("x", 0.0) == 12.0;
+
+    cout << "[testeStateSession] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Grava cada id no estado e falha nos batches que têm o id "falha"
+class EstadoTransformer : public Transformer {
+public:
+    explicit EstadoTransformer(std::shared_ptr<StateStore<string, double>> estado): estado(estado) {};
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        const auto& ids = inputs[0].second->getColumnData<string>(0);
+        for (int r : inputs[0].first) {
+            if (ids[r] == "falha") throw std::runtime_error("id inválido no batch");
+            estado->put(ids[r], 1.0);
+        }
+    }
+    void prepare(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override {
+        const auto& ids = inputs[0].second->getColumnData<string>(0);
+        if (!inputs[0].first.empty() && ids[inputs[0].first[0]] == "falha-prepare") throw std::runtime_error("prepare inválido");
+    }
+private:
+    std::shared_ptr<StateStore<string, double>> estado;
+};
+
+void testeRollbackMultiThread(int nThreads = 3) {
+    //Exceção numa das threads da task: a execução para, o estado do batch é desfeito e o próximo batch confirma
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    auto lote = [&schema](const string& prefixo, bool comFalha) {
+        auto df = schema.emptyCopy();
+        for (int i = 0; i < 6000; i++) df->addRow(vector<any>{prefixo + to_string(i)});
+        if (comFalha) df->addRow(vector<any>{string("falha")});
+        return df;
+    };
+    auto estado = std::make_shared<StateStore<string, double>>();
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(schema.emptyCopy());
+    e->setTaskName("e");
+    e->blockParallel();
+    auto t = std::make_shared<EstadoTransformer>(estado);
+    t->setTaskName("estado");
+    t->setMorselRows(500);
+    t->setMaxThreadsProportion(1.0);
+    e->addNext(t, {1});
+    ServerTrigger trigger;
+    trigger.addExtractor(e);
+    trigger.addStateStore(estado);
+
+    std::streambuf* saida = cout.rdbuf(nullptr);
+    std::streambuf* erros = cerr.rdbuf(nullptr);
+    trigger.start(nThreads, lote("a", true)).join();
+    bool ok = !estado->contains("a0") && !estado->contains("a5999") && !estado->inTransaction();
+    trigger.start(nThreads, lote("b", false)).join();
+    ok = ok && estado->contains("b0") && estado->contains("b5999") && !estado->contains("a0") && !trigger.isBusy();
+
+    //RequestTrigger: a exceção da thread chega a quem chamou start
+    RequestTrigger requisicao;
+    auto e2 = std::make_shared<ExtractorNoop>();
+    e2->addOutput(lote("c", true));
+    e2->setTaskName("e2");
+    e2->blockParallel();
+    auto t2 = std::make_shared<EstadoTransformer>(std::make_shared<StateStore<string, double>>());
+    t2->setTaskName("estado2");
+    t2->setMorselRows(500);
+    e2->addNext(t2, {1});
+    requisicao.addExtractor(e2);
+    std::string erro;
+    try {
+        requisicao.start(nThreads);
+    } catch (const std::runtime_error& ex) {
+        erro = ex.what();
+    }
+    ok = ok && erro == "id inválido no batch";
+
+    //Exceção no prepare: as threads que esperam por ele não ficam presas, e a execução falha
+    auto falhaPrepare = schema.emptyCopy();
+    falhaPrepare->addRow(vector<any>{string("falha-prepare")});
+    falhaPrepare->append(*lote("d", false));
+    trigger.start(nThreads, falhaPrepare).join();
+    ok = ok && !estado->contains("d0") && !estado->inTransaction();
+    trigger.start(nThreads, lote("f", false)).join();
+    ok = ok && estado->contains("f0") && !trigger.isBusy();
+    cout.rdbuf(saida);
+    cerr.rdbuf(erros);
+    cout << "[testeRollbackMultiThread] " << nThreads << " thread(s) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeTriggerPolicy() {
+    //Modelo aprendido das execuções: 10 ms fixos + 0,1 ms por linha
+    using Clock = TriggerPolicy::Clock;
+    LatencySLOTriggerPolicy politica(1000.0);
+    politica.onRunFinished(1000, 110.0);
+    politica.onRunFinished(5000, 510.0);
+    bool ok = abs(politica.predictRunMs(2000) - 210.0) < 1e-6;
+
+    //Pouca carga: um batch pequeno sai na hora
+    auto t0 = Clock::now();
+    politica.onArrival(10, t0);
+    TriggerState estado{10, 4, 4, t0, t0};
+    ok = ok && politica.shouldTrigger(estado);
+
+    //Muita carga (100 linhas/ms): o batch alvo cresce e só o prazo força o disparo de 1000 linhas
+    for (int ms = 1; ms <= 2000; ms++) {
+        politica.onArrival(100, t0 + chrono::milliseconds(ms));
+    }
+    auto agora = t0 + chrono::milliseconds(2000);
+    ok = ok && politica.targetBatchRows(4, agora) > 5000;
+    TriggerState cheio{1000, 4, 4, agora, agora};
+    ok = ok && !politica.shouldTrigger(cheio);
+    cheio.now = agora + chrono::milliseconds(800);
+    ok = ok && politica.shouldTrigger(cheio);
+    cheio.freeInstances = 0;
+    ok = ok && !politica.shouldTrigger(cheio);
+
+    //Critério original
+    SizeTriggerPolicy tamanho(100);
+    ok = ok && !tamanho.shouldTrigger(TriggerState{100, 1, 1, t0, t0}) && tamanho.shouldTrigger(TriggerState{101, 1, 1, t0, t0});
+
+    cout << "[testeTriggerPolicy] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+struct MensagemTeste {
+    string idValor;
+    double valorValor;
+    long tsValor;
+    const string& id() const { return idValor; }
+    double valor() const { return valorValor; }
+    long ts() const { return tsValor; }
+};
+
+void testeColumnDecoder() {
+    //Mensagens decodificadas direto nas colunas e batches concatenados coluna a coluna
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<double>("valor");
+    schema.addColumn<long long int>("ts");
+
+    ColumnDecoder<Field<&MensagemTeste::id>, Field<&MensagemTeste::valor>, Field<&MensagemTeste::ts, long long int>> decoder(schema);
+    decoder.append(MensagemTeste{"a", 1.5, 10});
+    decoder.append(MensagemTeste{"b", 2.5, 20});
+    auto primeiro = decoder.flush();
+    decoder.append(MensagemTeste{"c", 3.5, 30});
+    auto segundo = decoder.flush();
+
+    bool ok = primeiro->size() == 2 && segundo->size() == 1 && decoder.empty()
+              && primeiro->getHeader() == schema.getHeader();
+    primeiro->append(*segundo);
+    ok = ok && primeiro->size() == 3 && primeiro->getColumnData<string>(0)[2] == "c"
+            && primeiro->getColumnData<long long int>(2)[1] == 20 && primeiro->getRow(2)[1] == segundo->getRow(0)[1];
+
+    //Schema com tipos diferentes é recusado sem alterar o DataFrame
+    auto outro = std::make_shared<DataFrame>();
+    outro->addColumn<string>("id");
+    outro->addColumn<int>("valor");
+    outro->addColumn<long long int>("ts");
+    bool recusado = false;
+    try { primeiro->append(*outro); } catch (const std::invalid_argument&) { recusado = true; }
+    ok = ok && recusado && primeiro->size() == 3;
+
+    cout << "[testeColumnDecoder] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeCachedSource(int nThreads = 4) {
+    //Fonte em cache só é relida quando o arquivo muda
+    string arquivo = "data/teste_cache.csv";
+    {
+        ofstream out(arquivo, ios::trunc);
+        out << "id,valor\n" << "a,1\n" << "b,2\n";
+    }
+    auto modelo = std::make_shared<DataFrame>();
+    modelo->addColumn<string>("id");
+    modelo->addColumn<int>("valor");
+
+    auto e = std::make_shared<ExtractorFile>();
+    e->addRepo(new FileRepository(arquivo, ",", true));
+    e->addOutput(modelo);
+    e->setTaskName("e");
+    e->cacheSource("id");
+
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+
+    trigger.start(nThreads);
+    auto primeira = e->getOutputs().at(0);
+    auto indice = primeira->getKeyIndex("id");
+    bool ok = primeira->size() == 2 && indice && indice->findRow("b") == 1 && indice->findRow("z") == indice->npos;
+
+    trigger.start(nThreads);
+    ok = ok && e->getOutputs().at(0) == primeira;
+
+    {
+        ofstream out(arquivo, ios::app);
+        out << "c,3\n";
+    }
+    trigger.start(nThreads);
+    auto recarregado = e->getOutputs().at(0);
+    ok = ok && recarregado != primeira && recarregado->size() == 3
+            && recarregado->getKeyIndex("id")->findRow("c") == 2;
+
+    remove(arquivo.c_str());
+    cout << "[testeCachedSource] " << nThreads << " thread(s) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Segura a execução da pipeline até o teste liberar
+class BloqueioTransformer : public Transformer {
+public:
+    explicit BloqueioTransformer(std::atomic<bool>& liberado): liberado(liberado) {};
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        while (!liberado.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+private:
+    std::atomic<bool>& liberado;
+};
+
+// Espera até condicao() ou 2 s
+template <typename Condicao>
+bool esperar(Condicao condicao) {
+    auto limite = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!condicao()) {
+        if (std::chrono::steady_clock::now() > limite) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void testeBackpressure() {
+    //Pipeline de uma instância presa na primeira execução: os batches seguintes ficam pendentes
+    DataFrame schema;
+    schema.addColumn<int>("id");
+    auto lote = [&schema](int linhas) {
+        auto df = schema.emptyCopy();
+        for (int i = 0; i < linhas; i++) df->addRow(vector<any>{i});
+        return df;
+    };
+
+    std::atomic<bool> liberado{false};
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(schema.emptyCopy());
+    e->setTaskName("e");
+    e->blockParallel();
+    auto t = std::make_shared<BloqueioTransformer>(liberado);
+    t->setTaskName("bloqueio");
+    e->addNext(t, {1});
+    ServerTrigger trigger;
+    trigger.addExtractor(e);
+
+    PipelineManager manager(trigger, schema, 1, 1);
+    manager.setIngestLimits(10, 20, 40);
+    manager.start();
+
+    bool ok = manager.submitDataBatch(lote(10));
+    ok = ok && esperar([&] { return trigger.isBusy() && manager.getIngestStats().pendingRows == 0; });
+
+    //Pausa ao atingir 20 pendentes, descarta o que passaria de 40
+    ok = ok && manager.submitDataBatch(lote(10)) && manager.isAccepting();
+    ok = ok && manager.submitDataBatch(lote(10)) && !manager.isAccepting();
+    ok = ok && manager.submitDataBatch(lote(10));
+    ok = ok && !manager.submitDataBatch(lote(20));
+    std::atomic<bool> retomado{false};
+    manager.whenAccepting([&retomado] { retomado = true; });
+    ok = ok && !retomado.load();
+
+    //Liberada a pipeline, as 30 pendentes são entregues e os produtores retomam
+    liberado = true;
+    ok = ok && esperar([&] { return retomado.load(); }) && manager.isAccepting();
+    manager.stop();
+
+    auto stats = manager.getIngestStats();
+    ok = ok && stats.pendingRows == 0 && stats.peakPendingRows == 30 && stats.pauses == 1
+            && stats.droppedBatches == 1 && stats.droppedRows == 20 && stats.pausedMs > 0.0;
+    cout << "[testeBackpressure] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Guarda as chaves de cada batch que a pipeline recebeu
+class ColetaTransformer : public Transformer {
+public:
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto& ids = inputs[0].second->getColumnData<string>(0);
+        for (int r : inputs[0].first) chaves.push_back(ids[r]);
+    }
+    std::vector<string> getChaves() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return chaves;
+    }
+private:
+    std::mutex mtx;
+    std::vector<string> chaves;
+};
+
+void testeShardedPipelineManager(int nShards = 3) {
+    //Cada chave vai sempre para o mesmo shard, e nenhuma linha se perde na divisão
+    DataFrame schema;
+    schema.addColumn<string>("usuario");
+    schema.addColumn<int>("valor");
+
+    std::vector<std::shared_ptr<ColetaTransformer>> coletas;
+    std::vector<ServerTrigger*> triggers;
+    std::vector<PipelineManager*> shards;
+    for (int s = 0; s < nShards; s++) {
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(schema.emptyCopy());
+        e->setTaskName("e");
+        e->blockParallel();
+        auto t = std::make_shared<ColetaTransformer>();
+        t->setTaskName("coleta");
+        e->addNext(t, {1});
+        triggers.push_back(new ServerTrigger());
+        triggers.back()->addExtractor(e);
+        coletas.push_back(t);
+        shards.push_back(new PipelineManager(*triggers.back(), schema, 1, 1));
+    }
+    ShardedPipelineManager manager(shards, "usuario");
+    manager.start();
+
+    int total = 0;
+    for (int lote = 0; lote < 5; lote++) {
+        auto df = schema.emptyCopy();
+        for (int i = 0; i < 40; i++) df->addRow(vector<any>{"u" + to_string((lote * 7 + i) % 25), i});
+        total += df->size();
+        manager.submitDataBatch(df);
+    }
+    bool ok = esperar([&] {
+        size_t recebidas = 0;
+        for (auto& c : coletas) recebidas += c->getChaves().size();
+        return recebidas == static_cast<size_t>(total);
+    });
+    manager.stop();
+
+    for (int s = 0; s < nShards; s++) {
+        for (const string& chave : coletas[s]->getChaves()) {
+            ok = ok && manager.shardOf(chave) == static_cast<size_t>(s);
+        }
+    }
+
+    //Divisão de um DataFrame por linhas
+    auto origem = schema.emptyCopy();
+    origem->addRow(vector<any>{string("a"), 1});
+    origem->addRow(vector<any>{string("b"), 2});
+    origem->addRow(vector<any>{string("c"), 3});
+    auto parte = schema.emptyCopy();
+    parte->append(*origem, {2, 0});
+    ok = ok && parte->size() == 2 && parte->getColumnData<string>(0)[0] == "c" && parte->getColumnData<int>(1)[1] == 1;
+
+    for (ServerTrigger* trigger : triggers) delete trigger;
+    cout << "[testeShardedPipelineManager] " << nShards << " shard(s) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeMpscRing(int nProdutores = 8, int porProdutor = 100000) {
+    //Todos os valores chegam uma vez, na ordem de cada produtor, com a fila enchendo várias vezes
+    MpscRing<long long> fila(64);
+    std::vector<std::thread> produtores;
+    for (int p = 0; p < nProdutores; p++) {
+        produtores.emplace_back([&fila, p, porProdutor] {
+            for (int i = 0; i < porProdutor; i++) {
+                long long v = static_cast<long long>(p) * porProdutor + i;
+                while (!fila.tryPush(std::move(v))) std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<int> proximo(nProdutores, 0);
+    bool ok = true;
+    long long v;
+    for (long long recebidos = 0; recebidos < static_cast<long long>(nProdutores) * porProdutor; ) {
+        if (!fila.tryPop(v)) { std::this_thread::yield(); continue; }
+        int p = static_cast<int>(v / porProdutor);
+        ok = ok && v % porProdutor == proximo[p]++;
+        recebidos++;
+    }
+    for (auto& t : produtores) t.join();
+    ok = ok && !fila.tryPop(v) && fila.capacity() == 64;
+    cout << "[testeMpscRing] " << nProdutores << " produtor(es) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Fila de entrada como era no PipelineManager: mutex + std::queue + condition_variable
+class FilaComMutex {
+public:
+    void push(long long v) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            fila.push(v);
+        }
+        cv.notify_one();
+    }
+    bool pop(long long& v) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (fila.empty()) return false;
+        v = fila.front();
+        fila.pop();
+        return true;
+    }
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::queue<long long> fila;
+};
+
+// Microbenchmark do lado dos produtores: ns por submit com nProdutores submetendo ao mesmo tempo.
+// push recebe valores distintos de 0 a nProdutores * porProdutor - 1.
+template <typename Push>
+double medirProdutores(int nProdutores, int porProdutor, Push push) {
+    std::atomic<bool> largada{false};
+    std::vector<std::thread> produtores;
+    for (int p = 0; p < nProdutores; p++) {
+        produtores.emplace_back([&, p] {
+            while (!largada.load()) std::this_thread::yield();
+            for (int i = 0; i < porProdutor; i++) push(static_cast<long long>(p) * porProdutor + i);
+        });
+    }
+    auto inicio = std::chrono::high_resolution_clock::now();
+    largada = true;
+    for (auto& t : produtores) t.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - inicio;
+    return elapsed.count() / (static_cast<double>(nProdutores) * porProdutor);
+}
+
+// Filas que comportam todos os valores, então só a disputa entre produtores entra na medida;
+// o consumidor esvazia a fila depois (-1 se faltou algum valor)
+template <typename Push, typename Pop>
+double medirSubmit(int nProdutores, int porProdutor, Push push, Pop pop) {
+    double ns = medirProdutores(nProdutores, porProdutor, push);
+    long long v;
+    long long recebidos = 0;
+    while (pop(v)) recebidos++;
+    if (recebidos != static_cast<long long>(nProdutores) * porProdutor) return -1.0;
+    return ns;
+}
+
+void benchSubmit(int total = 200000) {
+    //Produtores: anel e fila com mutex sozinhos, e o submitDataBatch inteiro (reserva das pendentes,
+    //anel e aviso à worker_thread), que consome os batches ao mesmo tempo
+    DataFrame schema;
+    schema.addColumn<int>("id");
+    cout << "[benchSubmit] " << std::thread::hardware_concurrency() << " núcleo(s)" << endl;
+    for (int nProdutores : {1, 4, 16, 64}) {
+        MpscRing<long long> anel(total);
+        double nsAnel = medirSubmit(nProdutores, total / nProdutores,
+            [&anel](long long v) { anel.tryPush(std::move(v)); },
+            [&anel](long long& v) { return anel.tryPop(v); });
+        FilaComMutex fila;
+        double nsMutex = medirSubmit(nProdutores, total / nProdutores,
+            [&fila](long long v) { fila.push(v); },
+            [&fila](long long& v) { return fila.pop(v); });
+
+        //Batches de uma linha montados antes; a pipeline nunca dispara (critério acima do total)
+        std::vector<std::shared_ptr<DataFrame>> lotes(total);
+        for (int i = 0; i < total; i++) {
+            lotes[i] = schema.emptyCopy();
+            lotes[i]->addRow(vector<any>{i});
+        }
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(schema.emptyCopy());
+        e->setTaskName("e");
+        ServerTrigger trigger;
+        trigger.addExtractor(e);
+        std::streambuf* saida = cout.rdbuf(nullptr); // a worker_thread imprime cada batch
+        PipelineManager manager(trigger, schema, 1, total + 1);
+        manager.setIngestLimits(0, 0, 4 * static_cast<size_t>(total));
+        manager.start();
+        double nsManager = medirProdutores(nProdutores, total / nProdutores,
+            [&](long long v) { manager.submitDataBatch(lotes[v]); });
+        manager.stop();
+        cout.rdbuf(saida);
+        auto stats = manager.getIngestStats();
+        bool ok = stats.droppedBatches == 0 && stats.pendingRows == static_cast<size_t>(total / nProdutores * nProdutores);
+        cout << "[benchSubmit] " << nProdutores << " produtor(es): MpscRing " << nsAnel
+             << " ns/submit | mutex " << nsMutex << " ns/submit | submitDataBatch " << nsManager
+             << " ns/submit (" << stats.ingressFullWaits << " esperas com a fila cheia) - " << (ok ? "OK" : "FALHOU") << endl;
+    }
+}
+
+void testeIngestLog() {
+    //Batches não confirmados voltam depois de uma "queda"; confirmados e registros cortados não
+    string dir = "data/teste_wal";
+    std::filesystem::remove_all(dir);
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<double>("valor");
+    schema.addColumn<long long int>("ts");
+    auto lote = [&schema](int inicio, int linhas) {
+        auto df = schema.emptyCopy();
+        for (int i = inicio; i < inicio + linhas; i++) df->addRow(vector<any>{"t" + to_string(i), i * 1.5, 1000LL + i});
+        return df;
+    };
+    IngestLog::Options opcoes;
+    opcoes.segmentBytes = 256; // um segmento por escrita
+    opcoes.groupCommit = std::chrono::milliseconds(1);
+
+    bool ok = true;
+    {
+        IngestLog log(dir, opcoes);
+        ok = ok && log.recover(schema).empty();
+        log.start();
+        uint64_t s1 = log.append(*lote(0, 10));
+        log.flush();
+        log.append(*lote(10, 5));
+        log.append(*lote(15, 1));
+        log.acknowledge({s1});
+        log.flush();
+        log.flush(); // mais uma volta: o checkpoint e a remoção do segmento confirmado acontecem depois da escrita
+        ok = ok && log.getStats().records == 3 && log.getStats().acknowledged == s1;
+    }
+    //Queda no meio de uma escrita: lixo no fim do último segmento
+    std::vector<std::string> segmentos;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ".wal") segmentos.push_back(entry.path().string());
+    }
+    std::sort(segmentos.begin(), segmentos.end());
+    {
+        std::ofstream out(segmentos.back(), std::ios::binary | std::ios::app);
+        out << string(24, 'x');
+    }
+    {
+        IngestLog log(dir, opcoes);
+        auto pendentes = log.recover(schema);
+        ok = ok && pendentes.size() == 2 && pendentes[0]->size() == 5 && pendentes[1]->size() == 1
+                && pendentes[0]->getColumnData<string>(0)[0] == "t10" && pendentes[1]->getColumnData<long long int>(2)[0] == 1015
+                && pendentes[0]->getColumnData<double>(1)[4] == 14 * 1.5;
+        log.start();
+        std::vector<uint64_t> novas;
+        for (auto& batch : pendentes) novas.push_back(log.append(*batch));
+        log.discardRecovered();
+        log.acknowledge(novas);
+        log.flush();
+        log.flush();
+    }
+    {
+        IngestLog log(dir, opcoes);
+        ok = ok && log.recover(schema).empty();
+    }
+
+    //PipelineManager confirma os batches quando a execução termina
+    std::filesystem::remove_all(dir);
+    {
+        IngestLog log(dir, opcoes);
+        log.recover(schema);
+        log.start();
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(schema.emptyCopy());
+        e->setTaskName("e");
+        e->blockParallel();
+        auto t = std::make_shared<ColetaTransformer>();
+        t->setTaskName("coleta");
+        e->addNext(t, {1});
+        ServerTrigger trigger;
+        trigger.addExtractor(e);
+        PipelineManager manager(trigger, schema, 1, 1);
+        manager.setIngestLog(&log);
+        manager.start();
+        manager.submitDataBatch(lote(0, 3));
+        manager.submitDataBatch(lote(3, 4));
+        ok = ok && esperar([&] { return log.getStats().acknowledged == 2; }) && t->getChaves().size() == 7;
+        manager.stop();
+    }
+
+    //Execução que falha: seus batches não são confirmados e voltam na próxima inicialização, e quem
+    //espera pelas linhas é avisado
+    std::filesystem::remove_all(dir);
+    {
+        IngestLog log(dir, opcoes);
+        log.recover(schema);
+        log.start();
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(schema.emptyCopy());
+        e->setTaskName("e");
+        e->blockParallel();
+        auto estado = std::make_shared<StateStore<string, double>>();
+        auto t = std::make_shared<EstadoTransformer>(estado);
+        t->setTaskName("estado");
+        e->addNext(t, {1});
+        ServerTrigger trigger;
+        trigger.addExtractor(e);
+        trigger.addStateStore(estado);
+        PipelineManager manager(trigger, schema, 1, 1);
+        manager.setIngestLog(&log);
+        std::atomic<size_t> linhasFalhas{0};
+        manager.setOnRunFailed([&linhasFalhas](DataFrame& batch) { linhasFalhas += batch.size(); });
+        manager.start();
+        auto comFalha = lote(0, 3);
+        comFalha->addRow(vector<any>{string("falha"), 0.0, 0LL});
+        std::streambuf* erros = cerr.rdbuf(nullptr);
+        manager.submitDataBatch(comFalha);
+        ok = ok && esperar([&] { return manager.getIngestStats().pendingRows == 0 && !trigger.isBusy(); });
+        manager.submitDataBatch(lote(3, 2));
+        ok = ok && esperar([&] { return estado->contains("t4"); });
+        manager.stop();
+        cerr.rdbuf(erros);
+        ok = ok && !estado->contains("t0") && log.getStats().acknowledged == 0 && linhasFalhas.load() == 4;
+    }
+    {
+        IngestLog log(dir, opcoes);
+        auto pendentes = log.recover(schema);
+        ok = ok && pendentes.size() == 2 && pendentes[0]->size() == 4
+                && pendentes[0]->getColumnData<string>(0)[3] == "falha";
+    }
+
+    //Escrita que falha (limite de tamanho de arquivo): o batch não conta como gravado até ser escrito de novo
+    std::filesystem::remove_all(dir);
+    {
+        IngestLog log(dir, opcoes);
+        log.recover(schema);
+        log.start();
+        struct rlimit original;
+        getrlimit(RLIMIT_FSIZE, &original);
+        auto sinalAnterior = std::signal(SIGXFSZ, SIG_IGN);
+        struct rlimit pequeno = original;
+        pequeno.rlim_cur = 64;
+        setrlimit(RLIMIT_FSIZE, &pequeno);
+        log.append(*lote(0, 10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ok = ok && log.getStats().records == 0;
+        setrlimit(RLIMIT_FSIZE, &original);
+        std::signal(SIGXFSZ, sinalAnterior);
+        log.flush();
+        ok = ok && log.getStats().records == 1;
+    }
+    {
+        IngestLog log(dir, opcoes);
+        auto pendentes = log.recover(schema);
+        ok = ok && pendentes.size() == 1 && pendentes[0]->size() == 10;
+    }
+    std::filesystem::remove_all(dir);
+    cout << "[testeIngestLog] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Custo do log no caminho do submit: serializar e enfileirar um batch de 500 transações
+void benchIngestLog(int nBatches = 2000) {
+    string dir = "data/bench_wal";
+    std::filesystem::remove_all(dir);
+    DataFrame schema;
+    schema.addColumn<string>("id_transacao");
+    schema.addColumn<string>("id_usuario_pagador");
+    schema.addColumn<double>("valor_transacao");
+    schema.addColumn<long long int>("timestamp_envio");
+    auto batch = schema.emptyCopy();
+    for (int i = 0; i < 500; i++) {
+        batch->addRow(vector<any>{"3f2a9c1e-" + to_string(100000 + i), "usuario_" + to_string(i % 97), i * 3.25, 1700000000000LL + i});
+    }
+    double us, cpu;
+    IngestLog::Stats stats;
+    {
+        IngestLog log(dir);
+        log.recover(schema);
+        log.start();
+        //Tempo de CPU da thread que submete: numa máquina com poucos núcleos, o relógio de parede
+        //também conta a thread de escrita (CRC, cópia e write) rodando no mesmo núcleo
+        auto cpuMicros = [] {
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+        };
+        auto inicio = std::chrono::high_resolution_clock::now();
+        double inicioCpu = cpuMicros();
+        for (int b = 0; b < nBatches; b++) log.append(*batch);
+        cpu = (cpuMicros() - inicioCpu) / nBatches;
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - inicio;
+        us = elapsed.count() / nBatches;
+        log.flush();
+        stats = log.getStats();
+    }
+    std::filesystem::remove_all(dir);
+    cout << "[benchIngestLog] " << cpu << " us/batch de 500 linhas na thread do submit (" << us << " us de relógio); "
+         << stats.records << " registros em " << stats.syncs << " fdatasync(s)" << endl;
+}
+
+void testeDedupFilter(int nThreads = 4) {
+    bool ok = true;
+
+    //Básico, com tabelas pequenas que precisam crescer
+    DedupFilter::Options pequeno;
+    pequeno.expectedIds = 1000;
+    pequeno.numShards = 4;
+    DedupFilter filtro(pequeno);
+    ok = ok && filtro.insert("tx-1") && !filtro.insert("tx-1") && filtro.contains("tx-1") && !filtro.contains("tx-2");
+    for (int i = 0; i < 200000; i++) {
+        ok = ok && filtro.insert("id-" + to_string(i));
+    }
+    for (int i = 0; i < 200000; i += 7) {
+        ok = ok && !filtro.insert("id-" + to_string(i));
+    }
+    auto stats = filtro.getStats();
+    ok = ok && stats.size == 200001 && stats.duplicates == 1 + (200000 + 6) / 7;
+    //Remoção no meio das sequências de sondagem: os demais ids continuam sendo achados
+    for (int i = 0; i < 200000; i += 3) {
+        ok = ok && filtro.erase("id-" + to_string(i));
+    }
+    for (int i = 0; i < 200000; i++) {
+        ok = ok && filtro.contains("id-" + to_string(i)) == (i % 3 != 0);
+    }
+    ok = ok && !filtro.erase("id-0") && filtro.insert("id-0") && filtro.getStats().size == 200001 - (200000 + 2) / 3 + 1;
+
+    //Expiração: lembrado por pelo menos uma janela, esquecido depois de duas sem ser inserido de novo
+    DedupFilter::Options janela;
+    janela.window = std::chrono::seconds(10);
+    janela.numShards = 1;
+    DedupFilter comJanela(janela);
+    auto t0 = DedupFilter::Clock::now();
+    using std::chrono::seconds;
+    ok = ok && comJanela.insert("x", t0) && !comJanela.insert("x", t0 + seconds(5))
+            && !comJanela.insert("x", t0 + seconds(12)) // já na geração anterior
+            && comJanela.insert("x", t0 + seconds(25)); // expirou
+
+    //Várias threads inserindo os mesmos ids: cada id é aceito exatamente uma vez
+    DedupFilter compartilhado;
+    std::atomic<int> aceitos{0};
+    vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 100000; i++) {
+                int id = (i + t * 25000) % 100000;
+                if (compartilhado.insert("tx-" + to_string(id))) aceitos++;
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    ok = ok && aceitos.load() == 100000 && compartilhado.getStats().duplicates == (nThreads - 1) * 100000ULL;
+
+    cout << "[testeDedupFilter] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeDedupReenvio() {
+    //Como o servidor: o id entra no filtro ao chegar e sai dele se o batch for recusado
+    DataFrame schema;
+    schema.addColumn<string>("id_transacao");
+    DedupFilter filtro;
+    std::atomic<bool> liberado{false};
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(schema.emptyCopy());
+    e->setTaskName("e");
+    e->blockParallel();
+    auto bloqueio = std::make_shared<BloqueioTransformer>(liberado);
+    bloqueio->setTaskName("bloqueio");
+    auto coleta = std::make_shared<ColetaTransformer>();
+    coleta->setTaskName("coleta");
+    e->addNext(bloqueio, {1});
+    e->addNext(coleta, {1});
+    ServerTrigger trigger;
+    trigger.addExtractor(e);
+
+    PipelineManager manager(trigger, schema, 1, 1);
+    manager.setIngestLimits(10, 20, 40);
+    manager.start();
+
+    auto enviar = [&](const string& prefixo, int linhas) {
+        auto df = schema.emptyCopy();
+        for (int i = 0; i < linhas; i++) {
+            string id = prefixo + to_string(i);
+            if (filtro.insert(id)) df->addRow(vector<any>{id});
+        }
+        if (df->size() == 0) return true;
+        if (manager.submitDataBatch(df)) return true;
+        for (const string& id : df->getColumnData<string>(0)) filtro.erase(id);
+        return false;
+    };
+
+    bool ok = enviar("a", 10);
+    ok = ok && esperar([&] { return trigger.isBusy() && manager.getIngestStats().pendingRows == 0; });
+    ok = ok && enviar("b", 10) && enviar("c", 10) && enviar("d", 10);
+    //Passaria de 40 pendentes: recusado, e os ids não ficam marcados como vistos
+    ok = ok && !enviar("r", 20) && !filtro.contains("r0") && !filtro.contains("r19");
+
+    liberado = true;
+    ok = ok && esperar([&] { return manager.isAccepting() && manager.getIngestStats().pendingRows == 0; });
+    //O reenvio do batch recusado é processado; o de um batch aceito continua sendo filtrado
+    ok = ok && enviar("r", 20) && enviar("a", 10);
+    ok = ok && esperar([&] { return coleta->getChaves().size() == 60; });
+    manager.stop();
+
+    auto chaves = coleta->getChaves();
+    std::sort(chaves.begin(), chaves.end());
+    ok = ok && chaves.size() == 60 && std::adjacent_find(chaves.begin(), chaves.end()) == chaves.end()
+            && std::count_if(chaves.begin(), chaves.end(), [](const string& c) { return c[0] == 'r'; }) == 20;
+    ok = ok && manager.getIngestStats().droppedBatches == 1;
+
+    //Batch aceito cuja execução falha: os ids também saem do filtro, e o reenvio é processado
+    auto e2 = std::make_shared<ExtractorNoop>();
+    e2->addOutput(schema.emptyCopy());
+    e2->setTaskName("e2");
+    e2->blockParallel();
+    auto estado = std::make_shared<StateStore<string, double>>();
+    auto t2 = std::make_shared<EstadoTransformer>(estado);
+    t2->setTaskName("estado");
+    e2->addNext(t2, {1});
+    ServerTrigger trigger2;
+    trigger2.addExtractor(e2);
+    trigger2.addStateStore(estado);
+    PipelineManager manager2(trigger2, schema, 1, 1);
+    manager2.setOnRunFailed([&filtro](DataFrame& batch) {
+        for (const string& id : batch.getColumnData<string>(0)) filtro.erase(id);
+    });
+    manager2.start();
+    auto lote = [&](vector<string> ids) {
+        auto df = schema.emptyCopy();
+        for (const string& id : ids) {
+            if (filtro.insert(id)) df->addRow(vector<any>{id});
+        }
+        if (df->size() > 0) manager2.submitDataBatch(df);
+    };
+    std::streambuf* erros = cerr.rdbuf(nullptr);
+    lote({"x0", "x1", "falha"});
+    ok = ok && esperar([&] { return !filtro.contains("x0"); }) && !filtro.contains("falha");
+    lote({"x0", "x1"});
+    ok = ok && esperar([&] { return estado->contains("x1"); });
+    manager2.stop();
+    cerr.rdbuf(erros);
+    ok = ok && filtro.contains("x0") && estado->contains("x0");
+    cout << "[testeDedupReenvio] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Custo por transação do filtro com tabelas maiores que o cache (ids no formato de uuid4)
+void benchDedupFilter(int nIds = 4000000) {
+    vector<string> ids;
+    ids.reserve(nIds);
+    char buf[40];
+    for (int i = 0; i < nIds; i++) {
+        std::snprintf(buf, sizeof(buf), "%08x-9c1e-4b7a-8d2f-%012x", i * 2654435761u, i);
+        ids.emplace_back(buf);
+    }
+    DedupFilter::Options options;
+    options.expectedIds = nIds;
+    DedupFilter filtro(options);
+
+    auto inicio = std::chrono::high_resolution_clock::now();
+    size_t novos = 0;
+    for (const auto& id : ids) novos += filtro.insert(id);
+    std::chrono::duration<double, std::nano> inserir = std::chrono::high_resolution_clock::now() - inicio;
+
+    inicio = std::chrono::high_resolution_clock::now();
+    size_t repetidos = 0;
+    for (const auto& id : ids) repetidos += !filtro.insert(id);
+    std::chrono::duration<double, std::nano> repetir = std::chrono::high_resolution_clock::now() - inicio;
+
+    auto stats = filtro.getStats();
+    cout << "[benchDedupFilter] " << nIds << " ids: " << inserir.count() / nIds << " ns/id novo, "
+         << repetir.count() / nIds << " ns/id repetido, " << stats.memoryBytes / (1 << 20) << " MB - "
+         << (novos == ids.size() && repetidos == ids.size() ? "OK" : "FALHOU") << endl;
+}
+
+// Copia as linhas recebidas para a saída (cada thread a sua parte)
+class CopiaTransformer : public Transformer {
+public:
+    explicit CopiaTransformer(int esperaMs = 2): esperaMs(esperaMs) {};
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        std::vector<size_t> linhas(inputs[0].first.begin(), inputs[0].first.end());
+        std::this_thread::sleep_for(std::chrono::milliseconds(esperaMs));
+        std::lock_guard<std::mutex> lock(mtx);
+        outputs[0]->append(*inputs[0].second, linhas);
+        chamadas++;
+    }
+    int getChamadas() const {return chamadas.load();}
+private:
+    int esperaMs;
+    std::mutex mtx;
+    std::atomic<int> chamadas{0};
+};
+
+void testeTrace(int nThreads = 3) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 1000; i++) entrada->addRow(vector<any>{"transacao-com-id-longo-" + to_string(i), i});
+
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(entrada);
+    e->setTaskName("e");
+    e->blockParallel();
+    auto copia = std::make_shared<CopiaTransformer>();
+    copia->addOutput(schema.emptyCopy());
+    copia->setTaskName("copia");
+    auto coleta = std::make_shared<ColetaTransformer>();
+    coleta->setTaskName("coleta");
+    e->addNext(copia, {1});
+    copia->addNext(coleta, {1});
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+
+    string dir = "data/teste_trace";
+    std::filesystem::remove_all(dir);
+    trigger.enableProfiling(dir);
+    bool ok = true;
+    for (int threads : {nThreads, 1}) {
+        e->addOutput(entrada);
+        trigger.start(threads);
+        auto trace = trigger.getLastTrace();
+        ok = ok && trace && trace->getSpans().size() == 3 && trace->totalMs() > 0.0;
+        if (!trace) break;
+        for (const auto& span : trace->getSpans()) {
+            ok = ok && span.ready <= span.start && span.start <= span.end;
+            for (auto fim : span.threadEnds) ok = ok && span.start <= fim && fim <= span.end;
+            if (span.task == "copia") {
+                ok = ok && span.rowsIn == 1000 && span.rowsOut == 1000 && span.bytesOut > 1000 * sizeof(string)
+                        && !span.threadEnds.empty() && (threads > 1 || span.threadEnds.size() == 1);
+            }
+        }
+        string arquivo = dir + "/trace-" + to_string(trace->getRunId()) + ".json";
+        std::ifstream in(arquivo);
+        string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        ok = ok && json.find("\"traceEvents\"") != string::npos && json.find("\"name\":\"copia\"") != string::npos;
+        if (threads > 1) cout << trace->summary();
+    }
+
+    //Desligada, a execução não gera trace
+    auto ultimo = trigger.getLastTrace();
+    trigger.disableProfiling();
+    e->addOutput(entrada);
+    trigger.start(nThreads);
+    ok = ok && trigger.getLastTrace() == ultimo;
+    std::filesystem::remove_all(dir);
+    cout << "[testeTrace] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeTaskProfile(int nThreads = 2) {
+    bool ok = true;
+
+    //Médias móveis: a primeira execução inicializa, as seguintes se aproximam com peso alpha
+    TaskProfile perfil(0.5);
+    double ms = 0.0;
+    ok = ok && !perfil.expectedMs("a", ms) && perfil.meanExpectedMs() == 0.0;
+    perfil.record("a", 10.0, 100, 1);  // 0.1 ms por linha
+    perfil.record("a", 20.0, 100, 2);  // 0.4 ms por linha (2 threads)
+    perfil.record("b", 5.0, 0, 1);     // sem linhas: conta como 1
+    ok = ok && perfil.expectedMs("a", ms) && std::abs(ms - 25.0) < 1e-9;
+    ok = ok && perfil.expectedMs("b", ms) && std::abs(ms - 5.0) < 1e-9;
+    ok = ok && std::abs(perfil.meanExpectedMs() - 15.0) < 1e-9;
+    //Tasks sem nome (ou com espaço no nome) não são medidas: não se misturam nem quebram o arquivo
+    std::streambuf* erros = cerr.rdbuf(nullptr);
+    perfil.record("", 50.0, 10, 1);
+    perfil.record("com espaco", 50.0, 10, 1);
+    cerr.rdbuf(erros);
+    ok = ok && perfil.getEntries().size() == 2 && !perfil.expectedMs("", ms);
+
+    //Salvo e carregado, o perfil é o mesmo
+    string arquivo = "data/teste_task_profile.txt";
+    perfil.save(arquivo);
+    TaskProfile carregado;
+    ok = ok && carregado.load(arquivo) && !carregado.load(arquivo + ".inexistente");
+    auto original = perfil.getEntries(), lido = carregado.getEntries();
+    ok = ok && original.size() == lido.size();
+    for (const auto& [nome, entrada] : original) {
+        ok = ok && lido.count(nome) && std::abs(lido[nome].msPerRow - entrada.msPerRow) < 1e-12
+                && std::abs(lido[nome].rows - entrada.rows) < 1e-12 && lido[nome].samples == entrada.samples;
+    }
+    std::filesystem::remove(arquivo);
+
+    //Com autosave, a thread de gravação escreve o perfil depois de um record
+    {
+        TaskProfile automatico;
+        automatico.autosave(arquivo, std::chrono::milliseconds(10));
+        automatico.record("a", 1.0, 10, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TaskProfile gravado;
+        ok = ok && gravado.load(arquivo) && gravado.getEntries().size() == 1;
+    }
+    std::filesystem::remove(arquivo);
+
+    //Pipeline com um ramo lento e um rápido: sem medidas os dois pesam igual, depois da primeira
+    //execução o lento passa a pesar mais
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 200; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(entrada);
+    e->setTaskName("e");
+    e->blockParallel();
+    auto lento = std::make_shared<CopiaTransformer>(20);
+    lento->addOutput(schema.emptyCopy());
+    lento->setTaskName("lento");
+    auto rapido = std::make_shared<CopiaTransformer>(0);
+    rapido->addOutput(schema.emptyCopy());
+    rapido->setTaskName("rapido");
+    auto coletaLento = std::make_shared<ColetaTransformer>();
+    coletaLento->setTaskName("coleta_lento");
+    auto coletaRapido = std::make_shared<ColetaTransformer>();
+    coletaRapido->setTaskName("coleta_rapido");
+    e->addNext(lento, {1});
+    e->addNext(rapido, {1});
+    lento->addNext(coletaLento, {1});
+    rapido->addNext(coletaRapido, {1});
+
+    auto aprendido = std::make_shared<TaskProfile>();
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+    trigger.setTaskProfile(aprendido);
+    e->addOutput(entrada);
+    trigger.start(nThreads);
+    auto pesos = trigger.getTaskWeights();
+    ok = ok && pesos.size() == 5 && pesos["lento"] == pesos["rapido"];
+    ok = ok && aprendido->getEntries().size() == 5 && aprendido->expectedMs("e", ms);
+    e->addOutput(entrada);
+    trigger.start(nThreads);
+    pesos = trigger.getTaskWeights();
+    ok = ok && pesos["lento"] > pesos["rapido"] && pesos["e"] > pesos["rapido"];
+
+    //Um trigger novo com o perfil salvo já começa calibrado
+    aprendido->save(arquivo);
+    auto recarregado = std::make_shared<TaskProfile>();
+    ok = ok && recarregado->load(arquivo);
+    RequestTrigger novo;
+    novo.addExtractor(e);
+    novo.setTaskProfile(recarregado);
+    e->addOutput(entrada);
+    novo.start(nThreads);
+    auto pesosNovo = novo.getTaskWeights();
+    ok = ok && pesosNovo["lento"] > pesosNovo["rapido"];
+    std::filesystem::remove(arquivo);
+
+    cout << "lento: " << pesos["lento"] << "  rapido: " << pesos["rapido"] << "  e: " << pesos["e"] << endl;
+    cout << "[testeTaskProfile] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeScheduler(int nThreads = 4) {
+    bool ok = true;
+
+    //Amdahl: 1 ms por linha com 1 thread e 0.325 com 4 -> 10% serial, t1 = 100 ms (100 linhas)
+    TaskProfile perfil(1.0);
+    perfil.record("a", 100.0, 100, 1);
+    perfil.record("a", 32.5, 100, 4);
+    ScalingModel modelo;
+    ok = ok && perfil.scalingModel("a", true, modelo);
+    ok = ok && std::abs(modelo.t1Ms - 100.0) < 1e-6 && std::abs(modelo.serialFraction - 0.1) < 1e-6;
+    ok = ok && std::abs(modelo.predictMs(2) - 55.0) < 1e-6;
+    //Task que não paraleliza é toda serial; medida uma vez, usa a fração serial padrão
+    ok = ok && perfil.scalingModel("a", false, modelo) && modelo.serialFraction == 1.0;
+    perfil.record("b", 10.0, 10, 2);
+    ok = ok && perfil.scalingModel("b", true, modelo)
+            && std::abs(modelo.serialFraction - TaskProfile::defaultSerialFraction) < 1e-9
+            && std::abs(modelo.predictMs(2) - 10.0) < 1e-9;
+    ok = ok && !perfil.scalingModel("c", true, modelo);
+
+    //A (paralela, 80 ms) e C (serial, 20 ms) antes de D (serial, 10 ms), com 4 threads: dar as 4
+    //threads a A faria C esperar; o plano dá 3 a A e roda C ao mesmo tempo
+    std::vector<ScheduleTask> dag(3);
+    dag[0].name = "A"; dag[0].parallel = true;  dag[0].model = {80.0, 0.0}; dag[0].next = {2};
+    dag[1].name = "C"; dag[1].parallel = false; dag[1].model = {20.0, 1.0}; dag[1].next = {2};
+    dag[2].name = "D"; dag[2].parallel = false; dag[2].model = {10.0, 1.0};
+    SchedulePlan plano = planCriticalPath(dag, 4);
+    ok = ok && plano.threads == std::vector<int>({3, 1, 1}) && std::abs(plano.criticalPathMs - (80.0 / 3 + 10.0)) < 1e-9;
+    auto cp = simulateSchedule(dag, 4, SchedulingPolicy::CriticalPath);
+    auto pesos = simulateSchedule(dag, 4, SchedulingPolicy::Weights);
+    ok = ok && std::abs(cp.makespanMs - (80.0 / 3 + 10.0)) < 1e-9 && std::abs(pesos.makespanMs - 50.0) < 1e-9;
+    ok = ok && cp.startMs[2] >= cp.endMs[0] && cp.startMs[2] >= cp.endMs[1];
+    //Com uma thread, tudo em sequência
+    ok = ok && std::abs(simulateSchedule(dag, 1, SchedulingPolicy::CriticalPath).makespanMs - 110.0) < 1e-9;
+
+    //Pipeline executada pela política CriticalPath
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 400; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(entrada);
+    e->setTaskName("e");
+    e->blockParallel();
+    auto lento = std::make_shared<CopiaTransformer>(10);
+    lento->addOutput(schema.emptyCopy());
+    lento->setTaskName("lento");
+    lento->setMaxThreadsProportion(1.0);
+    auto rapido = std::make_shared<CopiaTransformer>(0);
+    rapido->addOutput(schema.emptyCopy());
+    rapido->setTaskName("rapido");
+    rapido->blockParallel();
+    auto coletaLento = std::make_shared<ColetaTransformer>();
+    coletaLento->setTaskName("coleta_lento");
+    auto coletaRapido = std::make_shared<ColetaTransformer>();
+    coletaRapido->setTaskName("coleta_rapido");
+    e->addNext(lento, {1});
+    e->addNext(rapido, {1});
+    lento->addNext(coletaLento, {1});
+    rapido->addNext(coletaRapido, {1});
+
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+    trigger.setTaskProfile(std::make_shared<TaskProfile>());
+    trigger.setSchedulingPolicy(SchedulingPolicy::CriticalPath);
+    for (int execucao = 0; execucao < 3; execucao++) {
+        e->addOutput(entrada);
+        trigger.start(nThreads);
+    }
+    ok = ok && coletaLento->getChaves().size() == 3 * 400 && coletaRapido->getChaves().size() == 3 * 400;
+    auto threads = trigger.getPlannedThreads();
+    ok = ok && threads.size() == 5 && threads["e"] == 1 && threads["rapido"] == 1 && threads["lento"] >= 1;
+
+    auto simCp = trigger.simulate(nThreads, SchedulingPolicy::CriticalPath);
+    auto simPesos = trigger.simulate(nThreads, SchedulingPolicy::Weights);
+    ok = ok && simCp.tasks.size() == 5 && simCp.makespanMs > 0.0 && simCp.makespanMs <= simPesos.makespanMs + 1e-9;
+
+    cout << "makespan simulado: CriticalPath " << simCp.makespanMs << " ms | Weights " << simPesos.makespanMs
+         << " ms | threads de lento: " << threads["lento"] << endl;
+    cout << "[testeScheduler] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeCompletionQueue(int nProdutores = 8) {
+    //Capacidade menor que o total de eventos: os produtores também esperam o consumidor liberar espaço
+    const int porProdutor = 20000;
+    CompletionQueue fila(nProdutores);
+    std::vector<std::thread> produtores;
+    for (int p = 0; p < nProdutores; p++) {
+        produtores.emplace_back([&fila, p] {
+            for (int i = 0; i < porProdutor; i++) fila.push(p, i);
+        });
+    }
+    //Cada produtor publica em ordem, então os slots de um mesmo grupo chegam em ordem
+    std::vector<int> proximo(nProdutores, 0);
+    bool ok = true;
+    for (int i = 0; i < nProdutores * porProdutor; i++) {
+        CompletionQueue::Event evento = fila.pop();
+        ok = ok && evento.group < static_cast<uint32_t>(nProdutores) && static_cast<int>(evento.slot) == proximo[evento.group];
+        if (evento.group < static_cast<uint32_t>(nProdutores)) proximo[evento.group]++;
+    }
+    for (auto& t : produtores) t.join();
+    CompletionQueue::Event sobra;
+    ok = ok && !fila.tryPop(sobra);
+    fila.push(7, 3);
+    ok = ok && fila.tryPop(sobra) && sobra.group == 7 && sobra.slot == 3 && !fila.tryPop(sobra);
+    cout << "[testeCompletionQueue] " << nProdutores << " produtor(es) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+//Custo do orquestrador: muitas tasks quase sem trabalho, de forma que o tempo é dominado pelo
+//disparo das threads e pelo tratamento dos términos
+void benchOrquestrador(int nThreads = 8, int execucoes = 200) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 64; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(entrada);
+    e->setTaskName("e");
+    e->blockParallel();
+    std::vector<std::shared_ptr<ColetaTransformer>> coletas;
+    for (int i = 0; i < 16; i++) {
+        auto copia = std::make_shared<CopiaTransformer>(0);
+        copia->addOutput(schema.emptyCopy());
+        copia->setTaskName("copia" + to_string(i));
+        copia->setMaxThreadsProportion(0.25);
+        auto coleta = std::make_shared<ColetaTransformer>();
+        coleta->setTaskName("coleta" + to_string(i));
+        e->addNext(copia, {1});
+        copia->addNext(coleta, {1});
+        coletas.push_back(coleta);
+    }
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+
+    std::streambuf* saida = cout.rdbuf(nullptr); // o trigger imprime a cada execução
+    auto inicio = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < execucoes; i++) {
+        e->addOutput(entrada);
+        trigger.start(nThreads);
+    }
+    std::chrono::duration<double, std::milli> tempo = std::chrono::high_resolution_clock::now() - inicio;
+    cout.rdbuf(saida);
+    bool ok = true;
+    for (auto& coleta : coletas) ok = ok && coleta->getChaves().size() == static_cast<size_t>(64 * execucoes);
+    cout << "[benchOrquestrador] " << nThreads << " thread(s), 33 tasks: " << tempo.count() / execucoes
+         << " ms/execução - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Uma task longa dividida em partes roda ao lado de tasks curtas: as threads que sobram vão para ela
+// e voltam quando outra task fica pronta
+void testeElasticidade(int nThreads = 3) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 2000; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+    bool ok = true;
+
+    // Direto na task: threads extras entram no meio e são pedidas de volta
+    {
+        auto previa = std::make_shared<ExtractorNoop>();
+        previa->addOutput(entrada);
+        auto copia = std::make_shared<CopiaTransformer>(1);
+        copia->addOutput(schema.emptyCopy());
+        copia->setMorselRows(50);
+        previa->addNext(copia, {1});
+        previa->executeMonoThread();
+        CompletionQueue completions(8);
+        auto threads = copia->executeMultiThread(1, completions, 0);
+        ok = ok && copia->pendingMorsels() > 0;
+        auto extras = copia->addWorkers(3, completions, 0, 1);
+        ok = ok && extras.size() == 3;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        copia->releaseWorkers(3);
+        for (int i = 0; i < 4; i++) completions.pop();
+        for (auto& t : threads) t.join();
+        for (auto& t : extras) t.join();
+        ok = ok && copia->getOutputs()[0]->size() == 2000 && copia->pendingMorsels() == 0;
+        copia->finishExecution();
+        ok = ok && copia->pendingMorsels() == 0 && copia->addWorkers(1, completions, 0, 1).empty();
+
+        // Em uma thread só a entrada não é repartida: uma chamada de transform com as 2000 linhas
+        auto sequencial = std::make_shared<CopiaTransformer>(0);
+        sequencial->addOutput(schema.emptyCopy());
+        sequencial->setMorselRows(50);
+        previa->addNext(sequencial, {1});
+        previa->addOutput(entrada);
+        sequencial->executeMonoThread();
+        ok = ok && sequencial->getChamadas() == 1 && sequencial->getOutputs()[0]->size() == 2000;
+        sequencial->blockParallel();
+        sequencial->resetExecution();
+        threads = sequencial->executeMultiThread(4, completions, 0);
+        completions.pop();
+        for (auto& t : threads) t.join();
+        ok = ok && threads.size() == 1 && sequencial->getChamadas() == 2 && sequencial->getOutputs()[0]->size() == 2000;
+    }
+
+    // Pelo orquestrador: lento começa com 1 thread; quando rapido termina, a thread livre vai para ele,
+    // e quando curto libera depois1 e depois2 com uma thread só, a emprestada volta para depois2
+    double tempos[2];
+    for (int elastico = 1; elastico >= 0; elastico--) {
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(entrada);
+        e->setTaskName("e");
+        e->blockParallel();
+        auto lento = std::make_shared<CopiaTransformer>(5);
+        lento->addOutput(schema.emptyCopy());
+        lento->setTaskName("lento");
+        lento->setMorselRows(50);
+        lento->setMaxThreadsProportion(1.0);
+        auto rapido = std::make_shared<CopiaTransformer>(0);
+        rapido->addOutput(schema.emptyCopy());
+        rapido->setTaskName("rapido");
+        rapido->blockParallel();
+        rapido->setBaseWeight(10);
+        auto curto = std::make_shared<CopiaTransformer>(20);
+        curto->addOutput(schema.emptyCopy());
+        curto->setTaskName("curto");
+        curto->blockParallel();
+        curto->setBaseWeight(10);
+        std::vector<std::shared_ptr<CopiaTransformer>> depois;
+        for (int i = 1; i <= 2; i++) {
+            auto d = std::make_shared<CopiaTransformer>(20);
+            d->addOutput(schema.emptyCopy());
+            d->setTaskName("depois" + to_string(i));
+            d->blockParallel();
+            d->setBaseWeight(10);
+            curto->addNext(d, {1});
+            depois.push_back(d);
+        }
+        e->addNext(lento, {1});
+        e->addNext(rapido, {1});
+        e->addNext(curto, {1});
+
+        RequestTrigger trigger;
+        trigger.addExtractor(e);
+        trigger.enableProfiling();
+        trigger.setElasticThreads(elastico);
+        std::streambuf* saida = cout.rdbuf(nullptr);
+        auto inicio = std::chrono::high_resolution_clock::now();
+        trigger.start(nThreads);
+        std::chrono::duration<double, std::milli> tempo = std::chrono::high_resolution_clock::now() - inicio;
+        cout.rdbuf(saida);
+        tempos[elastico] = tempo.count();
+
+        // cada linha exatamente uma vez na saída da task longa
+        auto saidaLento = lento->getOutputs()[0];
+        std::set<string> ids(saidaLento->getColumnData<string>(0).begin(), saidaLento->getColumnData<string>(0).end());
+        ok = ok && saidaLento->size() == 2000 && ids.size() == 2000;
+        for (auto& d : depois) ok = ok && d->getOutputs()[0]->size() == 2000;
+
+        auto trace = trigger.getLastTrace();
+        const PipelineTrace::TaskSpan* spanLento = nullptr;
+        const PipelineTrace::TaskSpan* spanDepois2 = nullptr;
+        for (const auto& span : trace->getSpans()) {
+            if (span.task == "lento") spanLento = &span;
+            if (span.task == "depois2") spanDepois2 = &span;
+        }
+        ok = ok && spanLento && spanDepois2;
+        if (!ok) break;
+        if (elastico) {
+            // recebeu threads emprestadas e devolveu uma antes de terminar
+            ok = ok && spanLento->threadEnds.size() >= 2 && spanDepois2->start < spanLento->end;
+        } else {
+            ok = ok && spanLento->threadEnds.size() == 1;
+        }
+    }
+    cout << "[testeElasticidade] " << nThreads << " threads: " << tempos[0] << " ms sem empréstimo, "
+         << tempos[1] << " ms com - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Marca o início de cada execução e segura a pipeline por esperaMs (uma vez por execução)
+class MarcaExecucaoTransformer : public Transformer {
+public:
+    explicit MarcaExecucaoTransformer(int esperaMs): esperaMs(esperaMs) {};
+    void prepare(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            inicios.push_back(std::chrono::steady_clock::now());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(esperaMs));
+    }
+    std::vector<std::chrono::steady_clock::time_point> getInicios() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return inicios;
+    }
+private:
+    int esperaMs;
+    std::mutex mtx;
+    std::vector<std::chrono::steady_clock::time_point> inicios;
+};
+
+void testeTimerTrigger(int nThreads = 2) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 100; i++) entrada->addRow(vector<any>{"id-" + to_string(i)});
+    bool ok = true;
+    std::ostringstream resumo;
+
+    // execução de esperaMs a cada 20 ms, por 300 ms
+    auto executar = [&](int esperaMs, MissedTickPolicy policy, std::vector<std::chrono::steady_clock::time_point>& inicios) {
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(entrada);
+        e->setTaskName("e");
+        e->blockParallel();
+        auto marca = std::make_shared<MarcaExecucaoTransformer>(esperaMs);
+        marca->setTaskName("marca");
+        e->addNext(marca, {1});
+        TimerTrigger trigger(20, policy);
+        trigger.addExtractor(e);
+        std::streambuf* saida = cout.rdbuf(nullptr);
+        trigger.start(nThreads);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        trigger.stop();
+        cout.rdbuf(saida);
+        inicios = marca->getInicios();
+        return trigger.getStats();
+    };
+
+    // Sem atraso: uma execução a cada 20 ms, sem acumular os 8 ms de cada uma
+    std::vector<std::chrono::steady_clock::time_point> inicios;
+    TimerStats stats = executar(8, MissedTickPolicy::Skip, inicios);
+    ok = ok && stats.runs >= 13 && stats.runs <= 16 && stats.overruns == 0 && inicios.size() == stats.runs;
+    if (inicios.size() >= 2) {
+        std::chrono::duration<double, std::milli> desvio = inicios.back() - inicios.front()
+                                                           - static_cast<int>(inicios.size() - 1) * std::chrono::milliseconds(20);
+        ok = ok && std::abs(desvio.count()) < 10.0;
+        resumo << stats.runs << " execuções, desvio " << desvio.count() << " ms";
+    }
+
+    // Execuções de 30 ms: Skip espera o próximo horário da grade (uma a cada 40 ms) e Coalesce roda
+    // logo em seguida (uma a cada 30 ms)
+    TimerStats skip = executar(30, MissedTickPolicy::Skip, inicios);
+    TimerStats coalesce = executar(30, MissedTickPolicy::Coalesce, inicios);
+    ok = ok && skip.overruns > 0 && skip.missedTicks > 0 && skip.runs >= 6 && skip.runs <= 9;
+    ok = ok && coalesce.overruns > 0 && coalesce.runs > skip.runs && coalesce.missedTicks < skip.missedTicks;
+    resumo << "; atrasadas: Skip " << skip.runs << " execuções/" << skip.missedTicks << " perdidos, Coalesce "
+           << coalesce.runs << "/" << coalesce.missedTicks;
+
+    //Execução que lança exceção: é contada e os disparos continuam, sem derrubar o processo
+    {
+        auto comFalha = schema.emptyCopy();
+        comFalha->append(*entrada);
+        comFalha->addRow(vector<any>{string("falha")});
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(comFalha);
+        e->setTaskName("e");
+        e->blockParallel();
+        auto t = std::make_shared<EstadoTransformer>(std::make_shared<StateStore<string, double>>());
+        t->setTaskName("estado");
+        e->addNext(t, {1});
+        TimerTrigger trigger(20);
+        trigger.addExtractor(e);
+        std::streambuf* saida = cout.rdbuf(nullptr);
+        std::streambuf* erros = cerr.rdbuf(nullptr);
+        trigger.start(nThreads);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        trigger.stop();
+        cout.rdbuf(saida);
+        cerr.rdbuf(erros);
+        TimerStats falhas = trigger.getStats();
+        ok = ok && falhas.runs >= 3 && falhas.failed == falhas.runs && falhas.cancelled == 0;
+        resumo << "; " << falhas.failed << " execuções com erro";
+    }
+
+    cout << "[testeTimerTrigger] " << nThreads << " thread(s): " << resumo.str() << " - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeFileWatchTrigger(int nThreads = 2) {
+    //Cada arquivo que chega na pasta (escrito nela ou renomeado para ela) dispara uma execução
+    std::filesystem::path pasta = "data/teste_filewatch";
+    std::filesystem::remove_all(pasta);
+    std::filesystem::create_directories(pasta);
+    {
+        ofstream out(pasta / "inicial.csv");
+        out << "id,valor\n";
+    }
+    auto modelo = std::make_shared<DataFrame>();
+    modelo->addColumn<string>("id");
+    modelo->addColumn<int>("valor");
+    auto e = std::make_shared<ExtractorFile>();
+    e->addRepo(new FileRepository((pasta / "inicial.csv").string(), ",", true));
+    e->addOutput(modelo);
+    e->setTaskName("e");
+    auto coleta = std::make_shared<ColetaTransformer>();
+    coleta->setTaskName("coleta");
+    e->addNext(coleta, {1});
+
+    FileWatchTrigger trigger(pasta.string(), "lote*.csv", e);
+    trigger.addExtractor(e);
+    std::mutex mtx;
+    std::vector<string> arquivos;
+    std::vector<double> latencias;
+    trigger.setOnFile([&](const std::string& arquivo, double ms) {
+        std::lock_guard<std::mutex> lock(mtx);
+        arquivos.push_back(std::filesystem::path(arquivo).filename().string());
+        latencias.push_back(ms);
+    });
+    std::streambuf* saida = cout.rdbuf(nullptr);
+    trigger.start(nThreads);
+
+    // escrito fora do padrão e renomeado, escrito direto na pasta e um que não casa com o padrão
+    {
+        ofstream out(pasta / "tmp-lote1");
+        out << "id,valor\n" << "a,1\n" << "b,2\n";
+    }
+    std::filesystem::rename(pasta / "tmp-lote1", pasta / "lote1.csv");
+    bool ok = esperar([&] { return trigger.getRunCount() == 1; });
+    {
+        ofstream out(pasta / "outro.txt");
+        out << "id,valor\n" << "x,9\n";
+    }
+    {
+        ofstream out(pasta / "lote2.csv");
+        out << "id,valor\n" << "c,3\n";
+    }
+    ok = esperar([&] { return trigger.getRunCount() == 2; }) && ok;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    trigger.stop();
+    cout.rdbuf(saida);
+
+    auto chaves = coleta->getChaves();
+    ok = ok && trigger.getRunCount() == 2 && chaves == std::vector<string>{"a", "b", "c"};
+    ok = ok && arquivos == std::vector<string>{"lote1.csv", "lote2.csv"};
+    double maior = latencias.empty() ? 0.0 : *std::max_element(latencias.begin(), latencias.end());
+    std::filesystem::remove_all(pasta);
+    cout << "[testeFileWatchTrigger] " << nThreads << " thread(s): até " << maior << " ms do aviso do inotify ao fim da execução - "
+         << (ok ? "OK" : "FALHOU") << endl;
+}
+
+// Copia a entrada em blocos de 50 linhas, 5 ms por bloco, parando no bloco seguinte ao cancelamento
+class CopiaLentaTransformer : public Transformer {
+public:
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        const auto& indices = inputs[0].first;
+        for (size_t i = 0; i < indices.size() && !isCancelled(); i += 50) {
+            std::vector<size_t> linhas(indices.begin() + i, indices.begin() + std::min(i + 50, indices.size()));
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            std::lock_guard<std::mutex> lock(mtx);
+            outputs[0]->append(*inputs[0].second, linhas);
+        }
+    }
+private:
+    std::mutex mtx;
+};
+
+// Espera até esperaMs em passos de 1 ms, parando cedo se a execução for cancelada
+class EsperaCancelavelTransformer : public Transformer {
+public:
+    explicit EsperaCancelavelTransformer(int esperaMs): esperaMs(esperaMs) {};
+    void transform(std::vector<std::shared_ptr<DataFrame>>& outputs, const std::vector<DataFrameWithIndexes>& inputs) override {
+        for (int i = 0; i < esperaMs && !isCancelled(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+private:
+    int esperaMs;
+};
+
+void testeCancelamento(int nThreads = 2) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 2000; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+
+    // e -> lento (40 blocos de 5 ms) -> coleta
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(entrada);
+    e->setTaskName("e");
+    e->blockParallel();
+    auto lento = std::make_shared<CopiaLentaTransformer>();
+    lento->addOutput(schema.emptyCopy());
+    lento->setTaskName("lento");
+    lento->setMorselRows(50);
+    lento->setMaxThreadsProportion(1.0);
+    auto coleta = std::make_shared<ColetaTransformer>();
+    coleta->setTaskName("coleta");
+    e->addNext(lento, {1});
+    lento->addNext(coleta, {1});
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+    auto e2 = std::make_shared<ExtractorNoop>();
+    e2->setTaskName("e2");
+    e2->blockParallel();
+
+    // Executa e devolve o motivo do cancelamento ("" se terminou) e o tempo
+    auto executar = [&](RequestTrigger& t, int threads, double& ms) {
+        std::string motivo;
+        e->addOutput(entrada); // o batch do ExtractorNoop é consumido a cada execução completa
+        e2->addOutput(entrada);
+        std::streambuf* saida = cout.rdbuf(nullptr);
+        auto inicio = std::chrono::high_resolution_clock::now();
+        try {
+            t.start(threads);
+        } catch (const PipelineCancelled& cancelada) {
+            motivo = cancelada.what();
+        }
+        ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - inicio).count();
+        cout.rdbuf(saida);
+        return motivo;
+    };
+    bool ok = true;
+    double ms = 0.0, msCompleto = 0.0;
+
+    // Prazo da execução: para no bloco seguinte, sem chegar à coleta
+    trigger.setRunDeadline(std::chrono::milliseconds(30));
+    std::string motivo = executar(trigger, nThreads, ms);
+    ok = ok && motivo == "prazo vencido" && ms < 60.0 && coleta->getChaves().empty();
+    double msPrazo = ms;
+
+    // A execução seguinte começa do zero: nada da cancelada sobra nas saídas
+    trigger.setRunDeadline(std::chrono::milliseconds(0));
+    ok = ok && executar(trigger, nThreads, msCompleto).empty() && coleta->getChaves().size() == 2000;
+
+    // Prazo da task
+    lento->setDeadline(std::chrono::milliseconds(20));
+    ok = ok && executar(trigger, nThreads, ms) == "task lento: prazo vencido" && ms < 50.0
+            && coleta->getChaves().size() == 2000;
+    lento->setDeadline(std::chrono::milliseconds(0));
+
+    // cancel() de outra thread, com um transform que consulta a token
+    auto espera = std::make_shared<EsperaCancelavelTransformer>(1000);
+    espera->setTaskName("espera");
+    e2->addNext(espera, {1});
+    RequestTrigger trigger2;
+    trigger2.addExtractor(e2);
+    for (int threads : {1, nThreads}) {
+        std::thread canceladora([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            trigger2.cancel("batch descartado");
+        });
+        motivo = executar(trigger2, threads, ms);
+        canceladora.join();
+        ok = ok && motivo == "batch descartado" && ms < 200.0;
+    }
+
+    ok = ok && executar(trigger, nThreads, ms).empty() && coleta->getChaves().size() == 4000;
+    cout << "[testeCancelamento] " << nThreads << " thread(s): cancelada em " << msPrazo << " ms (completa: "
+         << msCompleto << " ms) - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeMemoizacao(int nThreads = 2) {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto lote = [&](const std::string& versao, const std::string& primeiroId) {
+        auto df = schema.emptyCopy();
+        for (int i = 0; i < 2000; i++) df->addRow(vector<any>{i == 0 ? primeiroId : "id-" + to_string(i), i});
+        df->setVersion(versao);
+        return df;
+    };
+
+    // e -> copia (10 partes de 2 ms) -> copia2 -> coleta; só as cópias têm memoização
+    auto e = std::make_shared<ExtractorNoop>();
+    e->addOutput(schema.emptyCopy());
+    e->setTaskName("e");
+    e->blockParallel();
+    auto copia = std::make_shared<CopiaTransformer>();
+    copia->addOutput(schema.emptyCopy());
+    copia->setTaskName("copia");
+    copia->setMorselRows(200);
+    copia->setMemoization(Memoization::Versions);
+    auto copia2 = std::make_shared<CopiaTransformer>();
+    copia2->addOutput(schema.emptyCopy());
+    copia2->setTaskName("copia2");
+    copia2->setMemoization(Memoization::Versions);
+    auto coleta = std::make_shared<ColetaTransformer>();
+    coleta->setTaskName("coleta");
+    e->addNext(copia, {1});
+    copia->addNext(copia2, {1});
+    copia2->addNext(coleta, {1});
+    RequestTrigger trigger;
+    trigger.addExtractor(e);
+
+    // Executa com o batch dado e diz se as duas cópias foram puladas (-1 se só uma foi)
+    auto executar = [&](std::shared_ptr<DataFrame> batch, double& ms) {
+        e->addOutput(batch);
+        std::streambuf* saida = cout.rdbuf(nullptr);
+        auto inicio = std::chrono::high_resolution_clock::now();
+        trigger.start(nThreads);
+        ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - inicio).count();
+        cout.rdbuf(saida);
+        if (copia->outputsReused() != copia2->outputsReused()) return -1;
+        return copia->outputsReused() ? 1 : 0;
+    };
+    // A coleta da última execução tem o primeiro id do batch (em qualquer ordem, com várias threads)
+    auto recebeu = [&](const std::string& id) {
+        auto chaves = coleta->getChaves();
+        return chaves.size() >= 2000 && std::find(chaves.end() - 2000, chaves.end(), id) != chaves.end();
+    };
+    bool ok = true;
+    double msCompleta = 0.0, msMemo = 0.0, ms = 0.0;
+
+    // Mesma versão: as cópias são puladas e a coleta recebe as mesmas linhas
+    ok = ok && executar(lote("lote-1", "a"), msCompleta) == 0 && coleta->getChaves().size() == 2000;
+    ok = ok && executar(lote("lote-1", "a"), msMemo) == 1 && coleta->getChaves().size() == 4000 && recebeu("a");
+    // Versão nova executa; sem versão, o modo Versions sempre executa
+    ok = ok && executar(lote("lote-2", "b"), ms) == 0 && recebeu("b");
+    ok = ok && executar(lote("", "b"), ms) == 0 && executar(lote("", "b"), ms) == 0;
+
+    // Content: sem versão, o mesmo conteúdo é reconhecido pelo hash e um conteúdo diferente executa
+    copia->setMemoization(Memoization::Content);
+    ok = ok && executar(lote("", "c"), ms) == 0 && executar(lote("", "c"), ms) == 1 && recebeu("c");
+    ok = ok && executar(lote("", "d"), ms) == 0 && recebeu("d");
+    // Parâmetro mudou: descartar as saídas guardadas força a execução
+    copia->invalidateMemo();
+    ok = ok && executar(lote("", "d"), ms) == -1 && recebeu("d");
+    ok = ok && coleta->getChaves().size() == 2000 * 9;
+
+    cout << "[testeMemoizacao] " << nThreads << " thread(s): " << msCompleta << " ms executando, " << msMemo
+         << " ms com as saídas reutilizadas - " << (ok ? "OK" : "FALHOU") << endl;
+}
+
+void testeCompilacao() {
+    DataFrame schema;
+    schema.addColumn<string>("id");
+    schema.addColumn<int>("valor");
+    auto entrada = schema.emptyCopy();
+    for (int i = 0; i < 100; i++) entrada->addRow(vector<any>{"id-" + to_string(i), i});
+    auto extrator = [&](const std::string& nome) {
+        auto e = std::make_shared<ExtractorNoop>();
+        e->addOutput(entrada);
+        e->setTaskName(nome);
+        e->blockParallel();
+        return e;
+    };
+    auto copia = [&](const std::string& nome) {
+        auto t = std::make_shared<CopiaTransformer>(0);
+        t->addOutput(schema.emptyCopy());
+        t->setTaskName(nome);
+        return t;
+    };
+    // Mensagem do compile ("" se o DAG é válido)
+    auto compilar = [](Trigger& t) {
+        try {
+            t.compile();
+        } catch (const std::invalid_argument& erro) {
+            return std::string(erro.what());
+        }
+        return std::string();
+    };
+    auto contem = [](const std::string& texto, const std::string& trecho) {
+        return texto.find(trecho) != std::string::npos;
+    };
+    bool ok = true;
+
+    // Losango e -> (a, b) -> j: ordem topológica com os extratores primeiro e a junção por último
+    auto e = extrator("e");
+    auto a = copia("a");
+    auto b = copia("b");
+    auto j = std::make_shared<ColetaTransformer>();
+    j->setTaskName("j");
+    e->addNext(a, {1});
+    e->addNext(b, {1});
+    a->addNext(j, {1});
+    b->addNext(j, {0});
+    RequestTrigger valido;
+    valido.addExtractor(e);
+    ok = ok && compilar(valido).empty() && valido.getTopologicalOrder() == std::vector<string>{"e", "a", "b", "j"};
+
+    // O DAG mudou depois do compile: a execução seguinte recompila e dispara a task nova
+    auto fim = std::make_shared<ColetaTransformer>();
+    fim->setTaskName("fim");
+    a->addNext(fim, {1});
+    std::streambuf* saida = cout.rdbuf(nullptr);
+    valido.start(2);
+    cout.rdbuf(saida);
+    ok = ok && fim->getChaves().size() == 100 && j->getChaves().size() == 100 && valido.getTopologicalOrder().size() == 5;
+
+    // Nome repetido
+    auto e1 = extrator("e1");
+    e1->addNext(copia("x"), {1});
+    e1->addNext(copia("x"), {1});
+    RequestTrigger repetido;
+    repetido.addExtractor(e1);
+    ok = ok && contem(compilar(repetido), "nome de task repetido: 'x'");
+
+    // Ciclo c1 -> c2 -> c1
+    auto e2 = extrator("e2");
+    auto c1 = copia("c1");
+    auto c2 = copia("c2");
+    e2->addNext(c1, {1});
+    c1->addNext(c2, {1});
+    c2->addNext(c1, {1});
+    RequestTrigger ciclo;
+    ciclo.addExtractor(e2);
+    ok = ok && contem(compilar(ciclo), "ciclo entre as tasks: c1, c2");
+
+    // Saída acrescentada depois do addNext, inputIndex fora das saídas e anterior fora do DAG,
+    // todos na mesma mensagem
+    auto e3 = extrator("e3");
+    auto e4 = extrator("e4");
+    auto s1 = copia("s1");
+    auto juncao = copia("juncao");
+    auto loader = std::make_shared<LoaderMemory>(1);
+    loader->setTaskName("loader");
+    auto s2 = copia("s2");
+    e3->addNext(s1, {1});
+    s1->addOutput(schema.emptyCopy());
+    s1->addNext(s2, {1, 0});
+    s1->addOutput(schema.emptyCopy());
+    e3->addNext(juncao, {1});
+    e4->addNext(juncao, {1});
+    e3->addNext(loader, {1});
+    RequestTrigger varios;
+    varios.addExtractor(e3);
+    std::string erro = compilar(varios);
+    ok = ok && contem(erro, "splitDFs de 's1' -> 's2' tem 2 elemento(s), mas a task anterior tem 3 saída(s)");
+    ok = ok && contem(erro, "inputIndex 1 do Loader 'loader' fora das 1 saída(s) de 'e3'");
+    ok = ok && contem(erro, "'juncao' depende de 'e4'");
+    // Com os dois extratores, a junção passa a ser válida
+    varios.addExtractor(e4);
+    erro = compilar(varios);
+    ok = ok && !contem(erro, "juncao") && contem(erro, "splitDFs");
+
+    // start com DAG inválido lança antes de executar qualquer task
+    bool lancou = false;
+    saida = cout.rdbuf(nullptr);
+    try {
+        repetido.start(1);
+    } catch (const std::invalid_argument&) {
+        lancou = true;
+    }
+    cout.rdbuf(saida);
+    ok = ok && lancou;
+
+    cout << "[testeCompilacao] " << (ok ? "OK" : "FALHOU") << endl;
+}
+
 int main(int argc, char *argv[]) {
     // int nThreads = 1;
     // if (argc > 1) {
@@ -1182,6 +3132,42 @@ int main(int argc, char *argv[]) {
     // }
 
     auto start = std::chrono::high_resolution_clock::now();
+    testeGroupBy();
+    testeQuantile();
+    testeStateStore();
+    testeStateSession();
+    testeRollbackMultiThread(1);
+    testeRollbackMultiThread();
+    testeTriggerPolicy();
+    testeColumnDecoder();
+    testeBackpressure();
+    testeShardedPipelineManager();
+    testeMpscRing(1);
+    testeMpscRing();
+    benchSubmit();
+    testeIngestLog();
+    benchIngestLog();
+    testeDedupFilter();
+    testeDedupReenvio();
+    benchDedupFilter();
+    testeTrace();
+    testeTaskProfile();
+    testeScheduler();
+    testeCompletionQueue(1);
+    testeCompletionQueue();
+    benchOrquestrador();
+    testeElasticidade();
+    testeTimerTrigger(1);
+    testeTimerTrigger();
+    testeFileWatchTrigger(1);
+    testeFileWatchTrigger();
+    testeCancelamento(1);
+    testeCancelamento();
+    testeMemoizacao(1);
+    testeMemoizacao();
+    testeCompilacao();
+    testeCachedSource(1);
+    testeCachedSource();
     //testExtractorAndLoader();
     //testeTransformer(3);
     // testeGeralEmap(4);
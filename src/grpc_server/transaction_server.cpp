@@ -5,17 +5,31 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <utility>
+#include <array>
+#include <unordered_map>
+#include <functional>
+#include <numeric>
 
 #include <grpcpp/grpcpp.h>
+#include <grpcpp/alarm.h>
 #include "transaction.pb.h"
 #include "transaction.grpc.pb.h"
 
 #include "trigger.hpp"
+#include "groupby.h"
+#include "quantile.h"
+#include "statestore.h"
 #include "types.h"
 #include "dataframe.h"
 #include "task.h"
 #include "pipelinemanager.hpp"
+#include "shardedpipelinemanager.hpp"
+#include "ingestlog.h"
+#include "dedupfilter.h"
 #include "datarepository.h"
+#include "columndecoder.h"
 
 using DataFramePtr         = std::shared_ptr<DataFrame>;
 using DataFrameWithIndexes = std::pair<std::vector<int>, DataFramePtr>;
@@ -23,18 +37,32 @@ using DataFrameWithIndexes = std::pair<std::vector<int>, DataFramePtr>;
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
-using grpc::ServerReader;
 using grpc::Status;
 
 using transaction::Transaction;
 using transaction::Result;
 using transaction::TransactionService;
+using transaction::Verdict;
+using transaction::VerdictBatch;
 
 
 class T1Transformer final : public Transformer {
 private:
     std::mutex writeMtx;
+    std::shared_ptr<const KeyIndex> users;
 public:
+    // 1) índice id_usuario -> linha do cadastro: o do extrator em cache, ou um montado aqui uma vez por execução
+    void prepare(std::vector<DataFramePtr>& outputs,
+                 const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
+    {
+        if (inputs.size() < 2) return;
+        auto inUsers = inputs[1].second;   // E2
+        users = inUsers->getKeyIndex("id_usuario");
+        if (!users) {
+            users = std::make_shared<const KeyIndex>(*inUsers, "id_usuario");
+        }
+    }
+
     void transform(std::vector<DataFramePtr>& outputs,
                 const std::vector<DataFrameWithIndexes>& inputs) override
     {
@@ -51,7 +79,6 @@ public:
         int pRegT = inTrans->getColumn("id_regiao")            ->getPosition();
 
         // posições E2 (agora incluindo limite_Boleto)
-        int pKey    = inUsers->getColumn("id_usuario")           ->getPosition();
         int pSaldo  = inUsers->getColumn("saldo")                ->getPosition();
         int pPix    = inUsers->getColumn("limite_PIX")           ->getPosition();
         int pTed    = inUsers->getColumn("limite_TED")           ->getPosition();
@@ -59,20 +86,12 @@ public:
         int pBol    = inUsers->getColumn("limite_Boleto")        ->getPosition();
         int pRegU   = inUsers->getColumn("id_regiao")            ->getPosition();
 
-        // monta mapa: agora o tuple tem 5 limites + região
-        std::unordered_map<std::string,
-        std::tuple<double,double,double,double,double,std::string>
-        > userMap;
-        for (size_t r = 0; r < inUsers->size(); ++r) {
-            auto uid  = inUsers->getElement<std::string>(r, pKey);
-            auto sal  = inUsers->getElement<double>     (r, pSaldo);
-            auto lpix = inUsers->getElement<double>     (r, pPix);
-            auto lted = inUsers->getElement<double>     (r, pTed);
-            auto lcre = inUsers->getElement<double>     (r, pCre);
-            auto lbol = inUsers->getElement<double>     (r, pBol);
-            auto regU = inUsers->getElement<std::string>(r, pRegU);
-            userMap[uid] = std::make_tuple(sal, lpix, lted, lcre, lbol, regU);
-        }
+        const auto& sald = inUsers->getColumnData<double>     (pSaldo);
+        const auto& pix  = inUsers->getColumnData<double>     (pPix);
+        const auto& ted  = inUsers->getColumnData<double>     (pTed);
+        const auto& cre  = inUsers->getColumnData<double>     (pCre);
+        const auto& bol  = inUsers->getColumnData<double>     (pBol);
+        const auto& regs = inUsers->getColumnData<std::string>(pRegU);
 
         for (int idx : inputs[0].first) {
             // valores de E1
@@ -84,11 +103,16 @@ public:
             auto regT  = inTrans->getElement<std::string>(idx, pRegT);
 
             // desempacota info do usuário
-            double sal, lpix, lted, lcre, lbol;
+            double sal = 0, lpix = 0, lted = 0, lcre = 0, lbol = 0;
             std::string regU;
-            auto it = userMap.find(usr);
-            if (it != userMap.end()) {
-                std::tie(sal, lpix, lted, lcre, lbol, regU) = it->second;
+            size_t r = users->findRow(usr);
+            if (r != users->npos) {
+                sal  = sald[r];
+                lpix = pix[r];
+                lted = ted[r];
+                lcre = cre[r];
+                lbol = bol[r];
+                regU = regs[r];
             }
 
             // monta row incluindo limite_Boleto (lbol)
@@ -206,7 +230,20 @@ public:
 class T4Transformer final : public Transformer {
 private:
     std::mutex writeMtx;
+    std::shared_ptr<const KeyIndex> regions;
 public:
+    // índice id_regiao -> linha de E3 (o do extrator em cache, se houver)
+    void prepare(std::vector<DataFramePtr>& outputs,
+                 const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
+    {
+        if (inputs.size() < 2) return;
+        auto dfReg = inputs[0].second;
+        regions = dfReg->getKeyIndex("id_regiao");
+        if (!regions) {
+            regions = std::make_shared<const KeyIndex>(*dfReg, "id_regiao");
+        }
+    }
+
     void transform(std::vector<DataFramePtr>& outputs,
                 const std::vector<DataFrameWithIndexes>& inputs) override
     {
@@ -216,18 +253,9 @@ public:
         auto dfT1  = inputs[1].second;   // T1: transações enriquecidas
         auto out   = outputs[0];         // dfT4
 
-        // --- monta mapa de coordenadas de região (id_regiao → (lat, lon)) ---
-        int pR     = dfReg->getColumn("id_regiao") ->getPosition();
-        int pLat   = dfReg->getColumn("latitude")  ->getPosition();
-        int pLon   = dfReg->getColumn("longitude") ->getPosition();
-
-        std::unordered_map<std::string, std::pair<double,double>> coordMap;
-        for (size_t r = 0; r < dfReg->size(); ++r) {
-            auto rid = dfReg->getElement<std::string>(r, pR);
-            auto lat = dfReg->getElement<double>     (r, pLat);
-            auto lon = dfReg->getElement<double>     (r, pLon);
-            coordMap[rid] = { lat, lon };
-        }
+        // --- coordenadas de região, consultadas pelo índice id_regiao ---
+        const auto& lats = dfReg->getColumnData<double>(dfReg->getColumn("latitude") ->getPosition());
+        const auto& lons = dfReg->getColumnData<double>(dfReg->getColumn("longitude")->getPosition());
 
         // --- posições em dfT1 para id, regiões de transação e usuário ---
         int pTrId = dfT1->getColumn("id_transacao")       ->getPosition();
@@ -242,13 +270,13 @@ public:
             std::string regU = dfT1->getElement<std::string>(idx, pRegU);
 
             double latT = 0, lonT = 0, latU = 0, lonU = 0;
-            if (auto it = coordMap.find(regT); it != coordMap.end()) {
-                latT = it->second.first;
-                lonT = it->second.second;
+            if (size_t r = regions->findRow(regT); r != regions->npos) {
+                latT = lats[r];
+                lonT = lons[r];
             }
-            if (auto it = coordMap.find(regU); it != coordMap.end()) {
-                latU = it->second.first;
-                lonU = it->second.second;
+            if (size_t r = regions->findRow(regU); r != regions->npos) {
+                latU = lats[r];
+                lonU = lons[r];
             }
 
             std::vector<std::any> row = {
@@ -307,12 +335,53 @@ public:
     }
 };
 
+// Estado de cada usuário mantido entre os batches do servidor
+struct UserState {
+    double somaValor = 0.0;      // soma de valor_transacao de todos os batches (média de T6)
+    long long numTransacoes = 0;
+    bool temSaldo = false;       // saldo e limites só existem depois do primeiro batch processado por T11
+    double saldo = 0.0;
+    double limitePix = 0.0;
+    double limiteTed = 0.0;
+    double limiteCredito = 0.0;
+    double limiteBoleto = 0.0;
+};
+using UserStateStore = StateStore<std::string, UserState>;
+using UserStateSession = UserStateStore::Session;
+
 class T6Transformer final : public Transformer {
 private:
     std::mutex writeMtx;
+    std::shared_ptr<UserStateSession> state;
+    std::shared_ptr<GroupByResult<std::string>> stats;
+    std::vector<double> media; // média acumulada por grupo de 'stats'
 public:
+    T6Transformer(std::shared_ptr<UserStateSession> state): state(state) {};
+
+    // 1) média acumulada de valor por usuário: junta o agregado do batch ao estado do usuário
+    void prepare(std::vector<DataFramePtr>& outputs,
+                 const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
+    {
+        if (inputs.empty()) return;
+        stats = GroupBy<std::string>(inputs[0].second, "id_usuario_pagador")
+                    .agg("valor_transacao", AggOp::Sum, "soma")
+                    .count()
+                    .execute(numThreads);
+
+        size_t aSoma  = stats->aggIndex("soma");
+        size_t aCount = stats->aggIndex("count");
+        media.assign(stats->numGroups(), 0.0);
+        for (size_t g = 0; g < stats->numGroups(); ++g) {
+            UserState u = state->getOr(stats->getKey(g), UserState());
+            u.somaValor     += stats->get(g, aSoma);
+            u.numTransacoes += static_cast<long long>(stats->get(g, aCount));
+            media[g] = u.somaValor / u.numTransacoes;
+            state->put(stats->getKey(g), u);
+        }
+    }
+
     void transform(std::vector<DataFramePtr>& outputs,
-                const std::vector<DataFrameWithIndexes>& inputs) override
+                   const std::vector<DataFrameWithIndexes>& inputs) override
     {
         if (inputs.empty()) return;
         auto in  = inputs[0].second;   // df de T1
@@ -323,25 +392,13 @@ public:
         int pUser = in->getColumn("id_usuario_pagador")->getPosition();
         int pVal  = in->getColumn("valor_transacao")   ->getPosition();
 
-        std::unordered_map<std::string, std::pair<double,int>> stats;
-        for (size_t r = 0; r < in->size(); ++r) {
-            auto uid = in->getElement<std::string>(r, pUser);
-            double v = in->getElement<double>     (r, pVal);
-            auto &pr = stats[uid];
-            pr.first  += v;
-            pr.second += 1;
-        }
-        std::unordered_map<std::string,double> avg;
-        for (auto &kv : stats) {
-            avg[kv.first] = kv.second.first / kv.second.second;
-        }
-
         // 2) para cada transação, gera (id_tr, score)
         for (int idx : inputs[0].first) {
             auto trxId = in->getElement<std::string>(idx, pTrId);
             auto uid   = in->getElement<std::string>(idx, pUser);
             double v   = in->getElement<double>     (idx, pVal);
-            double mean = avg[uid];
+            size_t g   = stats->findGroup(uid);
+            double mean = (g != stats->npos) ? media[g] : 0.0;
 
             // score: razão valor/mean (quanto maior, mais “arriscado”)
             double score = (mean > 0 ? v / mean : 0.0);
@@ -397,6 +454,7 @@ class T8Transformer final : public Transformer {
     std::mutex writeMtx2;
     std::mutex writeMtx3;
     std::mutex writeMtx4;
+    double tau = 0.0;
 
 public:
     // inputs:
@@ -408,36 +466,42 @@ public:
     //   [1] = valor: (score_valor, aprovacao)
     //   [2] = horario: (score_horario, aprovacao)
     //   [3] = regiao: (score_regiao, aprovacao)
+
+    // 1) mediana dos somatórios, calculada uma vez por execução (seleção em O(n), sem ordenar)
+    void prepare(std::vector<DataFramePtr>& outputs,
+                 const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
+    {
+        tau = 0.0;
+        if (inputs.size() < 3) return;
+        auto dfVal = inputs[0].second;
+        auto dfHor = inputs[1].second;
+        auto dfReg = inputs[2].second;
+
+        const auto& sV = dfVal->getColumnData<double>(dfVal->getColumn("score_risco")->getPosition());
+        const auto& sH = dfHor->getColumnData<double>(dfHor->getColumn("score_risco")->getPosition());
+        const auto& sR = dfReg->getColumnData<double>(dfReg->getColumn("score_risco")->getPosition());
+
+        std::vector<double> totals(dfVal->size());
+        for (size_t i = 0; i < totals.size(); ++i) {
+            totals[i] = sV[i] + sH[i] + sR[i];
+        }
+        if (!totals.empty()) {
+            tau = median(totals, numThreads);
+        }
+    }
+
     void transform(std::vector<DataFramePtr>& outputs,
-                const std::vector<DataFrameWithIndexes>& inputs) override
+                   const std::vector<DataFrameWithIndexes>& inputs) override
     {
         if (inputs.size() < 3) return;
         auto dfVal = inputs[0].second;
         auto dfHor = inputs[1].second;
         auto dfReg = inputs[2].second;
 
-        // 1) calcula mediana dos somatórios
-        std::vector<double> totals;
-        totals.reserve(dfVal->size());
         int pScoreV = dfVal->getColumn("score_risco")->getPosition();
         int pScoreH = dfHor->getColumn("score_risco")->getPosition();
         int pScoreR = dfReg->getColumn("score_risco")->getPosition();
-        for (size_t i = 0; i < dfVal->size(); ++i) {
-            totals.push_back(
-                dfVal->getElement<double>(i, pScoreV)
-            + dfHor->getElement<double>(i, pScoreH)
-            + dfReg->getElement<double>(i, pScoreR)
-            );
-        }
-        std::sort(totals.begin(), totals.end());
-        double tau = 0.0;
-        size_t n = totals.size();
-        if (n > 0) {
-            tau = (n % 2 == 1)
-                ? totals[n/2]
-                : (totals[n/2 - 1] + totals[n/2]) / 2.0;
-        }
-        //tau = 0;
+
         // 2) posições e ponteiros de saída
         int pId      = dfVal->getColumn("id_transacao")->getPosition();
         auto outMain = outputs[0];
@@ -512,42 +576,56 @@ public:
 class T10Transformer final : public Transformer {
     private:
         std::mutex writeMtx;
+        std::shared_ptr<UserStateSession> state;
+        std::shared_ptr<GroupByResult<std::string>> sums;
+        std::vector<char> reprovado; // por grupo de 'sums'
     public:
+        T10Transformer(std::shared_ptr<UserStateSession> state): state(state) {};
+
+        // 1) acumula somatório de valor por usuário e compara com o saldo atual do usuário
+        //    (o do estado, se ele já passou por um batch anterior, senão o do cadastro)
+        void prepare(std::vector<DataFramePtr>& outputs,
+                     const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
+        {
+            if (inputs.empty()) return;
+            sums = GroupBy<std::string>(inputs[0].second, "id_usuario_pagador")
+                       .agg("valor_transacao", AggOp::Sum,  "soma")
+                       .agg("saldo",           AggOp::Last, "saldo")
+                       .execute(numThreads);
+
+            size_t aSoma  = sums->aggIndex("soma");
+            size_t aSaldo = sums->aggIndex("saldo");
+            reprovado.assign(sums->numGroups(), 0);
+            for (size_t g = 0; g < sums->numGroups(); ++g) {
+                UserState u;
+                double saldo = (state->get(sums->getKey(g), u) && u.temSaldo) ? u.saldo : sums->get(g, aSaldo);
+                reprovado[g] = sums->get(g, aSoma) > saldo;
+            }
+        }
+
         void transform(std::vector<DataFramePtr>& outputs,
-                    const std::vector<DataFrameWithIndexes>& inputs) override
+                       const std::vector<DataFrameWithIndexes>& inputs) override
         {
             if (inputs.empty()) return;
             auto in  = inputs[0].second;   // dfT9
             auto out = outputs[0];         // dfT10
-
+    
             // posições das colunas em dfT9
             int pUser  = in->getColumn("id_usuario_pagador")->getPosition();
-            int pVal   = in->getColumn("valor_transacao")     ->getPosition();
-            int pSaldo = in->getColumn("saldo")               ->getPosition();
             int pApr   = in->getColumn("aprovacao")           ->getPosition();
 
-            // 1) acumula somatório de valor e captura o saldo por usuário
-            std::unordered_map<std::string, double> sumMap;
-            std::unordered_map<std::string, double> balMap;
-            for (size_t r = 0; r < in->size(); ++r) {
-                auto uid = in->getElement<std::string>(r, pUser);
-                double v = in->getElement<double>     (r, pVal);
-                double s = in->getElement<double>     (r, pSaldo);
-                sumMap[uid] += v;
-                balMap[uid]  = s;
-            }
             //int counter = 0;
             // 2) para cada linha de entrada, decide aprovação em bloco
             for (int idx : inputs[0].first) {
                 auto row = in->getRow(idx);
-                auto uid = row[pUser];
-
+                size_t g = sums->findGroup(row[pUser]);
+    
                 // se somatório > saldo, reprova todas as transações deste usuário
-                if (sumMap[uid] > balMap[uid]) {
+                if (g != sums->npos && reprovado[g]) {
                     row[pApr] = "0";
                     //counter++;
                 }
-
+    
                 std::lock_guard<std::mutex> lk(writeMtx);
                 out->addRow(row);
             }
@@ -558,59 +636,98 @@ class T10Transformer final : public Transformer {
 class T11Transformer final : public Transformer {
     private:
         std::mutex writeMtx1;
-        std::mutex writeMtx2;
+        std::shared_ptr<UserStateSession> state;
     public:
-        void transform(std::vector<DataFramePtr>& outputs,
-                    const std::vector<DataFrameWithIndexes>& inputs) override
+        T11Transformer(std::shared_ptr<UserStateSession> state): state(state) {};
+
+        // 1) Debita as transações aprovadas do saldo e do limite da modalidade de cada usuário,
+        //    partindo do estado dos batches anteriores (ou do cadastro, na primeira vez que o
+        //    usuário aparece), e emite a tabela de usuários. Feito uma vez por execução.
+        void prepare(std::vector<DataFramePtr>& outputs,
+                     const std::vector<DataFrameWithIndexes>& inputs, int numThreads) override
         {
             if (inputs.empty()) return;
-            auto in        = inputs[0].second;   // dfT10
-            auto outTrans  = outputs[0];         // dfT11Trans
-            auto outUser   = outputs[1];         // dfT11User
+            auto in      = inputs[0].second;   // dfT10
+            auto outUser = outputs[1];         // dfT11User
 
-            // posições das colunas em dfT10
-            int pTrId    = in->getColumn("id_transacao")         ->getPosition();
-            int pUser    = in->getColumn("id_usuario_pagador")   ->getPosition();
             int pVal     = in->getColumn("valor_transacao")      ->getPosition();
-            int pSaldo   = in->getColumn("saldo")                ->getPosition();
-            int pPixLim  = in->getColumn("limite_PIX")           ->getPosition();
-            int pTedLim  = in->getColumn("limite_TED")           ->getPosition();
-            int pCreLim  = in->getColumn("limite_CREDITO")       ->getPosition();
-            int pBolLim  = in->getColumn("limite_Boleto")        ->getPosition();
             int pApr     = in->getColumn("aprovacao")            ->getPosition();
             int pMod     = in->getColumn("modalidade_pagamento") ->getPosition();
 
-            // 1) Acumula novo saldo e novo limite por usuário
-            std::unordered_map<std::string, double> balanceMap;
-            std::unordered_map<std::string, double> limitMap;
-            for (int idx : inputs[0].first) {
-                auto uid = in->getElement<std::string>(idx, pUser);
-                double val = in->getElement<double>(idx, pVal);
-                int apr = in->getElement<int>(idx, pApr);
-                std::string mod = in->getElement<std::string>(idx, pMod);
-
-                // inicializa, na primeira ocorrência do usuário
-                if (balanceMap.find(uid) == balanceMap.end()) {
-                    balanceMap[uid] = in->getElement<double>(idx, pSaldo);
-                    if (mod == "PIX") {
-                        limitMap[uid] = in->getElement<double>(idx, pPixLim);
-                    } else if (mod == "TED") {
-                        limitMap[uid] = in->getElement<double>(idx, pTedLim);
-                    } else if (mod == "CREDITO") {
-                        limitMap[uid] = in->getElement<double>(idx, pCreLim);
-                    } else if (mod == "Boleto") {
-                        limitMap[uid] = in->getElement<double>(idx, pBolLim);
-                    } else {
-                        limitMap[uid] = 0.0;
+            const auto& val = in->getColumnData<double>(pVal);
+            const auto& apr = in->getColumnData<int>(pApr);
+            const auto& mod = in->getColumnData<std::string>(pMod);
+
+            // modalidade de cada transação (-1 = desconhecida), valor debitado do saldo (toda transação
+            // aprovada) e valor debitado do limite de cada modalidade
+            const std::vector<std::string> modalidades = {"PIX", "TED", "CREDITO", "Boleto"};
+            std::vector<double> modalidade(in->size());
+            std::vector<double> debitoSaldo(in->size(), 0.0);
+            std::vector<std::vector<double>> debito(modalidades.size(), std::vector<double>(in->size(), 0.0));
+            for (size_t r = 0; r < in->size(); ++r) {
+                auto it = std::find(modalidades.begin(), modalidades.end(), mod[r]);
+                int m = (it == modalidades.end()) ? -1 : static_cast<int>(it - modalidades.begin());
+                modalidade[r] = m;
+                if (apr[r] != 1) continue;
+                debitoSaldo[r] = val[r];
+                if (m >= 0) debito[m][r] = val[r];
+            }
+
+            // saldo e limites do cadastro vêm da primeira ocorrência do usuário
+            auto users = GroupBy<std::string>(in, "id_usuario_pagador")
+                             .agg("saldo",              AggOp::First, "saldo")
+                             .agg("limite_PIX",         AggOp::First, "limite_PIX")
+                             .agg("limite_TED",         AggOp::First, "limite_TED")
+                             .agg("limite_CREDITO",     AggOp::First, "limite_CREDITO")
+                             .agg("limite_Boleto",      AggOp::First, "limite_Boleto")
+                             .agg(std::move(modalidade), AggOp::First, "modalidade")
+                             .agg(std::move(debitoSaldo), AggOp::Sum,  "debito")
+                             .agg(std::move(debito[0]),  AggOp::Sum,   "debito_PIX")
+                             .agg(std::move(debito[1]),  AggOp::Sum,   "debito_TED")
+                             .agg(std::move(debito[2]),  AggOp::Sum,   "debito_CREDITO")
+                             .agg(std::move(debito[3]),  AggOp::Sum,   "debito_Boleto")
+                             .execute(numThreads);
+
+            // 3) Emite tabela de usuários: (id_usuario_pagador, novo_saldo, novo_limite), onde o
+            //    limite é o da modalidade da primeira transação do usuário no batch
+            size_t aSaldo = users->aggIndex("saldo");
+            size_t aMod   = users->aggIndex("modalidade");
+            size_t aDeb   = users->aggIndex("debito");
+            for (size_t g = 0; g < users->numGroups(); ++g) {
+                const std::string& uid = users->getKey(g);
+                UserState u = state->getOr(uid, UserState());
+                double* limites[] = {&u.limitePix, &u.limiteTed, &u.limiteCredito, &u.limiteBoleto};
+                if (!u.temSaldo) {
+                    u.temSaldo = true;
+                    u.saldo = users->get(g, aSaldo);
+                    for (size_t m = 0; m < modalidades.size(); ++m) {
+                        *limites[m] = users->get(g, users->aggIndex("limite_" + modalidades[m]));
                     }
                 }
-
-                if (apr == 1) {
-                    balanceMap[uid] -= val;
-                    limitMap[uid]  -= val;
+                u.saldo -= users->get(g, aDeb);
+                for (size_t m = 0; m < modalidades.size(); ++m) {
+                    *limites[m] -= users->get(g, users->aggIndex("debito_" + modalidades[m]));
                 }
+                state->put(uid, u);
+
+                int m = static_cast<int>(users->get(g, aMod));
+                double novoLimite = (m >= 0) ? *limites[m] : 0.0;
+                std::vector<std::any> row = { uid, u.saldo, novoLimite };
+                outUser->addRow(row);
             }
+        }
 
+        void transform(std::vector<DataFramePtr>& outputs,
+                       const std::vector<DataFrameWithIndexes>& inputs) override
+        {
+            if (inputs.empty()) return;
+            auto in        = inputs[0].second;   // dfT10
+            auto outTrans  = outputs[0];         // dfT11Trans
+    
+            // posições das colunas em dfT10
+            int pTrId    = in->getColumn("id_transacao")         ->getPosition();
+            int pApr     = in->getColumn("aprovacao")            ->getPosition();
+    
             // 2) Emite tabela de transações: (id_transacao, aprovacao)
             for (int idx : inputs[0].first) {
                 std::string trxId = in->getElement<std::string>(idx, pTrId);
@@ -621,18 +738,6 @@ class T11Transformer final : public Transformer {
                     outTrans->addRow(row);
                 }
             }
-
-            // 3) Emite tabela de usuários: (id_usuario_pagador, novo_saldo, novo_limite)
-            for (const auto& kv : balanceMap) {
-                const auto& uid = kv.first;
-                double novoSaldo = kv.second;
-                double novoLimite = limitMap[uid];
-                std::vector<std::any> row = { uid, novoSaldo, novoLimite };
-                {
-                    std::lock_guard<std::mutex> lk2(writeMtx2);
-                    outUser->addRow(row);
-                }
-            }
         }
 };
 
@@ -684,7 +789,170 @@ public:
     }
 };
 
-ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* rowBatch = nullptr) {
+// Caixa de saída dos vereditos de um stream StreamTransactions. As threads da pipeline entregam
+// vereditos nela e acordam a chamada (wake), que os envia pelo stream na thread da sua fila.
+class VerdictMailbox {
+public:
+    explicit VerdictMailbox(std::function<void()> wake): wake(std::move(wake)) {};
+
+    void deliver(std::vector<Verdict>&& verdicts) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!open) return;
+        deliveredCount += verdicts.size();
+        for (auto& v : verdicts) pending.push_back(std::move(v));
+        if (!wakePending) {
+            wakePending = true;
+            wake();
+        }
+    }
+
+    // Move os vereditos pendentes para batch; false se não há nenhum
+    bool take(VerdictBatch& batch) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (pending.empty()) return false;
+        batch.clear_verdicts();
+        for (auto& v : pending) *batch.add_verdicts() = std::move(v);
+        pending.clear();
+        return true;
+    }
+
+    size_t delivered() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return deliveredCount;
+    }
+
+    // A chamada tratou o último wake: a próxima entrega pode acordá-la de novo
+    void rearm() {
+        std::lock_guard<std::mutex> lock(mtx);
+        wakePending = false;
+    }
+
+    // A chamada vai ser destruída: entregas a partir daqui são descartadas
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        open = false;
+    }
+
+private:
+    mutable std::mutex mtx;
+    std::vector<Verdict> pending;
+    size_t deliveredCount = 0;
+    bool wakePending = false;
+    bool open = true;
+    std::function<void()> wake;
+};
+
+// Liga cada id_transacao recebido por StreamTransactions à caixa de saída do stream que o enviou
+class VerdictRouter {
+public:
+    void expect(const std::string& id, const std::shared_ptr<VerdictMailbox>& mailbox) {
+        Shard& shard = shards[std::hash<std::string>{}(id) % numShards];
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        shard.waiting[id] = mailbox;
+    }
+
+    // Entrega os vereditos das linhas 'rows' de df (id_transacao, aprovacao), agrupados por stream.
+    // Transações que não vieram de StreamTransactions são ignoradas.
+    void publish(const DataFramePtr& df, const std::vector<int>& rows) {
+        const auto& ids = df->getColumnData<std::string>(df->getColumn("id_transacao")->getPosition());
+        const auto& apr = df->getColumnData<int>(df->getColumn("aprovacao")->getPosition());
+        route(ids, rows, [&apr](int r) { return apr[r]; });
+    }
+
+    // Batch recusado pelo manager, ou cuja execução falhou: cada transação ainda sem veredito recebe -1
+    // (descartada) e sai do roteamento
+    void reject(DataFrame& df) {
+        const auto& ids = df.getColumnData<std::string>(df.getColumn("id_transacao")->getPosition());
+        std::vector<int> rows(ids.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        route(ids, rows, [](int) { return -1; });
+    }
+
+private:
+    static constexpr size_t numShards = 16;
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, std::shared_ptr<VerdictMailbox>> waiting;
+    };
+    std::array<Shard, numShards> shards;
+
+    template <typename Aprovacao>
+    void route(const std::vector<std::string>& ids, const std::vector<int>& rows, Aprovacao aprovacaoOf) {
+        long long agora = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::unordered_map<VerdictMailbox*, std::pair<std::shared_ptr<VerdictMailbox>, std::vector<Verdict>>> porStream;
+        for (int r : rows) {
+            Shard& shard = shards[std::hash<std::string>{}(ids[r]) % numShards];
+            std::shared_ptr<VerdictMailbox> mailbox;
+            {
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                auto it = shard.waiting.find(ids[r]);
+                if (it == shard.waiting.end()) continue;
+                mailbox = std::move(it->second);
+                shard.waiting.erase(it);
+            }
+            auto& destino = porStream[mailbox.get()];
+            destino.first = mailbox;
+            Verdict v;
+            v.set_id_transacao(ids[r]);
+            v.set_aprovacao(aprovacaoOf(r));
+            v.set_timestamp_decisao(agora);
+            destino.second.push_back(std::move(v));
+        }
+        for (auto& [ptr, destino] : porStream) {
+            destino.first->deliver(std::move(destino.second));
+        }
+    }
+};
+
+// Publica a decisão final de cada transação (saída de T11) para os clientes de StreamTransactions
+class VerdictTransformer final : public Transformer {
+private:
+    std::shared_ptr<VerdictRouter> router;
+public:
+    VerdictTransformer(std::shared_ptr<VerdictRouter> router): router(router) {};
+
+    void transform(std::vector<DataFramePtr>& outputs,
+                   const std::vector<DataFrameWithIndexes>& inputs) override
+    {
+        if (inputs.empty()) return;
+        router->publish(inputs[0].second, inputs[0].first); // dfT11Trans
+    }
+};
+
+// Recursos compartilhados pelas instâncias da pipeline do servidor (o estado por usuário, só pelas
+// instâncias de um mesmo shard)
+struct PipelineShared {
+    std::shared_ptr<UserStateStore> userState; // saldo, limites e médias por usuário entre os batches
+    std::shared_ptr<SourceCache> cadastro;     // informações de cadastro (E2), lidas uma vez por versão
+    std::shared_ptr<SourceCache> regioes;      // regiões (E3), idem
+    std::shared_ptr<VerdictRouter> verdicts;   // destino dos vereditos de StreamTransactions
+    std::shared_ptr<TaskProfile> taskProfile;  // custo medido das tasks, usado como peso pelos triggers
+};
+
+PipelineShared buildPipelineShared() {
+    PipelineShared shared;
+    shared.userState = std::make_shared<UserStateStore>();
+    shared.verdicts = std::make_shared<VerdictRouter>();
+    // O perfil aprendido sobrevive a reinícios: o servidor sobe com os pesos da última execução
+    const std::string profilePath = "data/task_profile.txt";
+    shared.taskProfile = std::make_shared<TaskProfile>();
+    if (shared.taskProfile->load(profilePath)) {
+        std::cout << "Perfil de tasks carregado de " << profilePath << std::endl;
+    }
+    shared.taskProfile->autosave(profilePath, std::chrono::seconds(1));
+
+    SQLiteRepository* sqliteRepository = new SQLiteRepository("data/informacoes_cadastro_100k.db");
+    sqliteRepository->setTable("informacoes_cadastro");
+    shared.cadastro = std::make_shared<SourceCache>(sqliteRepository, "id_usuario");
+
+    shared.regioes = std::make_shared<SourceCache>(new FileRepository("data/regioes_estados_brasil.csv", ",", true), "id_regiao");
+    return shared;
+}
+
+// Constrói uma instância (DAG próprio) da pipeline; instâncias diferentes podem executar ao mesmo tempo
+ServerTrigger* buildPipelineTransacoes(const PipelineShared& shared) {
     //====================Construção dos DFS===========================//
 
     auto dfE1 = std::make_shared<DataFrame>();
@@ -796,20 +1064,19 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     e1->blockParallel();
 
     auto e2 = std::make_shared<ExtractorSQLite>();
-    SQLiteRepository* sqliteRepository = new SQLiteRepository("data/informacoes_cadastro_100k.db");
-    sqliteRepository->setTable("informacoes_cadastro");
-    e2->addRepo(sqliteRepository);
     e2->addOutput(dfE2);
     e2->setTaskName("e2");
-    e2->blockReadAgain();
+    e2->cacheSource(shared.cadastro);
 
     auto e3 = std::make_shared<ExtractorFile>();
-    e3->addRepo(new FileRepository("data/regioes_estados_brasil.csv", ",", true));
     e3->addOutput(dfE3);
     e3->setTaskName("e3");
-    e3->blockReadAgain();
+    e3->cacheSource(shared.regioes);
 
     //==================== Construção dos elementos do DAG ===========================//
+    // Sessão desta instância sobre o estado por usuário (usado por T6, T10 e T11)
+    auto userState = shared.userState->openSession();
+
     auto t1 = std::make_shared<T1Transformer>();
     t1->addOutput(dfT1);
     t1->setTaskName("t1");
@@ -850,7 +1117,7 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     // t5->addNext(tp5, {1});
     // tp5->setTaskName("tp5");
 
-    auto t6 = std::make_shared<T6Transformer>();
+    auto t6 = std::make_shared<T6Transformer>(userState);
     t6->addOutput(dfT6);
     t6->setTaskName("t6");
 
@@ -881,7 +1148,7 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     // t9->addNext(tp9, {1});
     // tp9->setTaskName("tp9");
 
-    auto t10  = std::make_shared<T10Transformer>();
+    auto t10  = std::make_shared<T10Transformer>(userState);
     t10->addOutput(dfT10);
     t10->setTaskName("t10");
 
@@ -889,13 +1156,17 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     // t10->addNext(tp10, {1});
     // tp10->setTaskName("tp10");
 
-    auto t11 = std::make_shared<T11Transformer>();
+    auto t11 = std::make_shared<T11Transformer>(userState);
     t11->addOutput(dfT11Trans);
     t11->addOutput(dfT11User);
     t11->setTaskName("t11");
 
+    auto tv = std::make_shared<VerdictTransformer>(shared.verdicts);
+    tv->setTaskName("tv");
+
     auto t12 = std::make_shared<T12Transformer>();
     t12->setTaskName("t12");
+    t12->blockParallel(); // mede a latência do batch inteiro, não da parte de cada chamada
 
     auto l6 = std::make_shared<LoaderFile>(0, false);
     l6->addRepo(new FileRepository("outputs/output_L6.csv", ",", true));
@@ -954,6 +1225,7 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     t10->addNext(t11, {1});
 
     t11->addNext(t12, {1,1});
+    t11->addNext(tv, {1,0});
 
     t11->addNext(l1, {1,1});
     t11->addNext(l2, {1,1});
@@ -962,53 +1234,444 @@ ServerTrigger* buildPipelineTransacoes(int nThreads = 8, std::vector<VarRow>* ro
     trigger->addExtractor(e1);
     trigger->addExtractor(e2);
     trigger->addExtractor(e3);
+    trigger->addStateStore(userState);
+    trigger->setTaskProfile(shared.taskProfile);
 
     return trigger;
 }
 
-class TransactionServerImpl final : public TransactionService::Service {
+// Campos de Transaction na ordem das colunas de E1: cada mensagem vai direto para as colunas do batch
+using TransactionDecoder = ColumnDecoder<
+    Field<&Transaction::id_transacao>,
+    Field<&Transaction::id_usuario_pagador>,
+    Field<&Transaction::id_usuario_recebedor>,
+    Field<&Transaction::id_regiao>,
+    Field<&Transaction::modalidade_pagamento>,
+    Field<&Transaction::data_horario>,
+    Field<&Transaction::valor_transacao>,
+    Field<&Transaction::timestamp_envio, long long int>>;
+
+// Acumula as transações de um stream em batches colunares pequenos, um por shard (pelo hash de
+// id_usuario_pagador), e os entrega ao manager do shard; o acúmulo até o tamanho de cada execução
+// fica a cargo do critério de disparo de cada manager
+class StreamBatcher {
+public:
+    // onRejected recebe os batches recusados por um shard acima do limite de linhas pendentes
+    StreamBatcher(ShardedPipelineManager* managers, const DataFrame& schema,
+                  std::function<void(DataFrame&)> onRejected = nullptr)
+        : managers(managers), onRejected(std::move(onRejected)) {
+        decoders.reserve(managers->numShards());
+        for (size_t i = 0; i < managers->numShards(); i++) {
+            decoders.emplace_back(schema);
+        }
+        lastSubmit = std::chrono::high_resolution_clock::now();
+    }
+
+    void add(const Transaction& transaction) {
+        size_t shard = managers->shardOf(transaction.id_usuario_pagador());
+        TransactionDecoder& decoder = decoders[shard];
+        if (decoder.empty()) decoder.reserve(streamBatchRows);
+        decoder.append(transaction);
+        if (decoder.size() >= streamBatchRows) {
+            submit(shard);
+        }
+        std::chrono::duration<double, std::milli> deltaTime = std::chrono::high_resolution_clock::now() - lastSubmit;
+        if (deltaTime > streamBatchDelay) {
+            submit();
+        }
+    }
+
+    // Entrega o que está acumulado em todos os shards
+    void submit() {
+        lastSubmit = std::chrono::high_resolution_clock::now();
+        for (size_t shard = 0; shard < decoders.size(); shard++) {
+            submit(shard);
+        }
+    }
+
 private:
-    ServerTrigger* trigger;
-    PipelineManager* manager;
+    static constexpr size_t streamBatchRows = 500;
+    static constexpr std::chrono::milliseconds streamBatchDelay{50};
+
+    ShardedPipelineManager* managers;
+    std::vector<TransactionDecoder> decoders;
+    std::function<void(DataFrame&)> onRejected;
+    std::chrono::high_resolution_clock::time_point lastSubmit;
+
+    void submit(size_t shard) {
+        if (decoders[shard].empty()) return;
+        auto batch = decoders[shard].flush();
+        if (!managers->shard(shard).submitDataBatch(batch) && onRejected) {
+            onRejected(*batch);
+        }
+    }
+};
+
+// Tira do filtro os ids de um batch que não foi processado (recusado ou com a execução desfeita),
+// para que o reenvio do cliente seja aceito em vez de ignorado como repetido
+void forgetTransactions(DedupFilter& dedup, DataFrame& batch) {
+    const auto& ids = batch.getColumnData<std::string>(batch.getColumn("id_transacao")->getPosition());
+    for (const std::string& id : ids) dedup.erase(id);
+}
 
+// Evento de uma chamada assíncrona; é o tag passado para a CompletionQueue
+class CallEvent {
 public:
-    TransactionServerImpl(ServerTrigger* trigg, PipelineManager* man): trigger(trigg), manager(man) {};
-    Status SendTransaction (ServerContext* context,
-                            ServerReader<Transaction>* stream,
-                            Result* reply) override {
-        Transaction current;
-        int incomingTransactions = 0;
-        std::vector<VarRow>* rowBatch = new std::vector<VarRow>;
-        
-        auto lastSubmit = std::chrono::high_resolution_clock::now();
+    virtual ~CallEvent() = default;
+    // ok é o resultado da operação que gerou o evento
+    virtual void Proceed(bool ok) = 0;
+};
 
-        while(stream->Read(&current)){
-            //==== Lógica vai aqui - esse while vai loopar enquanto há stream do client ====
-            VarRow row = {current.id_transacao(), current.id_usuario_pagador(),
-                current.id_usuario_recebedor(), current.id_regiao(),
-                current.modalidade_pagamento(), current.data_horario(),
-                current.valor_transacao(), current.timestamp_envio()};
-            rowBatch->push_back(row);
+// Servidor assíncrono: um número fixo de threads atende todos os streams, cada uma tirando eventos
+// da sua CompletionQueue. Cada chamada em andamento é uma máquina de estados que avança a cada
+// evento, então milhares de streams de clientes não precisam de milhares de threads.
+class TransactionServerImpl final {
+public:
+    // schema: DataFrame vazio com as colunas de E1, usado para montar os batches
+    // dedup: ids de transação já recebidos; transações repetidas não vão para a pipeline
+    TransactionServerImpl(ShardedPipelineManager* man, std::shared_ptr<VerdictRouter> verdicts, DedupFilter* dedup,
+                          const DataFrame& schema, size_t numPollers)
+        : manager(man), verdicts(verdicts), dedup(dedup), schema(schema), numPollers(std::max<size_t>(1, numPollers)) {};
+    ~TransactionServerImpl();
 
-            // std::cout << "Thread " << std::this_thread::get_id() << " recebeu a " << incomingTransactions << "ª transação de id " << current.id_transacao() << ": " << current.id_usuario_pagador() << " | " << current.id_usuario_recebedor() << " | " << current.id_regiao() << " | " << current.modalidade_pagamento() << " | " << current.data_horario() << " | " << current.valor_transacao() << " R$" << std::endl; std::cout << rowBatch->size() << std::endl;
-            
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> deltaTime = end - lastSubmit;
-                
-            incomingTransactions++;
-            if(rowBatch->size() >= 5000 || (rowBatch->size() > 0 && deltaTime > std::chrono::milliseconds(5*1000))){
-                lastSubmit = std::chrono::high_resolution_clock::now();
-
-                // std::cout << "thread " << std::this_thread::get_id() << " chamando submit." << std::endl;
-                manager->submitDataBatch(*rowBatch);
-                rowBatch = new std::vector<VarRow>;
+    // Sobe o servidor e atende as chamadas até ele ser desligado
+    void Run(const std::string& address);
+
+private:
+    class SendTransactionCall;
+    class StreamTransactionsCall;
+
+    ShardedPipelineManager* manager;
+    std::shared_ptr<VerdictRouter> verdicts;
+    DedupFilter* dedup;
+    const DataFrame& schema;
+    size_t numPollers;
+    TransactionService::AsyncService service;
+    std::unique_ptr<Server> server;
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs;
+
+    // Chamadas de cada tipo aguardando novos clientes em cada fila
+    static constexpr int pendingCallsPerQueue = 4;
+
+    void HandleRpcs(grpc::ServerCompletionQueue* cq);
+
+    // Um batch recusado pela pipeline não foi processado: seus ids saem do filtro para que o
+    // reenvio do cliente seja aceito
+    void forgetRejected(DataFrame& batch) { forgetTransactions(*dedup, batch); }
+};
+
+// Um stream de SendTransaction. Só recebe eventos da fila em que foi criado, então nunca é
+// acessado por duas threads ao mesmo tempo.
+class TransactionServerImpl::SendTransactionCall final : public CallEvent {
+public:
+    SendTransactionCall(TransactionServerImpl* owner, grpc::ServerCompletionQueue* cq)
+        : owner(owner), cq(cq), reader(&context),
+          batcher(owner->manager, owner->schema, [owner](DataFrame& batch) { owner->forgetRejected(batch); }) {
+        owner->service.RequestSendTransaction(&context, &reader, cq, cq, tag());
+    }
+
+    void Proceed(bool ok) override {
+        switch (state) {
+        case State::Waiting:
+            if (!ok) { // servidor desligando
+                delete this;
+                return;
             }
+            // Deixa outra chamada esperando o próximo cliente antes de atender este
+            new SendTransactionCall(owner, cq);
+            state = State::Reading;
+            reader.Read(&current, tag());
+            break;
+        case State::Reading:
+            if (ok) {
+                // Reenvio de uma transação já recebida: ignorada
+                if (owner->dedup->insert(current.id_transacao())) {
+                    batcher.add(current);
+                }
+                readNext();
+            } else {
+                // Cliente fechou o stream: o que sobrou também é processado
+                batcher.submit();
+                reply.set_ok(true);
+                state = State::Finishing;
+                reader.Finish(reply, Status::OK, tag());
+            }
+            break;
+        case State::Paused: // sem operação do reader pendente: os eventos do pause vêm por resumeEvent
+            break;
+        case State::Finishing:
+            finished = true;
+            // Só destrói depois que nenhum alarme pode mais chegar com este objeto
+            if (outstandingAlarms.load() == 0) delete this;
+            break;
+        }
+    }
+
+private:
+    enum class State { Waiting, Reading, Paused, Finishing };
+
+    // Tag do alarme de retomada, separado do tag das operações do reader
+    struct ResumeEvent final : public CallEvent {
+        SendTransactionCall* call;
+        explicit ResumeEvent(SendTransactionCall* call): call(call) {};
+        void Proceed(bool ok) override { call->onResume(ok); }
+    };
+
+    TransactionServerImpl* owner;
+    grpc::ServerCompletionQueue* cq;
+    ServerContext context;
+    grpc::ServerAsyncReader<Result, Transaction> reader;
+    State state = State::Waiting;
+
+    Transaction current;
+    Result reply;
+    StreamBatcher batcher;
+    ResumeEvent resumeEvent{this};
+    grpc::Alarm resumeAlarm;
+    std::atomic<int> outstandingAlarms{0};
+    bool finished = false;
+
+    void* tag() { return static_cast<CallEvent*>(this); }
+
+    void onResume(bool ok) {
+        outstandingAlarms--;
+        if (finished || !ok) { // ok == false: alarme cancelado, servidor desligando
+            if (outstandingAlarms.load() == 0) delete this;
+            return;
         }
-        reply->set_ok(true);
-        return Status::OK;
+        // O shard voltou a aceitar: retoma a leitura (e reavalia os demais na próxima mensagem)
+        state = State::Reading;
+        reader.Read(&current, tag());
+    }
+
+    // Com algum shard acima do limite, para de ler: as mensagens ficam no cliente e o controle de
+    // fluxo do HTTP/2 segura o envio até a leitura ser retomada
+    void readNext() {
+        PipelineManager* paused = owner->manager->pausedShard();
+        if (!paused) {
+            reader.Read(&current, tag());
+            return;
+        }
+        batcher.submit();
+        state = State::Paused;
+        outstandingAlarms++;
+        paused->whenAccepting([this] {
+            resumeAlarm.Set(cq, std::chrono::system_clock::now(), static_cast<CallEvent*>(&resumeEvent));
+        });
     }
 };
 
+// Um stream de StreamTransactions: lê transações como SendTransaction e, em paralelo, escreve de
+// volta os vereditos que a pipeline entrega na caixa de saída do stream, um VerdictBatch por vez.
+// O stream termina quando o cliente parou de enviar e todos os vereditos esperados foram escritos
+// (ou depois de drainTimeout, se algum não chegar).
+class TransactionServerImpl::StreamTransactionsCall {
+public:
+    StreamTransactionsCall(TransactionServerImpl* owner, grpc::ServerCompletionQueue* cq)
+        : owner(owner), cq(cq), stream(&context),
+          batcher(owner->manager, owner->schema, [owner](DataFrame& batch) {
+              owner->forgetRejected(batch);
+              owner->verdicts->reject(batch);
+          }),
+          requestEvent(this, Kind::Request), readEvent(this, Kind::Read), writeEvent(this, Kind::Write),
+          wakeEvent(this, Kind::Wake), timeoutEvent(this, Kind::Timeout), resumeEvent(this, Kind::Resume),
+          finishEvent(this, Kind::Finish) {
+        // Chamado por threads da pipeline; a caixa garante no máximo um wake pendente
+        mailbox = std::make_shared<VerdictMailbox>([this] {
+            outstandingAlarms++;
+            wakeAlarm.Set(this->cq, std::chrono::system_clock::now(), static_cast<CallEvent*>(&wakeEvent));
+        });
+        owner->service.RequestStreamTransactions(&context, &stream, cq, cq, static_cast<CallEvent*>(&requestEvent));
+    }
+
+private:
+    enum class Kind { Request, Read, Write, Wake, Timeout, Resume, Finish };
+
+    struct Event final : public CallEvent {
+        StreamTransactionsCall* call;
+        Kind kind;
+        Event(StreamTransactionsCall* call, Kind kind): call(call), kind(kind) {};
+        void Proceed(bool ok) override { call->onEvent(kind, ok); }
+    };
+
+    static constexpr std::chrono::seconds drainTimeout{30};
+
+    TransactionServerImpl* owner;
+    grpc::ServerCompletionQueue* cq;
+    ServerContext context;
+    grpc::ServerAsyncReaderWriter<VerdictBatch, Transaction> stream;
+    StreamBatcher batcher;
+    std::shared_ptr<VerdictMailbox> mailbox;
+
+    Event requestEvent, readEvent, writeEvent, wakeEvent, timeoutEvent, resumeEvent, finishEvent;
+    grpc::Alarm wakeAlarm;
+    grpc::Alarm timeoutAlarm;
+    grpc::Alarm resumeAlarm;
+    std::atomic<int> outstandingAlarms{0};
+
+    Transaction current;
+    VerdictBatch writing;
+    size_t expected = 0;      // transações lidas, cada uma espera um veredito
+    bool readsDone = false;
+    bool writeInFlight = false;
+    bool broken = false;      // uma escrita falhou: o cliente foi embora
+    bool timedOut = false;
+    bool finishing = false;
+    bool finished = false;
+    bool abandoned = false;   // a retomada da leitura foi cancelada
+
+    void onEvent(Kind kind, bool ok) {
+        switch (kind) {
+        case Kind::Request:
+            if (!ok) { // servidor desligando
+                delete this;
+                return;
+            }
+            new StreamTransactionsCall(owner, cq);
+            stream.Read(&current, static_cast<CallEvent*>(&readEvent));
+            return;
+        case Kind::Read:
+            if (ok) {
+                expected++;
+                if (owner->dedup->insert(current.id_transacao())) {
+                    // Registrado antes do envio ao manager, para o veredito nunca chegar antes
+                    owner->verdicts->expect(current.id_transacao(), mailbox);
+                    batcher.add(current);
+                } else {
+                    // Repetida: responde na hora, sem tirar o stream da transação original do roteamento
+                    rejectDuplicate();
+                }
+                readNext();
+            } else {
+                readsDone = true;
+                batcher.submit();
+                outstandingAlarms++;
+                timeoutAlarm.Set(cq, std::chrono::system_clock::now() + drainTimeout, static_cast<CallEvent*>(&timeoutEvent));
+            }
+            break;
+        case Kind::Write:
+            writeInFlight = false;
+            if (!ok) broken = true;
+            break;
+        case Kind::Wake:
+            outstandingAlarms--;
+            mailbox->rearm();
+            break;
+        case Kind::Timeout:
+            outstandingAlarms--;
+            if (ok) timedOut = true; // ok == false: alarme cancelado no fim normal
+            break;
+        case Kind::Resume:
+            outstandingAlarms--;
+            if (!ok) { // alarme cancelado: servidor desligando, nenhuma operação nova no stream
+                abandoned = true;
+                broken = true;
+                mailbox->close();
+                break;
+            }
+            stream.Read(&current, static_cast<CallEvent*>(&readEvent));
+            break;
+        case Kind::Finish:
+            mailbox->close();
+            finished = true;
+            break;
+        }
+        // Abandonada: termina sem Finish assim que a escrita em andamento (se houver) voltar
+        if (abandoned && !writeInFlight) finished = true;
+        if (finished) {
+            // Só destrói depois que nenhum alarme pode mais chegar com este tag
+            if (outstandingAlarms.load() == 0) delete this;
+            return;
+        }
+        tryWrite();
+        tryFinish();
+    }
+
+    // Como em SendTransaction, para de ler enquanto algum shard estiver acima do limite.
+    // Transações de batches recusados recebem o veredito "descartada" (ver o batcher).
+    void readNext() {
+        PipelineManager* paused = owner->manager->pausedShard();
+        if (!paused) {
+            stream.Read(&current, static_cast<CallEvent*>(&readEvent));
+            return;
+        }
+        batcher.submit();
+        outstandingAlarms++;
+        paused->whenAccepting([this] {
+            resumeAlarm.Set(cq, std::chrono::system_clock::now(), static_cast<CallEvent*>(&resumeEvent));
+        });
+    }
+
+    void rejectDuplicate() {
+        Verdict v;
+        v.set_id_transacao(current.id_transacao());
+        v.set_aprovacao(-2);
+        v.set_timestamp_decisao(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        std::vector<Verdict> verdicts;
+        verdicts.push_back(std::move(v));
+        mailbox->deliver(std::move(verdicts));
+    }
+
+    void tryWrite() {
+        if (writeInFlight || broken || finishing) return;
+        if (!mailbox->take(writing)) return;
+        writeInFlight = true;
+        stream.Write(writing, static_cast<CallEvent*>(&writeEvent));
+    }
+
+    void tryFinish() {
+        if (finishing || !readsDone || writeInFlight) return;
+        if (!broken && !timedOut && mailbox->delivered() < expected) return;
+        finishing = true;
+        timeoutAlarm.Cancel();
+        Status status = timedOut ? Status(grpc::StatusCode::DEADLINE_EXCEEDED, "Vereditos não recebidos a tempo.")
+                                 : Status::OK;
+        stream.Finish(status, static_cast<CallEvent*>(&finishEvent));
+    }
+};
+
+TransactionServerImpl::~TransactionServerImpl() {
+    if (server) {
+        server->Shutdown();
+    }
+    for (auto& cq : cqs) {
+        cq->Shutdown();
+    }
+}
+
+void TransactionServerImpl::Run(const std::string& address) {
+    ServerBuilder builder;
+    builder.AddListeningPort(address, grpc::InsecureServerCredentials());
+    builder.RegisterService(&service);
+    for (size_t i = 0; i < numPollers; i++) {
+        cqs.push_back(builder.AddCompletionQueue());
+    }
+    server = builder.BuildAndStart();
+    std::cout << "Server listening on " << address << " with " << numPollers << " polling threads" << std::endl;
+
+    std::vector<std::thread> pollers;
+    for (auto& cq : cqs) {
+        pollers.emplace_back(&TransactionServerImpl::HandleRpcs, this, cq.get());
+    }
+    for (auto& poller : pollers) {
+        poller.join();
+    }
+}
+
+void TransactionServerImpl::HandleRpcs(grpc::ServerCompletionQueue* cq) {
+    for (int i = 0; i < pendingCallsPerQueue; i++) {
+        new SendTransactionCall(this, cq);
+        new StreamTransactionsCall(this, cq);
+    }
+    void* tag;
+    bool ok;
+    // Next só retorna false depois do Shutdown da fila, quando ela já foi esvaziada
+    while (cq->Next(&tag, &ok)) {
+        static_cast<CallEvent*>(tag)->Proceed(ok);
+    }
+}
+
 
 void RunServer() {
     //Building dataframe
@@ -1022,19 +1685,82 @@ void RunServer() {
     dfE1.addColumn<double>       ("valor_transacao");
     dfE1.addColumn<long long int>("timestamp_envio");
 
-    //Building trigger and manager
-    ServerTrigger* trigger = buildPipelineTransacoes();
-    PipelineManager* manager = new PipelineManager(*trigger, dfE1, 8, 1);
+    //Building shards: as transações são divididas pelo hash de id_usuario_pagador entre numShards
+    //managers independentes, cada um com seu estado por usuário e numPipelinesPerShard instâncias
+    //da pipeline (até numPipelinesPerShard batches do shard ao mesmo tempo), dividindo os núcleos
+    //entre todas as instâncias. As fontes em cache e os vereditos são compartilhados.
+    const size_t numShards = 4;
+    const size_t numPipelinesPerShard = 2;
+    const size_t threadsPerPipeline = std::max<size_t>(1, std::thread::hardware_concurrency() / (numShards * numPipelinesPerShard));
+    PipelineShared shared = buildPipelineShared();
+    // As sessões das instâncias referenciam o store do shard, então ele vive até o fim do servidor
+    std::vector<PipelineShared> shardShared(numShards, shared);
+    std::vector<PipelineManager*> shards;
+    // Log de ingestão de cada shard: o que foi aceito e não terminou de ser processado antes de uma
+    // queda é recuperado aqui e submetido de novo assim que os managers sobem
+    std::vector<IngestLog*> logs;
+    std::vector<std::shared_ptr<DataFrame>> recovered;
+    for (size_t s = 0; s < numShards; s++) {
+        shardShared[s].userState = std::make_shared<UserStateStore>();
+        std::vector<ServerTrigger*> triggers;
+        for (size_t i = 0; i < numPipelinesPerShard; i++) {
+            triggers.push_back(buildPipelineTransacoes(shardShared[s]));
+        }
+        logs.push_back(new IngestLog("wal/shard-" + std::to_string(s)));
+        for (auto& batch : logs[s]->recover(dfE1)) {
+            recovered.push_back(batch);
+        }
+        logs[s]->start();
+        shards.push_back(new PipelineManager(triggers, dfE1, threadsPerPipeline, 1));
+        shards[s]->setIngestLog(logs[s]);
+    }
+    ShardedPipelineManager* manager = new ShardedPipelineManager(shards, "id_usuario_pagador");
+    // Dispara buscando latência ponta a ponta de até 1s: batches pequenos com pouca carga,
+    // maiores (mais vazão) conforme a taxa de chegada cresce
+    const double targetLatencyMs = 1000.0;
+    manager->setTriggerPolicy([targetLatencyMs] { return std::make_unique<LatencySLOTriggerPolicy>(targetLatencyMs); });
+    // Memória limitada sob carga máxima: com 100 mil linhas esperando a pipeline (somando os shards)
+    // os streams param de ler até voltarem a 50 mil; batches que passariam de 200 mil são descartados
+    manager->setIngestLimits(50000 / numShards, 100000 / numShards, 200000 / numShards);
+
+    // Transações repetidas (reenvios do cliente, replays) são ignoradas por 10 minutos ou mais.
+    // As recuperadas do log já contam como recebidas: um reenvio delas depois da queda não repete.
+    DedupFilter::Options dedupOptions;
+    dedupOptions.window = std::chrono::minutes(10);
+    dedupOptions.expectedIds = 1 << 22;
+    DedupFilter dedup(dedupOptions);
+
+    // Execução que falhou ou foi cancelada: as transações do batch não chegaram ao VerdictTransformer,
+    // então recebem o veredito -1 (descartada) em vez de deixar o stream esperando até o drainTimeout,
+    // e saem do filtro de repetidas para que o reenvio do cliente seja processado
+    manager->setOnRunFailed([verdicts = shared.verdicts, &dedup](DataFrame& batch) {
+        forgetTransactions(dedup, batch);
+        verdicts->reject(batch);
+    });
     manager->start();
 
+    for (auto& batch : recovered) {
+        for (const auto& id : batch->getColumnData<std::string>(batch->getColumn("id_transacao")->getPosition())) {
+            dedup.insert(id);
+        }
+    }
+
+    // Reprocessa os batches recuperados (pelo hash da chave, cada linha volta ao seu shard) antes de
+    // atender clientes, respeitando os limites da ingestão
+    for (auto& batch : recovered) {
+        while (manager->pausedShard()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        manager->submitDataBatch(batch);
+    }
+    for (IngestLog* log : logs) {
+        log->discardRecovered();
+    }
+
     std::string server_address("0.0.0.0:50051");
-    TransactionServerImpl service(trigger, manager);
-    ServerBuilder builder;
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&service);
-    std::unique_ptr<Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
-    server->Wait();
+    const size_t numPollers = std::max<size_t>(2, std::thread::hardware_concurrency() / 4);
+    TransactionServerImpl service(manager, shared.verdicts, &dedup, dfE1, numPollers);
+    service.Run(server_address);
 }
 
 int main() {
@@ -0,0 +1,390 @@
+#include "ingestlog.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Cabeçalho de cada registro: magic, tamanho do payload, sequência e CRC32 do payload
+constexpr uint32_t recordMagic = 0x31474f4c; // "LOG1"
+constexpr size_t headerBytes = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+
+// CRC32 (polinômio do zlib) com 8 tabelas: oito bytes por iteração em vez de um
+uint32_t crc32(const char* data, size_t len) {
+    static const auto tables = [] {
+        std::array<std::array<uint32_t, 256>, 8> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) t[k][i] = t[0][t[k - 1][i] & 0xff] ^ (t[k - 1][i] >> 8);
+        }
+        return t;
+    }();
+    uint32_t c = 0xffffffffu;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, data + i, 4);
+        std::memcpy(&hi, data + i + 4, 4);
+        lo ^= c;
+        c = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+          ^ tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff] ^ tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24];
+    }
+    for (; i < len; i++) {
+        c = tables[0][(c ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T get(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+const std::string segmentPrefix = "segment-";
+const std::string segmentSuffix = ".wal";
+
+// Tentativas de gravar um grupo que falhou antes de desistir dele na parada
+constexpr int stoppingAttempts = 3;
+
+} // namespace
+
+IngestLog::IngestLog(const std::string& directory) : IngestLog(directory, Options()) {}
+
+IngestLog::IngestLog(const std::string& directory, Options options)
+    : directory(directory), options(options), queue(options.queueCapacity) {
+    std::filesystem::create_directories(directory);
+
+    std::ifstream checkpoint(std::filesystem::path(directory) / "checkpoint", std::ios::binary);
+    if (checkpoint) {
+        checkpoint.read(reinterpret_cast<char*>(&checkpointSequence), sizeof(checkpointSequence));
+        if (!checkpoint) checkpointSequence = 0;
+    }
+    writtenCheckpoint = checkpointSequence;
+
+    // Segmentos deixados por execuções anteriores, em ordem de índice
+    std::vector<std::pair<uint64_t, std::string>> found;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind(segmentPrefix, 0) != 0 || name.size() <= segmentPrefix.size() + segmentSuffix.size()
+            || name.compare(name.size() - segmentSuffix.size(), segmentSuffix.size(), segmentSuffix) != 0) {
+            continue;
+        }
+        uint64_t index = std::stoull(name.substr(segmentPrefix.size(), name.size() - segmentPrefix.size() - segmentSuffix.size()));
+        found.emplace_back(index, entry.path().string());
+    }
+    std::sort(found.begin(), found.end());
+    for (auto& [index, path] : found) {
+        oldSegments.push_back({path, 0});
+        nextSegmentIndex = index + 1;
+    }
+}
+
+IngestLog::~IngestLog() {
+    if (running.load()) {
+        {
+            std::lock_guard<std::mutex> lk(writerMutex);
+            running.store(false);
+        }
+        writerCv.notify_one();
+        writer.join();
+    }
+    if (fd >= 0) ::close(fd);
+}
+
+std::vector<std::shared_ptr<DataFrame>> IngestLog::recover(DataFrame schema) {
+    if (recovered || running.load()) {
+        throw std::logic_error("IngestLog: recover() must be called once, before start().");
+    }
+    std::vector<std::shared_ptr<DataFrame>> batches;
+    uint64_t maxSequence = checkpointSequence;
+    for (auto& segment : oldSegments) {
+        std::ifstream in(segment.path, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t pos = 0;
+        while (bytes.size() - pos >= headerBytes) {
+            const char* header = bytes.data() + pos;
+            uint32_t magic = get<uint32_t>(header);
+            uint32_t length = get<uint32_t>(header + 4);
+            uint64_t sequence = get<uint64_t>(header + 8);
+            uint32_t checksum = get<uint32_t>(header + 16);
+            if (magic != recordMagic || bytes.size() - pos - headerBytes < length
+                || crc32(header + headerBytes, length) != checksum) {
+                // Registro incompleto: a escrita foi interrompida aqui
+                std::cout << "IngestLog: ignoring torn record at " << segment.path << ":" << pos << std::endl;
+                break;
+            }
+            segment.maxSequence = std::max(segment.maxSequence, sequence);
+            maxSequence = std::max(maxSequence, sequence);
+            if (sequence > checkpointSequence) {
+                auto batch = schema.emptyCopy();
+                try {
+                    batch->appendBinary(header + headerBytes, length);
+                    batches.push_back(batch);
+                } catch (const std::exception& e) {
+                    std::cerr << "IngestLog: skipping unreadable batch " << sequence << ": " << e.what() << std::endl;
+                }
+            }
+            pos += headerBytes + length;
+        }
+    }
+    // Tudo o que é antigo ou já estava confirmado ou vai ser gravado de novo, com novas sequências
+    nextSequence.store(maxSequence + 1);
+    ackedUpTo.store(maxSequence);
+    statRecovered.store(batches.size());
+    recovered = true;
+    std::cout << "IngestLog: recovered " << batches.size() << " batch(es) from " << oldSegments.size()
+              << " segment(s) in " << directory << "." << std::endl;
+    return batches;
+}
+
+void IngestLog::start() {
+    if (running.load()) return;
+    if (!oldSegments.empty() && !recovered) {
+        throw std::logic_error("IngestLog: call recover() before start() when old segments exist.");
+    }
+    openSegment();
+    running.store(true);
+    writer = std::thread(&IngestLog::writerLoop, this);
+}
+
+void IngestLog::discardRecovered() {
+    flush();
+    std::lock_guard<std::mutex> lk(writerMutex);
+    for (const auto& segment : oldSegments) {
+        std::filesystem::remove(segment.path);
+    }
+    oldSegments.clear();
+}
+
+uint64_t IngestLog::append(DataFrame& batch) {
+    if (!running.load()) {
+        throw std::logic_error("IngestLog: append() before start().");
+    }
+    uint64_t sequence = nextSequence++;
+    Record record;
+    record.sequence = sequence;
+    // Reserva pelo maior registro visto: o payload não é realocado (e copiado) enquanto cresce.
+    // A dica só é escrita quando aumenta, então os produtores não disputam a linha de cache.
+    size_t hint = payloadHint.load(std::memory_order_relaxed);
+    record.payload.reserve(hint);
+    batch.writeBinary(record.payload);
+    if (record.payload.size() > hint) {
+        payloadHint.store(record.payload.size() + record.payload.size() / 8, std::memory_order_relaxed);
+    }
+    while (!queue.tryPush(std::move(record))) {
+        // Fila cheia: a thread de escrita está atrasada, pede uma escrita já
+        writerCv.notify_one();
+        std::this_thread::yield();
+    }
+    published++;
+    return sequence;
+}
+
+void IngestLog::acknowledge(const std::vector<uint64_t>& sequences) {
+    std::lock_guard<std::mutex> lk(ackMutex);
+    uint64_t upTo = ackedUpTo.load();
+    for (uint64_t sequence : sequences) {
+        if (sequence > upTo) outOfOrderAcks.insert(sequence);
+    }
+    while (!outOfOrderAcks.empty() && *outOfOrderAcks.begin() == upTo + 1) {
+        outOfOrderAcks.erase(outOfOrderAcks.begin());
+        upTo++;
+    }
+    ackedUpTo.store(upTo);
+}
+
+void IngestLog::flush() {
+    uint64_t target = published.load();
+    std::unique_lock<std::mutex> lk(writerMutex);
+    while (synced < target && running.load()) {
+        flushRequests++;
+        writerCv.notify_one();
+        syncedCv.wait(lk);
+    }
+}
+
+IngestLog::Stats IngestLog::getStats() const {
+    Stats stats;
+    stats.records = statRecords.load();
+    stats.bytes = statBytes.load();
+    stats.syncs = statSyncs.load();
+    stats.acknowledged = ackedUpTo.load();
+    stats.recovered = statRecovered.load();
+    return stats;
+}
+
+void IngestLog::writerLoop() {
+    std::unique_lock<std::mutex> lk(writerMutex);
+    while (true) {
+        writerCv.wait_for(lk, options.groupCommit, [this] { return flushRequests > 0 || !running.load(); });
+        bool stopping = !running.load();
+        flushRequests = 0;
+        lk.unlock();
+        size_t written = writeGroup();
+        collectSegments();
+        lk.lock();
+        synced += written;
+        syncedCv.notify_all();
+        if (stopping && !queue.readable()) break;
+    }
+}
+
+// Escreve de uma vez tudo o que está na fila e faz um único fdatasync. Se a escrita ou o
+// fdatasync falham, o grupo não conta como gravado (flush() continua esperando): o segmento é
+// fechado e o grupo inteiro é escrito de novo num segmento novo até dar certo. Só na parada,
+// depois de algumas tentativas, o grupo é abandonado.
+size_t IngestLog::writeGroup() {
+    std::string buffer;
+    size_t count = 0;
+    uint64_t maxSequence = 0;
+    Record record;
+    // Um grupo vai até o tamanho de um segmento: com produtores contínuos a fila nunca esvazia, e
+    // sem o limite o grupo (e o buffer) cresceria sem nunca chegar ao fdatasync
+    while (buffer.size() < options.segmentBytes && queue.tryPop(record)) {
+        if (buffer.capacity() - buffer.size() < headerBytes + record.payload.size()) {
+            buffer.reserve(std::max(2 * buffer.capacity(), buffer.size() + headerBytes + record.payload.size()));
+        }
+        put(buffer, recordMagic);
+        put(buffer, static_cast<uint32_t>(record.payload.size()));
+        put(buffer, record.sequence);
+        put(buffer, crc32(record.payload.data(), record.payload.size()));
+        buffer.append(record.payload);
+        maxSequence = std::max(maxSequence, record.sequence);
+        count++;
+    }
+    if (count == 0) return 0;
+
+    auto backoff = std::chrono::milliseconds(10);
+    for (int attempt = 1; !writeAll(buffer); attempt++) {
+        if (!running.load() && attempt >= stoppingAttempts) {
+            std::cerr << "IngestLog: giving up on " << count << " record(s) at shutdown; they were not made durable."
+                      << std::endl;
+            return 0;
+        }
+        // O que ficou no segmento depois da última escrita boa é descartado; se o ftruncate também
+        // falhar, recover() para no registro cortado, e os seguintes vão para o segmento novo
+        if (fd >= 0) {
+            if (::ftruncate(fd, static_cast<off_t>(currentBytes)) != 0) {
+                std::cerr << "IngestLog: cannot truncate " << current.path << ": " << std::strerror(errno) << std::endl;
+            }
+            closeSegment();
+        }
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(2 * backoff, std::chrono::milliseconds(1000));
+        try {
+            openSegment();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    current.maxSequence = std::max(current.maxSequence, maxSequence);
+    statRecords += count;
+    statBytes += buffer.size();
+    statSyncs++;
+
+    currentBytes += buffer.size();
+    if (currentBytes >= options.segmentBytes) {
+        closeSegment();
+        try {
+            openSegment();
+        } catch (const std::exception& e) {
+            // O próximo grupo tenta abrir de novo
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    return count;
+}
+
+// Escreve o buffer inteiro no segmento atual e faz o fdatasync; false se algo falhou
+bool IngestLog::writeAll(const std::string& buffer) {
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "IngestLog: write failed on " << current.path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    if (::fdatasync(fd) != 0) {
+        // Depois de um fdatasync com erro não dá para saber o que chegou ao disco: escreve de novo
+        std::cerr << "IngestLog: fdatasync failed on " << current.path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void IngestLog::openSegment() {
+    current = {segmentPath(nextSegmentIndex++), 0};
+    currentBytes = 0;
+    fd = ::open(current.path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("IngestLog: cannot open " + current.path + ": " + std::strerror(errno));
+    }
+}
+
+void IngestLog::closeSegment() {
+    ::close(fd);
+    fd = -1;
+    closedSegments.push_back(current);
+}
+
+// Apaga os segmentos fechados já confirmados e atualiza o checkpoint
+void IngestLog::collectSegments() {
+    uint64_t upTo = ackedUpTo.load();
+    closedSegments.erase(std::remove_if(closedSegments.begin(), closedSegments.end(), [upTo](const Segment& segment) {
+        if (segment.maxSequence > upTo) return false;
+        std::filesystem::remove(segment.path);
+        return true;
+    }), closedSegments.end());
+
+    // Enquanto os segmentos antigos existem, o checkpoint não pode cobrir as sequências deles
+    std::lock_guard<std::mutex> lk(writerMutex);
+    if (oldSegments.empty() && upTo > writtenCheckpoint) {
+        writeCheckpoint(upTo);
+    }
+}
+
+void IngestLog::writeCheckpoint(uint64_t sequence) {
+    auto path = std::filesystem::path(directory) / "checkpoint";
+    auto tmp = std::filesystem::path(directory) / "checkpoint.tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+    }
+    std::filesystem::rename(tmp, path);
+    writtenCheckpoint = sequence;
+}
+
+std::string IngestLog::segmentPath(uint64_t index) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%012llu%s", segmentPrefix.c_str(),
+                  static_cast<unsigned long long>(index), segmentSuffix.c_str());
+    return (std::filesystem::path(directory) / name).string();
+}
@@ -1,9 +1,17 @@
 #include "pipelinemanager.hpp"
 #include <iostream>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
 
 // Construtor
 PipelineManager::PipelineManager(ServerTrigger& trigger, DataFrame empty_df_template, size_t pipelineNumThreads, size_t df_trigger_size)
-    : pipeline_trigger(trigger),              // Inicializa a referência
+    : PipelineManager(std::vector<ServerTrigger*>{&trigger}, std::move(empty_df_template), pipelineNumThreads, df_trigger_size) {}
+
+PipelineManager::PipelineManager(std::vector<ServerTrigger*> triggers, DataFrame empty_df_template, size_t pipelineNumThreads, size_t df_trigger_size)
+    : pipeline_triggers(std::move(triggers)),  // Instâncias da pipeline
+      orchestratorThreads(pipeline_triggers.size()),
       pipelineNumThreads(pipelineNumThreads), // Número de threads padrão para a pipeline
       df_trigger_size(df_trigger_size),       // Inicializa o tamanho do trigger
       running(false) {                        // Atomic bool inicializado como false
@@ -12,10 +20,26 @@ PipelineManager::PipelineManager(ServerTrigger& trigger, DataFrame empty_df_temp
         std::cerr << "PipelineManager: Error - empty_df_template should be empty." << std::endl;
         throw std::invalid_argument("empty_df_template is not empty.");
     }
+    if(pipeline_triggers.empty()) {
+        throw std::invalid_argument("PipelineManager: no pipeline instances.");
+    }
 
-    waiting_dataframe = empty_df_template;
-    running_dataframe = empty_df_template;
-    std::cout << "PipelineManager: Constructed." << std::endl;
+    // Quando uma instância termina, o loop reavalia o disparo: linhas que ficaram esperando
+    // porque todas as instâncias estavam ocupadas não dependem da chegada de um novo batch.
+    // O tempo da execução alimenta o critério de disparo.
+    for (size_t i = 0; i < pipeline_triggers.size(); i++) {
+        pipeline_triggers[i]->setOnFinish([this, i](size_t rows, double elapsedMs, bool committed) {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            finished_runs.push_back({i, rows, elapsedMs, committed});
+            queue_cv.notify_one();
+        });
+    }
+    running_sequences.resize(pipeline_triggers.size());
+    running_batches.resize(pipeline_triggers.size());
+    trigger_policy = std::make_unique<SizeTriggerPolicy>(df_trigger_size);
+
+    waiting_dataframe = empty_df_template.emptyCopy();
+    std::cout << "PipelineManager: Constructed with " << pipeline_triggers.size() << " pipeline instance(s)." << std::endl;
 }
 
 // Destrutor
@@ -27,18 +51,145 @@ PipelineManager::~PipelineManager() {
 }
 
 // Método para o servidor gRPC (ou outro produtor) submeter um batch.
-void PipelineManager::submitDataBatch(DataBatch batch) {
+bool PipelineManager::submitDataBatch(std::shared_ptr<DataFrame> batch) {
     if (!running.load()) {
         std::cout << "PipelineManager: Not running, cannot submit data batch." << std::endl;
+        return false;
+    }
+    size_t rows = batch ? batch->size() : 0;
+
+    // Reserva as linhas no total pendente, respeitando maxPendingRows. Um fetch_add por submit, sem
+    // laço de CAS que se repete a cada produtor que passa na frente; a reserva que estoura o limite
+    // é desfeita (enquanto isso, outro produtor perto do limite pode ser recusado junto). O pico é
+    // medido pela worker_thread, que é quem diminui as pendentes.
+    if (max_pending_rows > 0 && pending_rows.load(std::memory_order_relaxed) + rows > max_pending_rows) {
+        dropBatch(rows);
+        return false;
+    }
+    size_t pending = pending_rows.fetch_add(rows) + rows;
+    if (max_pending_rows > 0 && pending > max_pending_rows) {
+        pending_rows -= rows;
+        dropBatch(rows);
+        return false;
+    }
+    if (high_watermark > 0 && pending >= high_watermark && accepting.load()) {
+        pauseIfAbove();
+    }
+
+    // Durável (em até o intervalo de group commit do log) antes de chegar à pipeline
+    uint64_t sequence = (ingest_log && rows > 0) ? ingest_log->append(*batch) : 0;
+
+    QueuedBatch queued{std::move(batch), TriggerPolicy::Clock::now(), sequence};
+    if (!ingress.tryPush(std::move(queued))) {
+        // Fila de entrada cheia (muitos batches pequenos): espera a worker_thread abrir espaço
+        ingress_full_waits++;
+        do {
+            if (!running.load()) {
+                pending_rows -= rows;
+                if (sequence) ingest_log->acknowledge({sequence}); // recusado: não deve ser reprocessado
+                return false;
+            }
+            wakeConsumer();
+            std::this_thread::yield();
+        } while (!ingress.tryPush(std::move(queued)));
+    }
+    wakeConsumer(); // Notifica a worker_thread que há novos dados
+    return true;
+}
+
+void PipelineManager::dropBatch(size_t rows) {
+    dropped_batches++;
+    dropped_rows += rows;
+}
+
+void PipelineManager::wakeConsumer() {
+    // Par com processingLoop: ou a worker_thread vê o batch publicado antes de dormir, ou
+    // o produtor vê consumer_sleeping e a acorda sob o mutex (sem perder a notificação)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_sleeping.load()) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue_cv.notify_one();
+    }
+}
+
+// Acima do limite: os produtores param de ler até as pendentes voltarem ao lowWatermark
+void PipelineManager::pauseIfAbove() {
+    std::lock_guard<std::mutex> lock(ingest_mutex);
+    if (paused) return;
+    // accepting cai antes de reler as pendentes: se a worker_thread liberou linhas depois dessa
+    // leitura, ela vê accepting == false e retoma a ingestão em releasePending
+    accepting.store(false);
+    if (pending_rows.load() < high_watermark) {
+        accepting.store(true);
+        return;
+    }
+    paused = true;
+    paused_since = TriggerPolicy::Clock::now();
+    pauses++;
+}
+
+void PipelineManager::setIngestLimits(size_t lowWatermark, size_t highWatermark, size_t maxPendingRows) {
+    if (lowWatermark > highWatermark || (maxPendingRows > 0 && highWatermark > maxPendingRows)) {
+        throw std::invalid_argument("PipelineManager: expected lowWatermark <= highWatermark <= maxPendingRows.");
+    }
+    if (running.load()) {
+        std::cout << "PipelineManager: Cannot change ingest limits while running." << std::endl;
         return;
     }
-    std::cout << "PipelineManager: Submitting data batch." << std::endl;
+    low_watermark = lowWatermark;
+    high_watermark = highWatermark;
+    max_pending_rows = maxPendingRows;
+}
+
+void PipelineManager::whenAccepting(std::function<void()> callback) {
     {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        batchs_queue.push(std::move(batch));
+        std::lock_guard<std::mutex> lock(ingest_mutex);
+        if (paused) {
+            resume_listeners.push_back(std::move(callback));
+            return;
+        }
+    }
+    callback();
+}
+
+PipelineManager::IngestStats PipelineManager::getIngestStats() const {
+    IngestStats current;
+    current.pendingRows = pending_rows.load();
+    current.peakPendingRows = std::max(peak_pending_rows.load(), clampedPending());
+    current.droppedBatches = dropped_batches.load();
+    current.droppedRows = dropped_rows.load();
+    current.ingressFullWaits = ingress_full_waits.load();
+    std::lock_guard<std::mutex> lock(ingest_mutex);
+    current.pauses = pauses;
+    current.pausedMs = paused_ms;
+    if (paused) {
+        current.pausedMs += std::chrono::duration<double, std::milli>(TriggerPolicy::Clock::now() - paused_since).count();
+    }
+    return current;
+}
+
+void PipelineManager::setIngestLog(IngestLog* log) {
+    if (running.load()) {
+        std::cout << "PipelineManager: Cannot change ingest log while running." << std::endl;
+        return;
+    }
+    ingest_log = log;
+}
+
+void PipelineManager::setOnRunFailed(std::function<void(DataFrame&)> callback) {
+    if (running.load()) {
+        std::cout << "PipelineManager: Cannot change the failed run callback while running." << std::endl;
+        return;
+    }
+    on_run_failed = std::move(callback);
+}
+
+void PipelineManager::setTriggerPolicy(std::unique_ptr<TriggerPolicy> policy) {
+    if (running.load()) {
+        std::cout << "PipelineManager: Cannot change trigger policy while running." << std::endl;
+        return;
     }
-    queue_cv.notify_one(); // Notifica a worker_thread que há novos dados
-    std::cout << "PipelineManager: batchs_queue.size() = " << batchs_queue.size() << std::endl;
+    trigger_policy = std::move(policy);
 }
 
 // Inicia a thread de processamento interna do PipelineManager.
@@ -64,69 +215,187 @@ void PipelineManager::stop() {
     if (worker_thread.joinable()) {
         worker_thread.join();
     }
-    if (orchestratorThread.joinable()) {
-        orchestratorThread.join(); // Garante que a thread da pipeline também seja juntada
+    // Produtores em pausa são liberados: seus próximos batches serão recusados
+    std::vector<std::function<void()>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(ingest_mutex);
+        resumed.swap(resume_listeners);
+    }
+    for (auto& callback : resumed) {
+        callback();
+    }
+    for (auto& orchestratorThread : orchestratorThreads) {
+        if (orchestratorThread.joinable()) {
+            orchestratorThread.join(); // Garante que as threads da pipeline também sejam juntadas
+        }
     }
     std::cout << "PipelineManager: Worker thread stopped and joined." << std::endl;
 }
 
 // Loop principal executado pela thread interna do PipelineManager.
 void PipelineManager::processingLoop() {
-    // Mantém uma cópia local do template vazio para resetar o waiting_dataframe.
-    DataFrame local_empty_template = waiting_dataframe; // Captura o estado inicial (estrutura)
-
     while (running.load()) {
         // std::cout << "PipelineManager: processingLoop loop" << std::endl;
-        DataBatch current_data_batch;
+        std::vector<QueuedBatch> arrived;
+        std::vector<FinishedRun> finished;
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
-            // Espera até que a fila não esteja vazia OU o PipelineManager não esteja mais rodando
-            queue_cv.wait(lock, [this] {
-                return !batchs_queue.empty() || !running.load();
-            });
+            // Espera até chegar um batch, uma execução terminar, o PipelineManager parar
+            // ou o instante em que o critério de disparo pediu para ser reavaliado
+            auto wakeup = [this] {
+                return ingress.readable() || !finished_runs.empty() || !running.load();
+            };
+            TriggerState state = currentState();
+            auto next = TriggerPolicy::Clock::time_point::max();
+            if (state.pendingRows > 0 && state.freeInstances > 0) {
+                next = trigger_policy->nextCheck(state);
+            }
+            consumer_sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (next == TriggerPolicy::Clock::time_point::max()) {
+                queue_cv.wait(lock, wakeup);
+            } else {
+                queue_cv.wait_until(lock, next, wakeup);
+            }
+            consumer_sleeping.store(false);
 
-            if (!running.load() && batchs_queue.empty()) {
+            if (!running.load() && !ingress.readable()) {
                 // PipelineManager parando e fila vazia, sair do loop
                 break;
             }
+            finished.swap(finished_runs);
+        }
 
-            if (batchs_queue.empty()) {
-                continue;
-            }
+        // Tudo o que chegou entra de uma vez no DataFrame acumulado
+        QueuedBatch queued;
+        while (ingress.tryPop(queued)) {
+            arrived.push_back(std::move(queued));
+        }
 
-            current_data_batch = std::move(batchs_queue.front());
-            batchs_queue.pop();
+        for (const auto& run : finished) {
+            // O tempo de uma execução que falhou no meio não diz quanto custa um batch
+            if (run.committed) trigger_policy->onRunFinished(run.rows, run.elapsedMs);
+            if (ingest_log && !running_sequences[run.instance].empty()) {
+                // Só o que foi confirmado sai do log. Os batches de uma execução que falhou ficam sem
+                // confirmação e voltam no recover() da próxima inicialização
+                if (run.committed) {
+                    ingest_log->acknowledge(running_sequences[run.instance].front());
+                } else {
+                    std::cerr << "PipelineManager: run failed, keeping " << running_sequences[run.instance].front().size()
+                              << " batch(es) in the ingest log for replay." << std::endl;
+                }
+                running_sequences[run.instance].pop_front();
+            }
+            if (on_run_failed && !running_batches[run.instance].empty()) {
+                if (!run.committed) on_run_failed(*running_batches[run.instance].front());
+                running_batches[run.instance].pop_front();
+            }
         }
 
-        // Adiciona os dados do batch recebido ao waiting_dataframe
-        if (!current_data_batch.empty()) {
-            std::cout << "PipelineManager: Adding batch of size " << current_data_batch.size() << std::endl;
-            std::cout << "PipelineManager: waiting_dataframe.size() " << waiting_dataframe.size() << std::endl;
-            for (const auto& row : current_data_batch) {
-                waiting_dataframe.addRow(row);
+        // Adiciona os dados dos batches recebidos ao waiting_dataframe, coluna a coluna
+        for (auto& batch : arrived) {
+            size_t rows = batch.rows ? batch.rows->size() : 0;
+            if (rows == 0) continue;
+            std::cout << "PipelineManager: Adding batch of size " << rows << std::endl;
+            if (waiting_dataframe->size() == 0) {
+                // Nada acumulado: o próprio batch passa a ser o DataFrame acumulado, sem cópia
+                oldest_pending = batch.arrival;
+                waiting_dataframe = std::move(batch.rows);
+            } else {
+                waiting_dataframe->append(*batch.rows);
             }
-            std::cout << "PipelineManager: waiting_dataframe.size() " << waiting_dataframe.size() << std::endl;
+            trigger_policy->onArrival(rows, batch.arrival);
+            if (batch.sequence) waiting_sequences.push_back(batch.sequence);
+            std::cout << "PipelineManager: waiting_dataframe.size() " << waiting_dataframe->size() << std::endl;
         }
 
         // Lógica para decidir quando disparar a pipeline
-        bool flag_trigger_pipeline = !pipeline_trigger.isBusy() && 
-                                      waiting_dataframe.size() > 0 && 
-                                      waiting_dataframe.size() > df_trigger_size;
+        TriggerState state = currentState();
+        int instance = freeInstance();
+        bool flag_trigger_pipeline = instance >= 0 && 
+                                      state.pendingRows > 0 && 
+                                      trigger_policy->shouldTrigger(state);
         
         if (flag_trigger_pipeline) {
+            std::thread& orchestratorThread = orchestratorThreads[instance];
             if(orchestratorThread.joinable()) {
-                std::cout << "PipelineManager: Waiting for orchestrator thread to finish." << std::endl;
+                // A instância está livre, então a execução anterior dela já terminou
                 orchestratorThread.join();
             }
             std::cout << "PipelineManager Thread ID" << std::this_thread::get_id() << " executando a pipeline ###@@@" << std::endl;
 
-            // Prepara os dados para a pipeline.
-            running_dataframe = waiting_dataframe;
-            waiting_dataframe = *waiting_dataframe.emptyCopy();
+            // Entrega o DataFrame acumulado para a pipeline e começa um novo, vazio, para os próximos batches
+            auto running_dataframe = std::exchange(waiting_dataframe, waiting_dataframe->emptyCopy());
+            if (ingest_log) {
+                running_sequences[instance].push_back(std::exchange(waiting_sequences, {}));
+            }
+            if (on_run_failed) {
+                running_batches[instance].push_back(running_dataframe);
+            }
 
-            std::cout << "PipelineManager: Triggering pipeline with " << running_dataframe.size() << " rows." << std::endl;
-            orchestratorThread = pipeline_trigger.start(pipelineNumThreads, std::make_shared<DataFrame>(running_dataframe));
+            size_t rows = running_dataframe->size();
+            std::cout << "PipelineManager: Triggering pipeline instance " << instance << " with " << rows << " rows." << std::endl;
+            orchestratorThread = pipeline_triggers[instance]->start(pipelineNumThreads, std::move(running_dataframe));
+            releasePending(rows);
+
+            IngestStats ingest = getIngestStats();
+            if (ingest.pauses > 0 || ingest.droppedBatches > 0) {
+                std::cout << "PipelineManager: ingest - pending " << ingest.pendingRows
+                          << " (peak " << ingest.peakPendingRows << ") rows, " << ingest.pauses
+                          << " pause(s) totaling " << ingest.pausedMs << " ms, dropped "
+                          << ingest.droppedRows << " rows in " << ingest.droppedBatches << " batch(es)." << std::endl;
+            }
         }
     }
     std::cout << "PipelineManager: Processing loop finished." << std::endl;
 }
+
+TriggerState PipelineManager::currentState() const {
+    TriggerState state;
+    state.pendingRows = waiting_dataframe->size();
+    state.totalInstances = pipeline_triggers.size();
+    for (ServerTrigger* trigger : pipeline_triggers) {
+        if (!trigger->isBusy()) state.freeInstances++;
+    }
+    state.oldestArrival = oldest_pending;
+    state.now = TriggerPolicy::Clock::now();
+    return state;
+}
+
+int PipelineManager::freeInstance() const {
+    for (size_t i = 0; i < pipeline_triggers.size(); i++) {
+        if (!pipeline_triggers[i]->isBusy()) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Pendentes sem as reservas acima de maxPendingRows que ainda vão ser desfeitas
+size_t PipelineManager::clampedPending() const {
+    size_t pending = pending_rows.load();
+    return max_pending_rows > 0 ? std::min(pending, max_pending_rows) : pending;
+}
+
+// Linhas entregues à pipeline deixam de contar para os limites da ingestão
+void PipelineManager::releasePending(size_t rows) {
+    // As pendentes só diminuem aqui: o máximo delas é visto logo antes de cada entrega
+    // (ou agora, em getIngestStats). Só a worker_thread escreve o pico.
+    size_t pending = clampedPending();
+    if (pending > peak_pending_rows.load(std::memory_order_relaxed)) peak_pending_rows.store(pending);
+    pending_rows -= rows;
+    if (accepting.load()) return;
+    std::vector<std::function<void()>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(ingest_mutex);
+        if (paused && pending_rows.load() <= low_watermark) {
+            paused = false;
+            accepting.store(true);
+            paused_ms += std::chrono::duration<double, std::milli>(TriggerPolicy::Clock::now() - paused_since).count();
+            resumed.swap(resume_listeners);
+        }
+    }
+    for (auto& callback : resumed) {
+        callback();
+    }
+}
@@ -0,0 +1,153 @@
+#include "pipelinetrace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+double millis(PipelineTrace::Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+PipelineTrace::PipelineTrace(uint64_t runId, int maxThreads) : runId(runId), maxThreads(maxThreads) {}
+
+void PipelineTrace::begin() {
+    runStart = Clock::now();
+    runEnd = runStart;
+    spans.clear();
+}
+
+void PipelineTrace::add(TaskSpan span) {
+    spans.push_back(std::move(span));
+}
+
+void PipelineTrace::finish() {
+    runEnd = Clock::now();
+}
+
+double PipelineTrace::totalMs() const {
+    return millis(runEnd - runStart);
+}
+
+std::string PipelineTrace::toChromeJson() const {
+    auto micros = [this](Clock::time_point t) {
+        return std::chrono::duration<double, std::micro>(t - runStart).count();
+    };
+
+    // Cada thread de cada task vira um intervalo; intervalos que não se sobrepõem dividem a mesma
+    // linha do tempo (as threads das tasks são criadas e terminam a cada disparo)
+    struct Slice {
+        Clock::time_point start, end;
+        size_t span;
+        size_t thread;
+        int lane = 0;
+    };
+    std::vector<Slice> slices;
+    for (size_t s = 0; s < spans.size(); s++) {
+        const auto& span = spans[s];
+        if (span.threadEnds.empty()) {
+            slices.push_back({span.start, span.end, s, 0});
+        }
+        for (size_t t = 0; t < span.threadEnds.size(); t++) {
+            slices.push_back({span.start, std::max(span.start, span.threadEnds[t]), s, t});
+        }
+    }
+    std::sort(slices.begin(), slices.end(), [](const Slice& a, const Slice& b) {
+        return std::tie(a.start, a.span, a.thread) < std::tie(b.start, b.span, b.thread);
+    });
+    std::vector<Clock::time_point> laneFree;
+    for (auto& slice : slices) {
+        size_t lane = 0;
+        while (lane < laneFree.size() && laneFree[lane] > slice.start) lane++;
+        if (lane == laneFree.size()) laneFree.push_back(slice.end);
+        laneFree[lane] = slice.end;
+        slice.lane = static_cast<int>(lane) + 1; // linha 0 é a do orquestrador
+    }
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    const std::string pid = std::to_string(runId);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":"
+        << jsonString("pipeline (execução " + pid + ")") << "}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\"orquestrador\"}}";
+    for (size_t lane = 1; lane <= laneFree.size(); lane++) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << lane
+            << ",\"args\":{\"name\":\"thread " << lane << "\"}}";
+    }
+    out << ",\n{\"name\":\"execução\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":0,\"ts\":0,\"dur\":"
+        << micros(runEnd) << ",\"args\":{\"tasks\":" << spans.size() << ",\"max_threads\":" << maxThreads << "}}";
+
+    for (const auto& slice : slices) {
+        const auto& span = spans[slice.span];
+        out << ",\n{\"name\":" << jsonString(span.task) << ",\"cat\":\"task\",\"ph\":\"X\",\"pid\":" << pid
+            << ",\"tid\":" << slice.lane << ",\"ts\":" << micros(slice.start) << ",\"dur\":" << micros(slice.end) - micros(slice.start)
+            << ",\"args\":{\"thread\":" << slice.thread << ",\"threads\":" << span.threadEnds.size()
+            << ",\"rows_in\":" << span.rowsIn << ",\"rows_out\":" << span.rowsOut << ",\"bytes_out\":" << span.bytesOut
+            << ",\"queue_wait_ms\":" << millis(span.start - span.ready) << "}}";
+    }
+    // Espera na fila do orquestrador: eventos assíncronos, porque várias tasks esperam ao mesmo tempo
+    for (size_t s = 0; s < spans.size(); s++) {
+        const auto& span = spans[s];
+        if (span.start <= span.ready) continue;
+        std::string name = jsonString("fila: " + span.task);
+        out << ",\n{\"name\":" << name << ",\"cat\":\"fila\",\"ph\":\"b\",\"id\":" << s << ",\"pid\":" << pid
+            << ",\"tid\":0,\"ts\":" << micros(span.ready) << "}";
+        out << ",\n{\"name\":" << name << ",\"cat\":\"fila\",\"ph\":\"e\",\"id\":" << s << ",\"pid\":" << pid
+            << ",\"tid\":0,\"ts\":" << micros(span.start) << "}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+void PipelineTrace::writeChromeJson(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("PipelineTrace: cannot write " + path);
+    }
+    file << toChromeJson();
+}
+
+std::string PipelineTrace::summary() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "Execução " << runId << ": " << totalMs() << " ms, " << spans.size() << " task(s), até "
+        << maxThreads << " thread(s)\n";
+    for (const auto& span : spans) {
+        out << "  " << std::left << std::setw(12) << span.task << std::right
+            << " fila " << std::setw(8) << millis(span.start - span.ready) << " ms"
+            << " | " << std::setw(8) << millis(span.end - span.start) << " ms"
+            << " | " << std::setw(2) << span.threadEnds.size() << " thread(s)"
+            << " | " << span.rowsIn << " -> " << span.rowsOut << " linhas"
+            << " | " << span.bytesOut / 1024.0 << " KB\n";
+    }
+    return out.str();
+}
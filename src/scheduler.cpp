@@ -0,0 +1,175 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <set>
+#include <utility>
+
+namespace {
+
+std::vector<size_t> topologicalOrder(const std::vector<ScheduleTask>& dag) {
+    std::vector<int> indegree(dag.size(), 0);
+    for (const auto& task : dag) {
+        for (size_t next : task.next) indegree[next]++;
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0; i < dag.size(); i++) {
+        if (indegree[i] == 0) order.push_back(i);
+    }
+    for (size_t k = 0; k < order.size(); k++) {
+        for (size_t next : dag[order[k]].next) {
+            if (--indegree[next] == 0) order.push_back(next);
+        }
+    }
+    return order;
+}
+
+int threadLimit(const ScheduleTask& task, int maxThreads) {
+    if (!task.parallel) return 1;
+    return std::clamp(static_cast<int>(std::ceil(maxThreads * task.maxThreadsProportion)), 1, maxThreads);
+}
+
+// Lista de tarefas em tempo simulado: dispara as prontas por prioridade enquanto houver threads, com
+// chooseThreads(task, próxima da fila ou nullptr, threads livres) decidindo quantas cada uma usa
+template <typename ChooseThreads>
+SimulationResult runSimulation(const std::vector<ScheduleTask>& dag, int maxThreads,
+                               const std::vector<double>& priority, ChooseThreads chooseThreads) {
+    SimulationResult result;
+    const size_t n = dag.size();
+    result.startMs.assign(n, 0.0);
+    result.endMs.assign(n, 0.0);
+    result.threads.assign(n, 0);
+    for (const auto& task : dag) result.tasks.push_back(task.name);
+
+    auto cmp = [&](size_t a, size_t b) {
+        return priority[a] > priority[b] || (priority[a] == priority[b] && dag[a].name < dag[b].name);
+    };
+    std::set<size_t, decltype(cmp)> ready(cmp);
+
+    std::vector<int> indegree(n, 0);
+    for (const auto& task : dag) {
+        for (size_t next : task.next) indegree[next]++;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (indegree[i] == 0) ready.insert(i);
+    }
+
+    // (fim previsto, task) das tasks em execução
+    std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, std::greater<>> running;
+    double now = 0.0;
+    int usedThreads = 0;
+    while (!ready.empty() || !running.empty()) {
+        while (!ready.empty() && usedThreads < maxThreads) {
+            size_t task = *ready.begin();
+            ready.erase(ready.begin());
+            const int availableThreads = maxThreads - usedThreads;
+            const size_t* next = ready.empty() ? nullptr : &*ready.begin();
+            int threads = std::clamp(chooseThreads(task, next, availableThreads), 1, availableThreads);
+
+            result.startMs[task] = now;
+            result.threads[task] = threads;
+            running.push({now + dag[task].model.predictMs(threads), task});
+            usedThreads += threads;
+        }
+
+        auto [end, task] = running.top();
+        running.pop();
+        now = end;
+        result.endMs[task] = end;
+        usedThreads -= result.threads[task];
+        for (size_t next : dag[task].next) {
+            if (--indegree[next] == 0) ready.insert(next);
+        }
+    }
+    result.makespanMs = now;
+    return result;
+}
+
+double simulatePlan(const std::vector<ScheduleTask>& dag, int maxThreads, const SchedulePlan& plan) {
+    return runSimulation(dag, maxThreads, plan.rank,
+                         [&](size_t task, const size_t*, int) { return plan.threads[task]; }).makespanMs;
+}
+
+}
+
+SchedulePlan planCriticalPath(const std::vector<ScheduleTask>& dag, int maxThreads) {
+    SchedulePlan plan;
+    const size_t n = dag.size();
+    maxThreads = std::max(maxThreads, 1);
+    plan.threads.assign(n, 1);
+    plan.rank.assign(n, 0.0);
+    if (n == 0) return plan;
+
+    const auto order = topologicalOrder(dag);
+    // Recalcula os ranks (caminho crítico de cada task até o fim), o caminho crítico e a área
+    auto evaluate = [&](SchedulePlan& candidate) {
+        double work = 0.0;
+        candidate.criticalPathMs = 0.0;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            double time = dag[*it].model.predictMs(candidate.threads[*it]);
+            double tail = 0.0;
+            for (size_t next : dag[*it].next) tail = std::max(tail, candidate.rank[next]);
+            candidate.rank[*it] = time + tail;
+            candidate.criticalPathMs = std::max(candidate.criticalPathMs, candidate.rank[*it]);
+            work += time * candidate.threads[*it];
+        }
+        candidate.areaMs = work / maxThreads;
+    };
+
+    // O CPA para de dar threads quando o caminho crítico chega à área; como as tasks dividem as mesmas
+    // threads, cada passo também é conferido na simulação e só é aceito se diminuir o makespan
+    evaluate(plan);
+    double makespan = simulatePlan(dag, maxThreads, plan);
+    while (plan.criticalPathMs > plan.areaMs) {
+        SchedulePlan best;
+        double bestMakespan = makespan;
+        // Percorre o caminho crítico (a task de maior rank e, a cada passo, a próxima de maior rank)
+        size_t crr = std::max_element(plan.rank.begin(), plan.rank.end()) - plan.rank.begin();
+        while (true) {
+            if (plan.threads[crr] < threadLimit(dag[crr], maxThreads)) {
+                SchedulePlan candidate = plan;
+                candidate.threads[crr]++;
+                evaluate(candidate);
+                double candidateMakespan = simulatePlan(dag, maxThreads, candidate);
+                if (candidateMakespan < bestMakespan) {
+                    bestMakespan = candidateMakespan;
+                    best = std::move(candidate);
+                }
+            }
+            const auto& next = dag[crr].next;
+            if (next.empty()) break;
+            crr = *std::max_element(next.begin(), next.end(),
+                                    [&](size_t a, size_t b) { return plan.rank[a] < plan.rank[b]; });
+        }
+        if (best.threads.empty()) break; // mais threads no caminho crítico não encurta a execução
+        plan = std::move(best);
+        makespan = bestMakespan;
+    }
+    return plan;
+}
+
+int weightedThreads(bool parallel, double maxThreadsProportion, double weight,
+                    bool hasNext, double nextWeight, int availableThreads) {
+    if (!parallel) return 1;
+    if (!hasNext) {
+        return std::min(availableThreads, static_cast<int>(std::ceil(availableThreads * maxThreadsProportion)));
+    }
+    return static_cast<int>(std::ceil(weight / (weight + nextWeight) * availableThreads));
+}
+
+SimulationResult simulateSchedule(const std::vector<ScheduleTask>& dag, int maxThreads, SchedulingPolicy policy) {
+    maxThreads = std::max(maxThreads, 1);
+    if (policy == SchedulingPolicy::CriticalPath) {
+        SchedulePlan plan = planCriticalPath(dag, maxThreads);
+        return runSimulation(dag, maxThreads, plan.rank,
+                             [&](size_t task, const size_t*, int) { return plan.threads[task]; });
+    }
+    std::vector<double> priority;
+    for (const auto& task : dag) priority.push_back(task.finalWeight);
+    return runSimulation(dag, maxThreads, priority, [&](size_t task, const size_t* next, int availableThreads) {
+        return weightedThreads(dag[task].parallel, dag[task].maxThreadsProportion, dag[task].finalWeight,
+                               next != nullptr, next ? dag[*next].finalWeight : 0.0, availableThreads);
+    });
+}
@@ -0,0 +1,93 @@
+#include "shardedpipelinemanager.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+ShardedPipelineManager::ShardedPipelineManager(std::vector<PipelineManager*> shards, std::string keyColumn)
+    : shards(std::move(shards)), keyColumn(std::move(keyColumn)) {
+    if (this->shards.empty()) {
+        throw std::invalid_argument("ShardedPipelineManager: no shards.");
+    }
+    std::cout << "ShardedPipelineManager: " << this->shards.size() << " shard(s) by " << this->keyColumn << "." << std::endl;
+}
+
+ShardedPipelineManager::~ShardedPipelineManager() {
+    for (PipelineManager* manager : shards) {
+        delete manager; // o destrutor para o manager se ainda estiver rodando
+    }
+}
+
+bool ShardedPipelineManager::submitDataBatch(std::shared_ptr<DataFrame> batch) {
+    if (!batch || batch->size() == 0) return true;
+    if (shards.size() == 1) return shards[0]->submitDataBatch(std::move(batch));
+
+    const auto& keys = batch->getColumnData<std::string>(batch->getColumn(keyColumn)->getPosition());
+    std::vector<std::vector<size_t>> rows(shards.size());
+    for (size_t r = 0; r < keys.size(); r++) {
+        rows[shardOf(keys[r])].push_back(r);
+    }
+
+    bool accepted = true;
+    for (size_t i = 0; i < shards.size(); i++) {
+        if (rows[i].empty()) continue;
+        if (rows[i].size() == keys.size()) {
+            // Batch inteiro de um shard: vai sem cópia
+            return shards[i]->submitDataBatch(std::move(batch));
+        }
+        auto part = batch->emptyCopy();
+        part->append(*batch, rows[i]);
+        accepted = shards[i]->submitDataBatch(std::move(part)) && accepted;
+    }
+    return accepted;
+}
+
+void ShardedPipelineManager::setIngestLimits(size_t lowWatermark, size_t highWatermark, size_t maxPendingRows) {
+    for (PipelineManager* manager : shards) {
+        manager->setIngestLimits(lowWatermark, highWatermark, maxPendingRows);
+    }
+}
+
+void ShardedPipelineManager::setTriggerPolicy(const std::function<std::unique_ptr<TriggerPolicy>()>& makePolicy) {
+    for (PipelineManager* manager : shards) {
+        manager->setTriggerPolicy(makePolicy());
+    }
+}
+
+void ShardedPipelineManager::setOnRunFailed(const std::function<void(DataFrame&)>& callback) {
+    for (PipelineManager* manager : shards) {
+        manager->setOnRunFailed(callback);
+    }
+}
+
+void ShardedPipelineManager::start() {
+    for (PipelineManager* manager : shards) {
+        manager->start();
+    }
+}
+
+void ShardedPipelineManager::stop() {
+    for (PipelineManager* manager : shards) {
+        manager->stop();
+    }
+}
+
+PipelineManager* ShardedPipelineManager::pausedShard() const {
+    for (PipelineManager* manager : shards) {
+        if (!manager->isAccepting()) return manager;
+    }
+    return nullptr;
+}
+
+PipelineManager::IngestStats ShardedPipelineManager::getIngestStats() const {
+    PipelineManager::IngestStats total;
+    for (PipelineManager* manager : shards) {
+        auto stats = manager->getIngestStats();
+        total.pendingRows += stats.pendingRows;
+        total.peakPendingRows = std::max(total.peakPendingRows, stats.peakPendingRows);
+        total.pauses += stats.pauses;
+        total.pausedMs += stats.pausedMs;
+        total.droppedBatches += stats.droppedBatches;
+        total.droppedRows += stats.droppedRows;
+    }
+    return total;
+}
@@ -8,7 +8,11 @@
 #include <chrono>
 #include <atomic>
 #include <condition_variable>
+#include <future>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <string>
 
 //TODO: melhorar isso daqui
 //Função auxiliar para não poluir a execute do transformer
@@ -38,6 +42,7 @@ void Task::addNext(std::shared_ptr<Task> nextTask, std::vector<bool> splitDFs) {
 
     nextTasks.push_back(nextTask);
     tasksConsumingOutput = nextTasks.size();
+    generation++;
 }
 
 //Todas as tasks precisam saber suas anteriores e próximas, por isso esse método também é necessário
@@ -51,6 +56,7 @@ void Task::addPrevious(std::shared_ptr<Task> previousTask, std::vector<bool> spl
 
 void Task::addOutput(std::shared_ptr<DataFrame> modelDF) {
     outputDFs.push_back(modelDF->emptyCopy());
+    generation++;
 }
 
 void Task::incrementExecutedPreviousTasks(){
@@ -129,13 +135,31 @@ int Task::getBaseWeight() const {
     return baseWeight;
 }
 
-void Task::executeMonoThreadSpecial(std::vector<std::atomic<bool>>& completedList, int tIndex, std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
-    executeMonoThread();
-    completedList[tIndex].store(true, std::memory_order_release);
-    {
-        std::lock_guard<std::mutex> lk(orchestratorMutex);
-        orchestratorCv.notify_one();
+void Task::resetThreadFinishTimes(int numThreads) {
+    threadFinishTimes.assign(std::max(numThreads, 0), std::chrono::steady_clock::time_point());
+}
+
+void Task::signalThreadFinished(CompletionQueue& completions, uint32_t group, int tIndex, std::exception_ptr error){
+    if(static_cast<size_t>(tIndex) < threadFinishTimes.size()){
+        threadFinishTimes[tIndex] = std::chrono::steady_clock::now();
+    }
+    completions.push(group, tIndex, error);
+}
+
+void Task::resetExecution(){
+    cntExecutedPreviousTasks = 0;
+    tasksConsumingOutput = nextTasks.size();
+    cancellation.reset();
+}
+
+void Task::executeMonoThreadSpecial(CompletionQueue& completions, uint32_t group, int tIndex){
+    std::exception_ptr error;
+    try {
+        executeMonoThread();
+    } catch (...) {
+        error = std::current_exception();
     }
+    signalThreadFinished(completions, group, tIndex, error);
 }
 
 // ###############################################################################################
@@ -155,98 +179,253 @@ void Transformer::decreaseConsumingCounter(){
     }
 }
 
-void Transformer::transformThread(std::vector<std::shared_ptr<DataFrame>>& outputs,
-                     const std::vector<DataFrameWithIndexes>& inputs,
-                     std::vector<std::atomic<bool>>& completedList, int tIndex,
-                     std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
-    // std::cout << tIndex << " " << completedList->size() << std::endl;
-    transform(outputs, inputs);
-    completedList[tIndex].store(true, std::memory_order_release);
-    {
-        std::lock_guard<std::mutex> lk(orchestratorMutex);
-        orchestratorCv.notify_one();
+std::vector<DataFrameWithIndexes> Transformer::MorselPool::morselInputs(size_t m) const {
+    std::vector<DataFrameWithIndexes> inputs;
+    inputs.reserve(prepareStep->inputs.size());
+    for (size_t i = 0; i < prepareStep->inputs.size(); i++){
+        const auto& dataFrame = prepareStep->inputs[i].second;
+        if(split[i]){
+            inputs.push_back(std::make_pair(getRangeVector(dataFrame->size(), numMorsels, m), dataFrame));
+        } else {
+            inputs.push_back(prepareStep->inputs[i]);
+        }
     }
+    return inputs;
 }
 
-std::vector<std::thread> Transformer::executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                         std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
+bool Transformer::MorselPool::tryRelease(){
+    if(releaseRequests.load() <= 0) return false;
+    std::lock_guard<std::mutex> lock(workersMutex);
+    if(releaseRequests.load() <= 0 || activeWorkers <= 1) return false;
+    releaseRequests--;
+    activeWorkers--;
+    return true;
+}
+
+void Transformer::morselWorker(std::shared_ptr<MorselPool> pool, CompletionQueue& completions, uint32_t group, int tIndex){
+    //A thread 0 executa o prepare (podendo usar as threads reservadas para a task) e as
+    //demais só começam o transform depois que ele terminar. Se o prepare falha, a exceção vai para
+    //o futuro (as demais threads não ficam presas na espera) e só a thread 0 a publica.
+    std::exception_ptr error;
+    if(tIndex == 0){
+        try {
+            if(!isCancelled()) prepare(outputDFs, pool->prepareStep->inputs, pool->prepareStep->numThreads);
+            pool->prepareStep->done.set_value();
+        } catch (...) {
+            error = std::current_exception();
+            pool->prepareStep->done.set_exception(error);
+        }
+    }
+    bool prepared = true;
+    try {
+        pool->prepareStep->ready.get();
+    } catch (...) {
+        prepared = false;
+    }
+    bool released = false;
+    try {
+        for(size_t m = pool->next++; prepared && m < pool->numMorsels; m = pool->next++){
+            //Execução cancelada: as partes restantes ficam sem processar
+            if(isCancelled()) break;
+            transform(outputDFs, pool->morselInputs(m));
+            if(pool->tryRelease()){
+                released = true;
+                break;
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if(!released){
+        std::lock_guard<std::mutex> lock(pool->workersMutex);
+        pool->activeWorkers--;
+    }
+    signalThreadFinished(completions, group, tIndex, error);
+}
+
+std::vector<std::thread> Transformer::executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group){
     std::vector<std::thread> runningThreads;
-    if(numThreads == 1){
-        runningThreads.emplace_back(&Transformer::executeMonoThreadSpecial, this, ref(completedThreads), 0, ref(orchestratorCv), ref(orchestratorMutex));
+    //Entradas iguais às da última execução: nenhuma thread é criada
+    if(reuseMemo()){
+        return runningThreads;
+    }
+    if(blockMultiThreading){
+        runningThreads.emplace_back(&Transformer::sequentialWorker, this, std::ref(completions), group, 0);
     }
     else{
-        runningThreads = executeWithThreading(numThreads, completedThreads,  orchestratorCv, orchestratorMutex);
+        runningThreads = executeWithThreading(std::max(numThreads, 1), completions, group);
     }
     return runningThreads;
 }
 
 void Transformer::executeMonoThread(){
+    if(reuseMemo()) return;
+    processSequential();
+}
 
-    std::vector<DataFrameWithIndexes> inputs;//A entrada da função transform
-
-    //Constrói essa entrada de acordo com os dataframes anteriores
-    for (auto previousTask : previousTasks){
-        size_t dataFrameCounter = previousTask.first->getOutputs().size();
-        for (size_t i = 0; i < dataFrameCounter; i++){
-            auto dataFrame = previousTask.first->getOutputs().at(i);
-            //Primeiro constrói o vetor index para cada dataframe e depois faz e dá push no pair.
-            //Como tem só uma thread, só pega o indice todo do dataframe
-            std::vector<int> indexes;
-            for (size_t j = 0; j < dataFrame->size(); j++){
-                indexes.push_back(j);
-            }
-            auto pair = std::make_pair(indexes, dataFrame);
-            inputs.push_back(pair);
-        }
+void Transformer::sequentialWorker(CompletionQueue& completions, uint32_t group, int tIndex){
+    std::exception_ptr error;
+    try {
+        processSequential();
+    } catch (...) {
+        error = std::current_exception();
     }
-    transform(outputDFs, inputs);
+    signalThreadFinished(completions, group, tIndex, error);
+}
+
+void Transformer::processSequential(){
+    //Uma thread só: uma única parte com todas as linhas, já que tratadores que veem o batch inteiro
+    //(ex.: métricas por execução) contam com uma chamada de transform por execução
+    auto pool = buildMorselPool(1, 0);
+    if(isCancelled()) return;
+    prepare(outputDFs, pool->prepareStep->inputs, 1);
+    if(isCancelled()) return;
+    transform(outputDFs, pool->morselInputs(0));
 }
 
 //Função separada da executeMultiThread para não poluir ela
-std::vector<std::thread> Transformer::executeWithThreading(int numThreads, std::vector<std::atomic<bool>>& completedList,
-                                                           std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
-    //Um vector contendo as entradas que serão passadas para cada thread
-    std::vector<std::vector<DataFrameWithIndexes>> threadInputs;
-    for (int i = 0; i < numThreads; i++){
-        std::vector<DataFrameWithIndexes> inputs;
-        threadInputs.push_back(inputs); //Input para cada thread. Começa vazio
-    }
-    //Constrói  as entradas de acordo com os dataframes anteriores
+std::vector<std::thread> Transformer::executeWithThreading(int numThreads, CompletionQueue& completions, uint32_t group){
+    auto pool = buildMorselPool(numThreads, morselRows);
+    pool->activeWorkers = numThreads;
+    morselPool = pool;
+
+    std::vector<std::thread> threadList;
+    for(int tIndex = 0; tIndex < numThreads; tIndex++){
+        threadList.emplace_back(&Transformer::morselWorker, this, pool, std::ref(completions), group, tIndex);
+    }
+    return threadList;
+}
+
+std::shared_ptr<Transformer::MorselPool> Transformer::buildMorselPool(int numThreads, size_t rowsPerMorsel){
+    auto pool = std::make_shared<MorselPool>();
+    auto prepareStep = std::make_shared<PrepareStep>(); //Entradas completas, usadas pelo prepare
+    prepareStep->numThreads = numThreads;
+    prepareStep->ready = prepareStep->done.get_future().share();
+    pool->prepareStep = prepareStep;
+
+    //Constrói as entradas de acordo com os dataframes anteriores; as partes de cada thread são
+    //montadas por ela mesma, quando pega a parte
+    size_t maxSplitRows = 0;
     for (auto previousTask : previousTasks){ //Roda as tasks anteriores
         size_t dataFrameCounter = previousTask.first->getOutputs().size();
         for (size_t i = 0; i < dataFrameCounter; i++){ //Roda cada df que pode sair da task anterior. Se só passar a ser um fixo por task, esse for iria de base
             auto dataFrame = previousTask.first->getOutputs().at(i);
             bool shouldSplit = previousTask.second.at(i);
 
-            if(shouldSplit){
-                for (int tIndex = 0; tIndex < numThreads; tIndex++){
-                    std::vector<int> indexes = getRangeVector(dataFrame->size(), numThreads, tIndex);
-                    auto pair = std::make_pair(indexes, dataFrame);
-                    threadInputs.at(tIndex).push_back(pair);
-                }
-            } else {
-                std::vector<int> indexes;
-                for (size_t j = 0; j < dataFrame->size(); j++){
-                    indexes.push_back(j);
-                }
-                for (int tIndex = 0; tIndex < numThreads; tIndex++){
-                    auto pair = std::make_pair(indexes, dataFrame);
-                    threadInputs.at(tIndex).push_back(pair);
-                }
+            std::vector<int> allIndexes;
+            for (size_t j = 0; j < dataFrame->size(); j++){
+                allIndexes.push_back(j);
             }
+            prepareStep->inputs.push_back(std::make_pair(std::move(allIndexes), dataFrame));
+            pool->split.push_back(shouldSplit);
+            if(shouldSplit) maxSplitRows = std::max(maxSplitRows, dataFrame->size());
         }
     }
+    //Sem entradas divididas, todas as threads recebem as entradas inteiras (uma parte por thread)
+    pool->numMorsels = numThreads;
+    if(rowsPerMorsel > 0 && maxSplitRows > 0){
+        size_t morsels = (maxSplitRows + rowsPerMorsel - 1) / rowsPerMorsel;
+        pool->numMorsels = std::max<size_t>(numThreads, morsels);
+        pool->elastic = true;
+    }
+    return pool;
+}
+
+size_t Transformer::pendingMorsels() const {
+    if(!morselPool || !morselPool->elastic) return 0;
+    size_t next = morselPool->next.load();
+    return next < morselPool->numMorsels ? morselPool->numMorsels - next : 0;
+}
+
+std::vector<std::thread> Transformer::addWorkers(int numThreads, CompletionQueue& completions, uint32_t group, int firstSlot){
     std::vector<std::thread> threadList;
-//    threadList.reserve(numThreads);
-    for(int tIndex = 0; tIndex < numThreads; tIndex++){
-        //Cada thread executa o equivalente a transform(outputDFs, threadInputs.at(tIndex));
-        threadList.emplace_back(&Transformer::transformThread, this, ref(outputDFs), threadInputs.at(tIndex), ref(completedList), tIndex, ref(orchestratorCv), ref(orchestratorMutex));
+    //O slot 0 é o da thread que executa o prepare
+    int extra = std::min<size_t>(std::max(numThreads, 0), pendingMorsels());
+    if(extra == 0 || firstSlot < 1) return threadList;
+    {
+        std::lock_guard<std::mutex> lock(morselPool->workersMutex);
+        morselPool->activeWorkers += extra;
+        //Threads sobrando de novo: pedidos de devolução ainda não atendidos perdem o sentido
+        morselPool->releaseRequests = 0;
+    }
+    for(int i = 0; i < extra; i++){
+        threadList.emplace_back(&Transformer::morselWorker, this, morselPool, std::ref(completions), group, firstSlot + i);
     }
     return threadList;
 }
 
+void Transformer::releaseWorkers(int numThreads){
+    if(!morselPool || numThreads <= 0) return;
+    morselPool->releaseRequests += numThreads;
+}
+
+void Transformer::setMemoization(Memoization mode){
+    memoization = mode;
+    if(mode == Memoization::Off) invalidateMemo();
+}
+
+void Transformer::invalidateMemo(){
+    memoKey.clear();
+    memoOutputs.clear();
+}
+
+std::string Transformer::inputsKey() const {
+    std::string key;
+    for (const auto& previousTask : previousTasks){
+        for (const auto& dataFrame : previousTask.first->getOutputs()){
+            std::string version = dataFrame->getVersion();
+            if(version.empty()){
+                if(memoization != Memoization::Content) return "";
+                version = "#" + std::to_string(dataFrame->contentFingerprint());
+            }
+            key += version;
+            key += '|';
+        }
+    }
+    return key;
+}
+
+bool Transformer::reuseMemo(){
+    reusedOutputs = false;
+    pendingKey.clear();
+    if(memoization == Memoization::Off) return false;
+    pendingKey = inputsKey();
+    if(!pendingKey.empty() && pendingKey == memoKey){
+        outputDFs = memoOutputs;
+        reusedOutputs = true;
+        return true;
+    }
+    //Saídas que ainda são as guardadas (sem tasks seguintes para trocá-las): a execução escreve em cópias vazias
+    for(size_t i = 0; i < outputDFs.size() && i < memoOutputs.size(); i++){
+        if(outputDFs[i] == memoOutputs[i]) outputDFs[i] = outputDFs[i]->emptyCopy();
+    }
+    return false;
+}
+
+void Transformer::resetExecution(){
+    Task::resetExecution();
+    reusedOutputs = false;
+    pendingKey.clear();
+    morselPool.reset();
+    for(size_t i = 0; i < outputDFs.size(); i++){
+        outputDFs[i] = outputDFs[i]->emptyCopy();
+    }
+}
+
 void Transformer::finishExecution(){
+    //Execução completa com entradas identificáveis: guarda as saídas, com versões derivadas das entradas
+    //(as mesmas a cada execução com essas entradas, para que as tasks seguintes também as reconheçam)
+    if(memoization != Memoization::Off && !reusedOutputs && !pendingKey.empty()){
+        memoKey = pendingKey;
+        memoOutputs = outputDFs;
+        std::hash<std::string> hasher;
+        for(size_t i = 0; i < outputDFs.size(); i++){
+            outputDFs[i]->setVersion(taskName + "@" + std::to_string(hasher(memoKey + "#" + std::to_string(i))));
+        }
+    }
+    pendingKey.clear();
     //Limpeza pós execução
+    morselPool.reset();
     for (auto previousTask: previousTasks){
         previousTask.first->decreaseConsumingCounter();
     }
@@ -260,6 +439,7 @@ void Transformer::finishExecution(){
 void Extractor::addOutput(std::shared_ptr<DataFrame> modelDF) {
     outputDFs.push_back(modelDF->emptyCopy());
     dfOutput = outputDFs.at(0);
+    generation++;
 }
 
 void Extractor::decreaseConsumingCounter(){
@@ -267,7 +447,7 @@ void Extractor::decreaseConsumingCounter(){
     tasksConsumingOutput--;
     if(tasksConsumingOutput == 0){
         for(size_t i = 0; i < outputDFs.size(); i++){
-            if(readAgain) {
+            if(readAgain && !cache) {
                 outputDFs[i] = outputDFs[i]->emptyCopy();
                 dfOutput = outputDFs[i];
             }
@@ -281,11 +461,17 @@ void Extractor::executeMonoThread(){
     // std::cout << "Executando extrator sem paralelizar" << std::endl;
     // Percorre toda a base de dados
     // std::cout << taskName << " mono " << readAgain << " " << dfOutput->size() << std::endl;
+    if(cache && !cacheNeedsLoad()){
+        return;
+    }
     if(dfOutput->size() != 0){
         return;
     }
     int i = 0;
+    size_t rowsRead = 0;
     while (true) {
+        // Execução cancelada: para de ler (a cada 1024 linhas, para não olhar o relógio por linha)
+        if (++rowsRead % 1024 == 0 && isCancelled()) break;
         // Pega cada linha
         DataRow row = repository->getRow();
 
@@ -305,20 +491,23 @@ void Extractor::executeMonoThread(){
     }
 }
 
-std::vector<std::thread> Extractor::executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                       std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
+std::vector<std::thread> Extractor::executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group){
     // std::cout << taskName << " multi " << numThreads << " " << readAgain << " " << dfOutput->size() << std::endl;
     std::vector<std::thread> runningThreads;
+    //Fonte em cache e sem mudanças: nenhuma thread é criada
+    if(cache && !cacheNeedsLoad()){
+        return runningThreads;
+    }
     if(numThreads == 1){
-        runningThreads.emplace_back(&Extractor::executeMonoThreadSpecial, this, ref(completedThreads), 0, ref(orchestratorCv), ref(orchestratorMutex));
+        runningThreads.emplace_back(&Extractor::executeMonoThreadSpecial, this, std::ref(completions), group, 0);
     }
     else{
         // std::cout << "Executando extrator com " << numThreads << " threads" << std::endl;
         maxBufferSize = numThreads * numThreads;
 
-        runningThreads.emplace_back(&Extractor::producer, this, ref(completedThreads), 0,  ref(orchestratorCv), ref(orchestratorMutex));
+        runningThreads.emplace_back(&Extractor::producer, this, std::ref(completions), group, 0);
         for (int i = 0; i < numThreads - 1; ++i) {
-            runningThreads.emplace_back(&Extractor::consumer, this, ref(completedThreads), i + 1, ref(orchestratorCv), ref(orchestratorMutex));
+            runningThreads.emplace_back(&Extractor::consumer, this, std::ref(completions), group, i + 1);
         }
     }
     if(readAgain == false){
@@ -327,43 +516,61 @@ std::vector<std::thread> Extractor::executeMultiThread(int numThreads, std::vect
     return runningThreads;
 }
 
-void Extractor::producer(std::vector<std::atomic<bool>>& completedList, int tIndex,
-                         std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) {
-    while (true) {
-        // Pega um batch de linhas da base de dados
-        std::string rows = repository->getBatch();
+void Extractor::producer(CompletionQueue& completions, uint32_t group, int tIndex) {
+    std::exception_ptr error;
+    try {
+        while (true) {
+            // Execução cancelada: para de ler e encerra a produção
+            if (isCancelled()) break;
+            // Pega um batch de linhas da base de dados
+            std::string rows = repository->getBatch();
 
-        // Mutex para caso o buffer se encha
-        std::unique_lock<std::mutex> lock(bufferMutex);
-        cv.wait(lock, [this] { return buffer.size() < maxBufferSize; });
+            // Mutex para caso o buffer se encha (os consumidores de uma execução cancelada saem e avisam)
+            std::unique_lock<std::mutex> lock(bufferMutex);
+            cv.wait(lock, [this] { return buffer.size() < maxBufferSize || isCancelled(); });
 
 
-        // Adiciona o batch de linhas ao buffer
-        buffer.push(rows);
+            // Adiciona o batch de linhas ao buffer
+            buffer.push(rows);
 
-        // Verifica se terminou
-        if (!repository->hasNext()) break;
+            // Verifica se terminou
+            if (!repository->hasNext()) break;
 
-        // Libera o mutex
-        lock.unlock();
+            // Libera o mutex
+            lock.unlock();
 
-        // Notifica aos consumidores
-        cv.notify_all();
-    };
+            // Notifica aos consumidores
+            cv.notify_all();
+        };
+    } catch (...) {
+        // Erro na leitura: os consumidores param com o que já está no buffer
+        error = std::current_exception();
+        if (cancellation) cancellation->cancel("erro na leitura da fonte");
+    }
     endProduction = true;
 
     // Notifica aos consumidores que encerrou a produção
     cv.notify_all();
-    completedList[tIndex].store(true, std::memory_order_release);
-    {
-        std::lock_guard<std::mutex> lk(orchestratorMutex);
-        orchestratorCv.notify_one();
-    }
+    signalThreadFinished(completions, group, tIndex, error);
 };
 
-void Extractor::consumer(std::vector<std::atomic<bool>>& completedList, int tIndex,
-                         std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) {
+void Extractor::consumer(CompletionQueue& completions, uint32_t group, int tIndex) {
+    std::exception_ptr error;
+    try {
+        consumeBuffer();
+    } catch (...) {
+        // O produtor pode estar esperando espaço no buffer: sai pelo cancelamento da task
+        error = std::current_exception();
+        if (cancellation) cancellation->cancel("erro na conversão das linhas");
+    }
+    cv.notify_all();
+    signalThreadFinished(completions, group, tIndex, error);
+}
+
+void Extractor::consumeBuffer() {
     while (true) {
+        // Execução cancelada: o que está no buffer é descartado
+        if (isCancelled()) break;
         std::unique_lock<std::mutex> lock(bufferMutex);
 
 
@@ -392,21 +599,94 @@ void Extractor::consumer(std::vector<std::atomic<bool>>& completedList, int tInd
         }
         cv.notify_all();
     }
-    completedList[tIndex].store(true, std::memory_order_release);
-    {
-        std::lock_guard<std::mutex> lk(orchestratorMutex);
-        orchestratorCv.notify_one();
-    }
 }
 
 void Extractor::finishExecution(){
-    if(readAgain){
+    if(loadingCache){
+        if(!cache->keyColumn.empty()){
+            dfOutput->buildKeyIndex(cache->keyColumn);
+        }
+        std::lock_guard<std::mutex> lock(cache->mtx);
+        //A versão da fonte identifica o DataFrame para a memoização dos tratadores seguintes
+        dfOutput->setVersion(loadingVersion);
+        cache->df = dfOutput;
+        cache->version = loadingVersion;
+        cache->loaded = true;
+        cache->loading = false;
+        loadingCache = false;
+        cache->cv.notify_all();
+    }
+    if(readAgain && !cache){
         repository->close();
     }
     endProduction = false;
     cntExecutedPreviousTasks = 0;
 }
 
+void Extractor::resetExecution(){
+    Task::resetExecution();
+    //Carga da fonte em cache interrompida: volta a leitura ao início e libera os extratores que
+    //esperam por ela (um deles a carrega na próxima execução)
+    if(loadingCache){
+        std::lock_guard<std::mutex> lock(cache->mtx);
+        cache->repository->resetReader();
+        cache->loading = false;
+        loadingCache = false;
+        cache->cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        buffer = std::queue<std::string>();
+    }
+    if(readAgain && !cache){
+        for(size_t i = 0; i < outputDFs.size(); i++){
+            outputDFs[i] = outputDFs[i]->emptyCopy();
+        }
+        if(!outputDFs.empty()) dfOutput = outputDFs[0];
+        repository->close();
+    }
+    endProduction = false;
+}
+
+void Extractor::cacheSource(const std::string& keyColumn){
+    cache = std::make_shared<SourceCache>(repository, keyColumn);
+}
+
+void Extractor::cacheSource(std::shared_ptr<SourceCache> sharedCache){
+    cache = sharedCache;
+    repository = cache->repository;
+}
+
+//Decide, uma vez por execução, se a fonte em cache precisa ser (re)lida por este extrator
+bool Extractor::cacheNeedsLoad(){
+    if(loadingCache){
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(cache->mtx);
+    //Outro extrator já está lendo a fonte: espera a carga dele em vez de ler de novo
+    cache->cv.wait(lock, [this] { return !cache->loading; });
+    std::string version = cache->repository->getVersion();
+    if(cache->loaded && version == cache->version){
+        if(dfOutput != cache->df){
+            outputDFs[0] = cache->df;
+            dfOutput = cache->df;
+        }
+        return false;
+    }
+    if(cache->loaded){
+        std::cout << "Extractor " << taskName << ": fonte modificada, recarregando." << std::endl;
+        cache->repository->resetReader();
+    }
+    //Carga num DataFrame novo: o anterior pode estar em uso por outras instâncias
+    outputDFs[0] = dfOutput->emptyCopy();
+    dfOutput = outputDFs[0];
+    //A versão é lida antes da carga: uma mudança durante a leitura força nova carga na próxima execução
+    loadingVersion = version;
+    loadingCache = true;
+    cache->loading = true;
+    return true;
+}
+
 // ###############################################################################################
 // ###############################################################################################
 // Metodos da classe ExtractorNoop
@@ -416,6 +696,7 @@ void ExtractorNoop::addOutput(std::shared_ptr<DataFrame> modelDF) {
     if(outputDFs.size() == 0){
         // std::cout << "chamou e nçao tinha coisa" << std::endl;
         outputDFs.push_back(modelDF);
+        generation++;
     }
     else {
         // std::cout << "chamou e já tinha coisa" << std::endl;
@@ -471,20 +752,22 @@ void Loader::executeMonoThread(){
         repository->appendHeader(header);
     }
     std::shared_ptr<DataFrame> dfInput = inputs[0].second;
+    std::vector<StrRow> rows;
     for (auto i: inputs[0].first) {
         // Pega cada linha do DF
-        std::vector<std::string> row = dfInput->getRow(i);
-        // Adiciona a linha ao repositório
-        repository->appendRow(row);
+        rows.push_back(dfInput->getRow(i));
+    }
+    // Um único append por execução, como no addRows (nenhum se a execução foi cancelada)
+    if(!rows.empty() && !isCancelled()){
+        repository->appendStr(repository->serializeBatch(rows));
     }
 }
 
-std::vector<std::thread> Loader::executeMultiThread(int numThreads, std::vector<std::atomic<bool>>& completedThreads,
-                                                    std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex){
+std::vector<std::thread> Loader::executeMultiThread(int numThreads, CompletionQueue& completions, uint32_t group){
 
     std::vector<std::thread> runningThreads;
     if(numThreads == 1){
-        runningThreads.emplace_back(&Loader::executeMonoThreadSpecial, this, ref(completedThreads), 0, ref(orchestratorCv), ref(orchestratorMutex));
+        runningThreads.emplace_back(&Loader::executeMonoThreadSpecial, this, std::ref(completions), group, 0);
     }
     else{
         repository->open();
@@ -496,36 +779,42 @@ std::vector<std::thread> Loader::executeMultiThread(int numThreads, std::vector<
             repository->appendHeader(header);
         }
         for (int i = 0; i < numThreads; i++) {
-            runningThreads.emplace_back(&Loader::addRows, this, inputs[i], ref(completedThreads), i, ref(orchestratorCv), ref(orchestratorMutex));
+            runningThreads.emplace_back(&Loader::addRows, this, inputs[i], std::ref(completions), group, i);
         }
     }
     return runningThreads;
 }
 
-void Loader::addRows(DataFrameWithIndexes pair, std::vector<std::atomic<bool>>& completedList, int tIndex, std::condition_variable& orchestratorCv, std::mutex& orchestratorMutex) {
+void Loader::addRows(DataFrameWithIndexes pair, CompletionQueue& completions, uint32_t group, int tIndex) {
     std::shared_ptr<DataFrame> dfInput = pair.second;
     std::vector<StrRow> rows;
-    if(pair.first.size() > 0){
-        for (int i: pair.first) {
-            // Pega cada linha do DF
-            StrRow row = dfInput->getRow(i);
-            // Adiciona as linhas ao vetor de linhas
-            rows.push_back(row);
-        }
-        std::string batchRows = repository->serializeBatch(rows);
+    std::exception_ptr error;
+    try {
+        if(pair.first.size() > 0 && !isCancelled()){
+            for (int i: pair.first) {
+                // Pega cada linha do DF
+                StrRow row = dfInput->getRow(i);
+                // Adiciona as linhas ao vetor de linhas
+                rows.push_back(row);
+            }
+            std::string batchRows = repository->serializeBatch(rows);
 
-        {
-            std::lock_guard<std::mutex> lock(repoMutex);
-            repository->appendStr(batchRows);
+            {
+                std::lock_guard<std::mutex> lock(repoMutex);
+                repository->appendStr(batchRows);
+            }
         }
+    } catch (...) {
+        error = std::current_exception();
     }
-    completedList[tIndex].store(true, std::memory_order_release);
-    {
-        std::lock_guard<std::mutex> lk(orchestratorMutex);
-        orchestratorCv.notify_one();
-    }
+    signalThreadFinished(completions, group, tIndex, error);
 };
 
+void Loader::resetExecution() {
+    Task::resetExecution();
+    repository->close();
+}
+
 void Loader::finishExecution() {
     repository->close();
     for (auto previousTask: previousTasks){
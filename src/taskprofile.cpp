@@ -0,0 +1,226 @@
+#include "taskprofile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+double ScalingModel::predictMs(int threads) const {
+    return t1Ms * (serialFraction + (1.0 - serialFraction) / std::max(threads, 1));
+}
+
+TaskProfile::TaskProfile(double alpha) : alpha(alpha) {
+    if (alpha <= 0.0 || alpha > 1.0) {
+        throw std::invalid_argument("TaskProfile: alpha must be in (0, 1].");
+    }
+}
+
+TaskProfile::~TaskProfile() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    saverCv.notify_all();
+    if (saver.joinable()) saver.join();
+}
+
+bool TaskProfile::validName(const std::string& task) {
+    if (task.empty() || task[0] == '#') return false;
+    return std::none_of(task.begin(), task.end(), [](unsigned char c) { return std::isspace(c); });
+}
+
+void TaskProfile::record(const std::string& task, double elapsedMs, size_t rows, int threads) {
+    double n = static_cast<double>(std::max<size_t>(rows, 1));
+    threads = std::max(threads, 1);
+    double msPerRow = elapsedMs * threads / n;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!validName(task)) {
+        // Tasks sem nome cairiam todas na mesma entrada; as demais quebrariam o arquivo
+        if (ignored.insert(task).second) {
+            std::cerr << "TaskProfile: not profiling task with name '" << task
+                      << "' (empty, with whitespace or starting with '#')." << std::endl;
+        }
+        return;
+    }
+    Entry& entry = entries[task];
+    if (entry.samples == 0) {
+        entry.msPerRow = msPerRow;
+        entry.rows = n;
+    } else {
+        entry.msPerRow += alpha * (msPerRow - entry.msPerRow);
+        entry.rows += alpha * (n - entry.rows);
+    }
+    auto wall = entry.wallMsPerRow.find(threads);
+    if (wall == entry.wallMsPerRow.end()) {
+        entry.wallMsPerRow[threads] = elapsedMs / n;
+    } else {
+        wall->second += alpha * (elapsedMs / n - wall->second);
+    }
+    entry.samples++;
+    version++;
+    dirty = true;
+}
+
+bool TaskProfile::expectedMs(const std::string& task, double& ms) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(task);
+    if (it == entries.end() || it->second.samples == 0) return false;
+    ms = it->second.msPerRow * it->second.rows;
+    return true;
+}
+
+double TaskProfile::meanExpectedMs() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    double sum = 0.0;
+    size_t count = 0;
+    for (const auto& [name, entry] : entries) {
+        if (entry.samples == 0) continue;
+        sum += entry.msPerRow * entry.rows;
+        count++;
+    }
+    return count ? sum / count : 0.0;
+}
+
+std::map<std::string, TaskProfile::Entry> TaskProfile::getEntries() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return entries;
+}
+
+bool TaskProfile::scalingModel(const std::string& task, bool parallel, ScalingModel& model) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = entries.find(task);
+    if (it == entries.end() || it->second.wallMsPerRow.empty()) return false;
+    const Entry& entry = it->second;
+
+    // tempo por linha com n threads = a + b / n, com a = t1 * serial e b = t1 * (1 - serial)
+    double a = 0.0, b = 0.0;
+    if (entry.wallMsPerRow.size() >= 2) {
+        double count = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for (const auto& [threads, ms] : entry.wallMsPerRow) {
+            double x = 1.0 / threads;
+            count++;
+            sx += x;
+            sy += ms;
+            sxx += x * x;
+            sxy += x * ms;
+        }
+        b = (count * sxy - sx * sy) / (count * sxx - sx * sx);
+        a = (sy - b * sx) / count;
+        // Mais threads não pode deixar a task mais lenta nem ter parte serial negativa
+        if (b < 0.0) {
+            a = sy / count;
+            b = 0.0;
+        } else if (a < 0.0) {
+            b = sxy / sxx;
+            a = 0.0;
+        }
+    } else {
+        const auto& [threads, ms] = *entry.wallMsPerRow.begin();
+        double serial = parallel ? defaultSerialFraction : 1.0;
+        double t1 = ms / (serial + (1.0 - serial) / threads);
+        a = t1 * serial;
+        b = t1 - a;
+    }
+    if (!parallel) {
+        a += b;
+        b = 0.0;
+    }
+    double t1PerRow = a + b;
+    model.t1Ms = t1PerRow * entry.rows;
+    model.serialFraction = t1PerRow > 0.0 ? a / t1PerRow : 1.0;
+    return true;
+}
+
+bool TaskProfile::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::map<std::string, Entry> loaded;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string name;
+        Entry entry;
+        if (!(fields >> name >> entry.msPerRow >> entry.rows >> entry.samples) || !validName(name)) {
+            std::cerr << "TaskProfile: ignoring malformed line in " << path << ": " << line << std::endl;
+            continue;
+        }
+        std::string pair;
+        while (fields >> pair) {
+            size_t colon = pair.find(':');
+            if (colon == std::string::npos) continue;
+            try {
+                entry.wallMsPerRow[std::stoi(pair.substr(0, colon))] = std::stod(pair.substr(colon + 1));
+            } catch (const std::exception&) {
+                std::cerr << "TaskProfile: ignoring malformed pair in " << path << ": " << pair << std::endl;
+            }
+        }
+        loaded[name] = entry;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& [name, entry] : loaded) entries[name] = entry;
+    version++;
+    return true;
+}
+
+void TaskProfile::save(const std::string& path) const {
+    std::map<std::string, Entry> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        snapshot = entries;
+    }
+    write(path, snapshot);
+}
+
+void TaskProfile::autosave(const std::string& path, std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mtx);
+    autosavePath = path;
+    autosaveInterval = interval;
+    if (!saver.joinable()) saver = std::thread(&TaskProfile::saverLoop, this);
+}
+
+// Grava o perfil a cada autosaveInterval, se mudou; na parada grava o que faltar. As entradas são
+// copiadas sob o mutex e o arquivo é escrito sem ele, para não segurar o record() das tasks
+void TaskProfile::saverLoop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!stopping) {
+        saverCv.wait_for(lock, autosaveInterval, [this] { return stopping; });
+        if (dirty) {
+            dirty = false;
+            std::map<std::string, Entry> snapshot = entries;
+            std::string path = autosavePath;
+            lock.unlock();
+            write(path, snapshot);
+            lock.lock();
+        }
+    }
+}
+
+// Grava num arquivo temporário e renomeia, para uma queda no meio não deixar o perfil truncado
+void TaskProfile::write(const std::string& path, const std::map<std::string, Entry>& snapshot) const {
+    std::lock_guard<std::mutex> lock(fileMtx); // save() e a thread de gravação usam o mesmo .tmp
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) {
+            std::cerr << "TaskProfile: cannot write " << tmp << std::endl;
+            return;
+        }
+        out.precision(17);
+        out << "# task ms_por_linha linhas amostras [threads:ms_por_linha_parede ...]\n";
+        for (const auto& [name, entry] : snapshot) {
+            out << name << " " << entry.msPerRow << " " << entry.rows << " " << entry.samples;
+            for (const auto& [threads, ms] : entry.wallMsPerRow) out << " " << threads << ":" << ms;
+            out << "\n";
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp, path, error);
+    if (error) {
+        std::cerr << "TaskProfile: cannot rename " << tmp << ": " << error.message() << std::endl;
+    }
+}
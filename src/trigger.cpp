@@ -8,59 +8,372 @@
 #include <queue>
 #include <map>
 #include <set>
+#include <utility>
+#include <cstdlib>
+#include <filesystem>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 // ##################################################################################################
 // ##################################################################################################
 // Implementação dos métodos de Trigger
+namespace {
+// Numeração das execuções instrumentadas, comum a todos os triggers (nomes dos arquivos de trace)
+std::atomic<uint64_t> nextTraceRunId{1};
+}
+
+Trigger::Trigger() {
+    if (const char* dir = std::getenv("PIPELINE_TRACE_DIR")) {
+        int every = 1;
+        if (const char* value = std::getenv("PIPELINE_TRACE_EVERY")) every = std::max(1, std::atoi(value));
+        enableProfiling(dir, every);
+    }
+}
+
 Trigger::~Trigger() = default; // Destrutor padrão
 
+void Trigger::enableProfiling(const std::string& dir, unsigned every) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    traceDir = dir;
+    traceEvery = std::max(every, 1u);
+    if (!traceDir.empty()) {
+        std::filesystem::create_directories(traceDir);
+    }
+    profiling = true;
+}
+
+void Trigger::disableProfiling() {
+    profiling = false;
+}
+
+std::shared_ptr<const PipelineTrace> Trigger::getLastTrace() const {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    return lastTrace;
+}
+
+void Trigger::beginTrace(int maxThreads) {
+    currentTrace.reset();
+    if (!profiling.load()) return;
+    currentTrace = std::make_shared<PipelineTrace>(nextTraceRunId++, maxThreads);
+    currentTrace->begin();
+}
+
+void Trigger::endTrace() {
+    if (!currentTrace) return;
+    currentTrace->finish();
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        lastTrace = currentTrace;
+        if (!traceDir.empty() && currentTrace->getRunId() % traceEvery == 0) {
+            path = traceDir + "/trace-" + std::to_string(currentTrace->getRunId()) + ".json";
+        }
+    }
+    if (!path.empty()) {
+        try {
+            currentTrace->writeChromeJson(path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    currentTrace.reset();
+}
+
+// Task disparada agora: linhas que ela recebe das anteriores
+PipelineTrace::TaskSpan Trigger::startSpan(const std::shared_ptr<Task>& task, PipelineTrace::Clock::time_point ready) {
+    PipelineTrace::TaskSpan span;
+    span.task = task->getTaskName();
+    span.ready = ready;
+    span.start = PipelineTrace::Clock::now();
+    span.rowsIn = inputRows(task);
+    return span;
+}
+
+// Threads da task terminadas: fim de cada uma e tamanho das saídas (antes do finishExecution)
+void Trigger::measureSpan(const std::shared_ptr<Task>& task, PipelineTrace::TaskSpan& span, size_t launchedThreads) {
+    const auto& ends = task->getThreadFinishTimes();
+    span.threadEnds.assign(ends.begin(), ends.begin() + std::min(launchedThreads, ends.size()));
+    for (const auto& df : task->getOutputs()) {
+        span.rowsOut += df->size();
+        span.bytesOut += df->memoryBytes();
+    }
+}
+
+void Trigger::setTaskProfile(std::shared_ptr<TaskProfile> profile) {
+    taskProfile = std::move(profile);
+    weightsReady = false;
+}
+
+std::map<std::string, double> Trigger::getTaskWeights() const {
+    std::map<std::string, double> weights;
+    for (const auto& node : taskNodes) weights[node.task->getTaskName()] = node.finalWeight;
+    return weights;
+}
+
+// Linhas que a task recebe das anteriores
+size_t Trigger::inputRows(const std::shared_ptr<Task>& task) const {
+    size_t rows = 0;
+    for (const auto& previous : task->getPreviousTasks()) {
+        for (const auto& df : previous.first->getOutputs()) rows += df->size();
+    }
+    return rows;
+}
+
+// Extratores não recebem linhas: o custo deles é medido pelas linhas que produzem. Tasks que só
+// reutilizaram as saídas da execução anterior não entram no perfil.
+void Trigger::recordTaskRuntime(const std::shared_ptr<Task>& task, double elapsedMs, size_t rowsIn, int threads) {
+    if (!taskProfile || task->outputsReused()) return;
+    size_t rows = rowsIn;
+    if (rows == 0) {
+        for (const auto& df : task->getOutputs()) rows += df->size();
+    }
+    taskProfile->record(task->getTaskName(), elapsedMs, rows, threads);
+}
+
 void Trigger::setExtractors(const std::vector<std::shared_ptr<Task>>& vExtractors) {
     this->vExtractors = vExtractors;
+    compiled = false;
 }
 
 void Trigger::addExtractor(std::shared_ptr<Task> extractor) {
     vExtractors.push_back(extractor);
+    compiled = false;
 }
 
 void Trigger::clearExtractors() {
     vExtractors.clear();
+    compiled = false;
 }
 
-void Trigger::orchestratePipelineMonoThread() {
-    std::queue<std::shared_ptr<Task>> tasksQueue;
+void Trigger::ensureCompiled() {
+    if (!compiled || compiledGeneration != Task::graphGeneration()) compile();
+}
 
-    // Adiciona os extratores à fila de tarefas
-    for (const auto& extractor : vExtractors) {
-        tasksQueue.push(extractor);
+void Trigger::compile() {
+    uint64_t generation = Task::graphGeneration();
+    std::vector<std::string> problems;
+
+    // Tasks alcançáveis pelos extratores, na ordem em que são encontradas
+    std::vector<std::shared_ptr<Task>> found;
+    std::map<const Task*, int> foundIndex;
+    for (size_t k = 0; k < vExtractors.size(); k++) {
+        if (foundIndex.emplace(vExtractors[k].get(), found.size()).second) found.push_back(vExtractors[k]);
     }
-    
+    const size_t numStarts = found.size();
+    for (size_t k = 0; k < found.size(); k++) {
+        for (const auto& next : found[k]->getNextTasks()) {
+            if (foundIndex.emplace(next.get(), found.size()).second) found.push_back(next);
+        }
+    }
+
+    std::map<std::string, int> names;
+    std::vector<int> indegree(found.size(), 0);
+    for (size_t k = 0; k < found.size(); k++) {
+        const auto& task = found[k];
+        const std::string& name = task->getTaskName();
+        // Tasks sem nome são aceitas (o orquestrador usa os ids), mas ficam fora do perfil e das consultas por nome
+        if (!name.empty() && !names.emplace(name, k).second) problems.push_back("nome de task repetido: '" + name + "'");
+        const auto& previousTasks = task->getPreviousTasks();
+        if (k < numStarts && !previousTasks.empty()) {
+            problems.push_back("a task de início '" + name + "' tem tasks anteriores");
+        }
+        for (const auto& [previous, splitDFs] : previousTasks) {
+            if (foundIndex.find(previous.get()) == foundIndex.end()) {
+                problems.push_back("'" + name + "' depende de '" + previous->getTaskName() +
+                                   "', que não é alcançável pelos extratores (nunca seria disparada)");
+                continue;
+            }
+            indegree[k]++;
+            if (splitDFs.size() != previous->getOutputs().size()) {
+                problems.push_back("splitDFs de '" + previous->getTaskName() + "' -> '" + name + "' tem " +
+                                   std::to_string(splitDFs.size()) + " elemento(s), mas a task anterior tem " +
+                                   std::to_string(previous->getOutputs().size()) + " saída(s)");
+            }
+        }
+        if (auto loader = std::dynamic_pointer_cast<Loader>(task)) {
+            if (previousTasks.empty()) {
+                problems.push_back("o Loader '" + name + "' não tem task anterior");
+            } else {
+                int outputs = static_cast<int>(previousTasks[0].first->getOutputs().size());
+                if (loader->getInputIndex() < 0 || loader->getInputIndex() >= outputs) {
+                    problems.push_back("inputIndex " + std::to_string(loader->getInputIndex()) + " do Loader '" + name +
+                                       "' fora das " + std::to_string(outputs) + " saída(s) de '" +
+                                       previousTasks[0].first->getTaskName() + "'");
+                }
+            }
+        }
+    }
+
+    // Ordem topológica (Kahn, em fila: a mesma ordem em que a execução com uma thread dispara as tasks)
+    std::vector<int> order;
+    std::vector<int> remaining = indegree;
+    for (size_t k = 0; k < found.size(); k++) {
+        if (remaining[k] == 0) order.push_back(k);
+    }
+    for (size_t pos = 0; pos < order.size(); pos++) {
+        for (const auto& next : found[order[pos]]->getNextTasks()) {
+            int n = foundIndex[next.get()];
+            if (--remaining[n] == 0) order.push_back(n);
+        }
+    }
+    if (order.size() < found.size()) {
+        std::string cycle;
+        for (size_t k = 0; k < found.size(); k++) {
+            if (remaining[k] > 0) cycle += (cycle.empty() ? "" : ", ") + found[k]->getTaskName();
+        }
+        problems.push_back("ciclo entre as tasks: " + cycle);
+    }
+
+    if (!problems.empty()) {
+        std::string message = "Pipeline inválida:";
+        for (const auto& problem : problems) message += "\n  - " + problem;
+        throw std::invalid_argument(message);
+    }
+
+    // Vetores por id (posição na ordem topológica)
+    const size_t n = order.size();
+    std::vector<int> idOf(found.size());
+    for (size_t id = 0; id < n; id++) idOf[order[id]] = id;
+    taskNodes.assign(n, taskNode());
+    nextOffsets.assign(n + 1, 0);
+    nextIds.clear();
+    fanIn.assign(n, 0);
+    for (size_t id = 0; id < n; id++) {
+        auto& node = taskNodes[id];
+        node.task = found[order[id]];
+        fanIn[id] = indegree[order[id]];
+        for (const auto& next : node.task->getNextTasks()) {
+            int nextId = idOf[foundIndex[next.get()]];
+            nextIds.push_back(nextId);
+            taskNodes[nextId].level = std::max(taskNodes[nextId].level, node.level + 1);
+        }
+        nextOffsets[id + 1] = nextIds.size();
+    }
+    // Desempate da fila pelo nome, como quando o DAG era um mapa por nome (as sem nome, pelo id)
+    std::vector<int> byName(n);
+    for (size_t id = 0; id < n; id++) byName[id] = id;
+    std::stable_sort(byName.begin(), byName.end(), [this](int a, int b) {
+        return taskNodes[a].task->getTaskName() < taskNodes[b].task->getTaskName();
+    });
+    for (size_t rank = 0; rank < n; rank++) taskNodes[byName[rank]].nameRank = rank;
+
+    compiled = true;
+    compiledGeneration = generation;
+    weightsReady = false;
+}
+
+std::vector<std::string> Trigger::getTopologicalOrder() const {
+    std::vector<std::string> order;
+    for (const auto& node : taskNodes) order.push_back(node.task->getTaskName());
+    return order;
+}
+
+void Trigger::cancel(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(runMutex);
+    if (runToken) runToken->cancel(reason);
+}
+
+std::shared_ptr<CancellationToken> Trigger::beginRun() {
+    auto deadline = CancellationToken::Clock::time_point::max();
+    if (runDeadline.count() > 0) deadline = CancellationToken::Clock::now() + runDeadline;
+    auto token = std::make_shared<CancellationToken>(nullptr, deadline);
+    std::lock_guard<std::mutex> lock(runMutex);
+    runToken = token;
+    return token;
+}
+
+void Trigger::endRun() {
+    std::lock_guard<std::mutex> lock(runMutex);
+    runToken.reset();
+}
+
+std::shared_ptr<CancellationToken> Trigger::taskToken(const std::shared_ptr<CancellationToken>& run, const std::shared_ptr<Task>& task) {
+    auto deadline = CancellationToken::Clock::time_point::max();
+    if (task->getDeadline().count() > 0) deadline = CancellationToken::Clock::now() + task->getDeadline();
+    return std::make_shared<CancellationToken>(run, deadline);
+}
+
+void Trigger::abortRun(const std::shared_ptr<CancellationToken>& run) {
+    for (auto& node : taskNodes) node.task->resetExecution();
+    endTrace();
+    endRun();
+    std::string reason = run->getReason();
+    std::cout << "Execução da pipeline cancelada: " << reason << std::endl;
+    throw PipelineCancelled(reason);
+}
+
+void Trigger::failRun(std::exception_ptr error) {
+    for (auto& node : taskNodes) node.task->resetExecution();
+    endTrace();
+    endRun();
+    std::cout << "Execução da pipeline interrompida por erro em uma task." << std::endl;
+    std::rethrow_exception(error);
+}
+
+void Trigger::orchestratePipelineMonoThread() {
+    ensureCompiled();
+    auto run = beginRun();
+    beginTrace(1);
+    // Quando cada task ficou pronta (só com a instrumentação ligada): o fim da última anterior
+    std::vector<PipelineTrace::Clock::time_point> readyAt;
+    if (currentTrace) readyAt.assign(taskNodes.size(), PipelineTrace::Clock::now());
+
     std::cout << "Iniciando execução da pipeline...\n";
-    while (!tasksQueue.empty()) {
-        auto task = tasksQueue.front();
-        tasksQueue.pop();
+    // A ordem topológica dos ids é a ordem de execução
+    for (size_t id = 0; id < taskNodes.size(); id++) {
+        if (run->isCancelled()) abortRun(run);
+        const auto& task = taskNodes[id].task;
 
         // Executa a tarefa
         // std::cout << "(1)Tamanho do nextTasks da task atual: " << task->getNextTasks().size() << std::endl;
 
+        PipelineTrace::TaskSpan span;
+        if (currentTrace) span = startSpan(task, readyAt[id]);
+        size_t rowsIn = taskProfile ? inputRows(task) : 0;
         auto start = std::chrono::high_resolution_clock::now();
-        task->executeMonoThread();
+        task->setCancellation(taskToken(run, task));
+        try {
+            task->executeMonoThread();
+        } catch (...) {
+            failRun(std::current_exception());
+        }
+        if (task->getCancellation()->isCancelled()) {
+            // cancelada pela execução (cancel ou prazo dela) ou pelo prazo da própria task
+            if (!run->isCancelled()) run->cancel("task " + task->getTaskName() + ": " + task->getCancellation()->getReason());
+            abortRun(run);
+        }
+        task->setCancellation(nullptr);
+        if (taskProfile) {
+            std::chrono::duration<double, std::milli> taskElapsed = std::chrono::high_resolution_clock::now() - start;
+            recordTaskRuntime(task, taskElapsed.count(), rowsIn, 1);
+        }
+        if (currentTrace) {
+            measureSpan(task, span, 0);
+            span.threadEnds.push_back(PipelineTrace::Clock::now()); // a própria thread do orquestrador
+        }
         task->finishExecution();
         auto end = std::chrono::high_resolution_clock::now();
+        if (currentTrace) {
+            span.end = PipelineTrace::Clock::now();
+            currentTrace->add(std::move(span));
+        }
         std::chrono::duration<double, std::milli> elapsed = end - start;
         std::cout << "Tempo de execução do bloco " << task->getTaskName() << ": " << elapsed.count() << " milissegundos.\n";
         // std::cout << "(2)Tamanho do nextTasks da task atual: " << task->getNextTasks().size() << std::endl;
 
-        // Adiciona as próximas tarefas à fila
-        const auto& nextTasks = task->getNextTasks();
-        for (const auto& nextTask : nextTasks) {
-            nextTask->incrementExecutedPreviousTasks();
-
-            // Se todas as tarefas anteriores foram executadas, adiciona a próxima tarefa à fila
-            if(nextTask->checkPreviousTasks()) {
-                tasksQueue.push(nextTask);  
-            }
+        if (currentTrace) {
+            for (size_t k = nextOffsets[id]; k < nextOffsets[id + 1]; k++) readyAt[nextIds[k]] = PipelineTrace::Clock::now();
         }
     }
+    endTrace();
+    endRun();
     std::cout << "Pipeline concluída.\n";
 }
 /*
@@ -155,91 +468,73 @@ void Trigger::orchestratePipelineMultiThread(int numThreads) {
 bool Trigger::calculateThreadsDistribution(int numThreads) {
     // std::cout << "Calculando a distribuição ideal de threads...\n";
 
+    // O DAG é compilado uma vez só (ou quando muda); os pesos são refeitos sempre que o perfil aprende algo novo
+    ensureCompiled();
     if(vExtractors.empty()){
         std::cout << "Nenhum extrator foi adicionado ao Trigger.\n";
         return false;  
     }
-    else if(!taskMap.empty()){
-        // std::cout << "A distribuição de threads já foi calculada.\n";
-        return false;
-    }
-    std::queue<std::string> tasksQueue, tasksQueueReverse;
+    uint64_t profileVersion = taskProfile ? taskProfile->getVersion() : 0;
+    if(weightsReady && profileVersion == weightsVersion && numThreads == plannedMaxThreads) return false;
+    weightsVersion = profileVersion;
+    computeTaskWeights();
+    planSchedule(numThreads);
+    weightsReady = true;
 
-    // Adiciona os extratores à fila de tarefas
-    for (const auto& extractor : vExtractors) {
-        taskMap[extractor->getTaskName()] = taskNode(extractor);
-        tasksQueue.push(extractor->getTaskName());
-    }
+    // std::cout << "Cálculo concluído.\n";
+    return true;
+}
 
-    // std::cout << "Iniciando queue 1" << std::endl;
-    while (!tasksQueue.empty()) {
-        auto& crrTaskNode = taskMap[tasksQueue.front()];
-        tasksQueue.pop();
-        
-        if(crrTaskNode.auxOrquestrador == 1) continue;
-
-        // std::cout << "Tarefa atual: " << crrTaskNode.task->getTaskName() << std::endl;
-        // Marca a task como visitada
-        crrTaskNode.auxOrquestrador = 1;
-
-        const auto& nextTasks = crrTaskNode.task->getNextTasks();
-
-        // Adiciona as próximas tarefas à fila
-        if(!nextTasks.empty()){
-            for (const auto& nextTask : nextTasks) {
-                std::string nextTaskName = nextTask->getTaskName();
-                // Se a task não foi visitada, adiciona à fila
-                if(taskMap.find(nextTaskName) == taskMap.end()){
-                    taskMap[nextTaskName] = taskNode(nextTask); 
-                    taskMap[nextTaskName].level = crrTaskNode.level + 1;
-                    tasksQueue.push(nextTaskName);
-                }
+// Calcula cpWeight, sumWeight e finalWeight partindo dos loaders em direção aos extratores.
+// Com perfil, o peso de cada task é o trabalho esperado medido, normalizado para a task medida mais
+// leve valer 1 (o finalWeight é limitado a no mínimo 1); tasks ainda não medidas valem a média das
+// medidas vezes o peso base. Sem perfil (ou sem medidas), usa getBaseWeight.
+void Trigger::computeTaskWeights() {
+    const size_t n = taskNodes.size();
+    std::vector<double> baseWeights(n);
+    double meanMs = taskProfile ? taskProfile->meanExpectedMs() : 0.0;
+    if (meanMs > 0.0) {
+        double minMs = 0.0;
+        std::vector<bool> measured(n, false);
+        for (size_t id = 0; id < n; id++) {
+            double ms;
+            if (taskProfile->expectedMs(taskNodes[id].task->getTaskName(), ms) && ms > 0.0) {
+                baseWeights[id] = ms;
+                measured[id] = true;
+                if (minMs == 0.0 || ms < minMs) minMs = ms;
             }
         }
-        // Se não tiver próxima tarefa então a task é um Loader
-        else{
-            tasksQueueReverse.push(crrTaskNode.task->getTaskName());
+        for (size_t id = 0; id < n; id++) {
+            const auto& task = taskNodes[id].task;
+            if (minMs == 0.0) {
+                baseWeights[id] = task->getBaseWeight();
+                continue;
+            }
+            double ms = measured[id] ? baseWeights[id] : meanMs * task->getBaseWeight();
+            baseWeights[id] = std::max(ms / minMs, 1e-3);
         }
+    } else {
+        for (size_t id = 0; id < n; id++) baseWeights[id] = taskNodes[id].task->getBaseWeight();
     }
 
-    for(auto& pair: taskMap){
-        auto& crrTaskNode = pair.second;
-
-        crrTaskNode.auxOrquestrador = 0;
-        crrTaskNode.numChild = 0;
-        crrTaskNode.cpWeight  = 0;
-        crrTaskNode.sumWeight = 0;
-    }
-
-    // std::cout << "Iniciando queue 2" << std::endl;
-    while(!tasksQueueReverse.empty()){
-        auto& crrNodeTask = taskMap[tasksQueueReverse.front()];
-        tasksQueueReverse.pop();
-
-        // std::cout << "Tarefa atual: " << crrNodeTask.task->getTaskName() << std::endl;
-
-        int crrBaseWeight = crrNodeTask.task->getBaseWeight(); // TODO: calcular essa valor com a estimativa do peso da task;
-
-        crrNodeTask.cpWeight  = crrBaseWeight;
-        crrNodeTask.sumWeight = crrBaseWeight;
-
-        const auto& nextTasks = crrNodeTask.task->getNextTasks();
-        
-        if(!nextTasks.empty()){ 
-            int cpChild = 0, sumChild=0;
-
-            for (const auto& nextTask : nextTasks) {
-                auto& child = taskMap[nextTask->getTaskName()];
-                
-                cpChild   = std::max(cpChild, child.cpWeight);
-                sumChild += child.sumWeight;
-                crrNodeTask.numChild += 1 + child.numChild;
-            }
-
-            crrNodeTask.cpWeight  += cpChild;
-            crrNodeTask.sumWeight += sumChild;
+    // Ordem topológica ao contrário: as próximas de cada task já têm os pesos calculados
+    for (size_t id = n; id-- > 0; ) {
+        auto& crrNodeTask = taskNodes[id];
+        crrNodeTask.cpWeight  = baseWeights[id];
+        crrNodeTask.sumWeight = baseWeights[id];
+        crrNodeTask.numChild  = 0;
+
+        double cpChild = 0, sumChild = 0;
+        for (size_t k = nextOffsets[id]; k < nextOffsets[id + 1]; k++) {
+            const auto& child = taskNodes[nextIds[k]];
+            cpChild   = std::max(cpChild, child.cpWeight);
+            sumChild += child.sumWeight;
+            crrNodeTask.numChild += 1 + child.numChild;
         }
-        crrNodeTask.finalWeight = alpha*(double)crrNodeTask.cpWeight + (1.0-alpha)*(double)crrNodeTask.sumWeight/((double)crrNodeTask.numChild+1.0);
+        crrNodeTask.cpWeight  += cpChild;
+        crrNodeTask.sumWeight += sumChild;
+
+        crrNodeTask.finalWeight = alpha*crrNodeTask.cpWeight + (1.0-alpha)*crrNodeTask.sumWeight/((double)crrNodeTask.numChild+1.0);
         crrNodeTask.finalWeight = std::max(crrNodeTask.finalWeight, 1.0);
 
         // std::cout << "cpWeight:  " << crrNodeTask.cpWeight
@@ -248,28 +543,69 @@ bool Trigger::calculateThreadsDistribution(int numThreads) {
         //       << "    numChild: " << crrNodeTask.numChild
         //       << "    finalWeight: " << crrNodeTask.finalWeight
         //       << std::endl << std::endl;
+    }
+}
 
-        const auto& previousTasks = crrNodeTask.task->getPreviousTasks();
+// Prioridade e threads de cada task conforme a política
+void Trigger::planSchedule(int maxThreads) {
+    plannedMaxThreads = maxThreads;
+    if (schedulingPolicy == SchedulingPolicy::Weights) {
+        for (auto& node : taskNodes) {
+            node.priority = node.finalWeight;
+            node.plannedThreads = 1;
+        }
+        return;
+    }
+    auto dag = buildScheduleDag();
+    SchedulePlan plan = planCriticalPath(dag, maxThreads);
+    for (size_t id = 0; id < dag.size(); id++) {
+        taskNodes[id].priority = plan.rank[id];
+        taskNodes[id].plannedThreads = plan.threads[id];
+    }
+}
 
-        if(!previousTasks.empty()) {
-            for(const auto& pair: previousTasks){
-                std::string prevTaskName = pair.first->getTaskName();
-                auto& prevTaskNode = taskMap[prevTaskName];
+// Tasks sem medidas: tempo igual ao peso base vezes o t1 médio das medidas (ou 1 ms), e fração
+// serial padrão
+std::vector<ScheduleTask> Trigger::buildScheduleDag() {
+    std::vector<ScheduleTask> dag(taskNodes.size());
+    std::vector<bool> measured(taskNodes.size(), false);
+    double measuredT1 = 0.0;
+    for (size_t id = 0; id < taskNodes.size(); id++) {
+        const auto& node = taskNodes[id];
+        ScheduleTask& task = dag[id];
+        task.name = node.task->getTaskName();
+        task.parallel = node.task->canBeParallel();
+        task.maxThreadsProportion = node.task->getMaxThreadsProportion();
+        task.finalWeight = node.finalWeight;
+        task.next.assign(nextIds.begin() + nextOffsets[id], nextIds.begin() + nextOffsets[id + 1]);
+        measured[id] = taskProfile && taskProfile->scalingModel(task.name, task.parallel, task.model);
+        if (measured[id]) measuredT1 += task.model.t1Ms;
+    }
+    size_t numMeasured = std::count(measured.begin(), measured.end(), true);
+    double defaultT1 = numMeasured ? measuredT1 / numMeasured : 1.0;
+    for (size_t id = 0; id < taskNodes.size(); id++) {
+        if (measured[id]) continue;
+        auto& task = dag[id];
+        task.model.t1Ms = defaultT1 * taskNodes[id].task->getBaseWeight();
+        task.model.serialFraction = task.parallel ? TaskProfile::defaultSerialFraction : 1.0;
+    }
+    return dag;
+}
 
-                prevTaskNode.auxOrquestrador++;
-                
-                if(prevTaskNode.cpWeight != 0) continue;
+void Trigger::setSchedulingPolicy(SchedulingPolicy policy) {
+    schedulingPolicy = policy;
+    weightsReady = false;
+}
 
-                const auto& nextTasksPrevTask = prevTaskNode.task->getNextTasks();
-                if((int)nextTasksPrevTask.size() == prevTaskNode.auxOrquestrador){
-                    tasksQueueReverse.push(prevTaskName);
-                }
-            }
-        }
-    }
+std::map<std::string, int> Trigger::getPlannedThreads() const {
+    std::map<std::string, int> threads;
+    for (const auto& node : taskNodes) threads[node.task->getTaskName()] = node.plannedThreads;
+    return threads;
+}
 
-    // std::cout << "Cálculo concluído.\n";
-    return true;
+SimulationResult Trigger::simulate(int maxThreads, SchedulingPolicy policy) {
+    calculateThreadsDistribution(maxThreads);
+    return simulateSchedule(buildScheduleDag(), maxThreads, policy);
 }
 
 // struct TaskComparator {
@@ -351,13 +687,55 @@ void Trigger::orchestratePipelineMultiThread2(int numThreads) {
 }*/
 
 struct ExecGroup {
+    int id;                       // id da task no DAG compilado
     std::shared_ptr<Task> task;
-    std::shared_ptr<std::vector<std::atomic<bool>>> flags;
     std::vector<std::thread> threads;
-    std::vector<bool> joined;
+    int running = 0; // threads cujo término ainda não chegou
     std::chrono::high_resolution_clock::time_point start;
+    PipelineTrace::TaskSpan span; // preenchido só com a instrumentação ligada
+    size_t rowsIn = 0;            // preenchido só com perfil de tasks
+    int launched = 0;             // threads do disparo; as seguintes (slots >= launched) são emprestadas
+    int lent = 0;                 // emprestadas que ainda não foram pedidas de volta
+    std::vector<std::chrono::high_resolution_clock::time_point> lentAt; // por slot emprestado
+    double lentMs = 0.0;          // tempo somado das emprestadas que já terminaram
+    bool failed = false;          // alguma thread terminou com exceção
 };
 
+void Trigger::setElasticThreads(bool enabled) {
+    elasticThreads = enabled;
+}
+
+// Empresta as threads livres às tasks em execução que aceitam threads extras, respeitando a fração
+// máxima de cada uma e o número de horários de término reservados (maxThreads slots por task)
+void Trigger::lendIdleThreads(std::map<uint32_t, ExecGroup>& activeGroups, CompletionQueue& completions,
+                              int maxThreads, int& usedThreads) {
+    std::vector<std::pair<double, uint32_t>> candidates;
+    for (auto& [id, group] : activeGroups) {
+        if (!group.task->canBeParallel() || group.task->pendingMorsels() == 0) continue;
+        candidates.emplace_back(taskNodes[group.id].priority, id);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+    for (const auto& [priority, id] : candidates) {
+        int freeThreads = maxThreads - usedThreads;
+        if (freeThreads <= 0) break;
+        ExecGroup& group = activeGroups.at(id);
+        int cap = std::max(1, static_cast<int>(group.task->getMaxThreadsProportion() * maxThreads));
+        int extra = std::min({freeThreads, cap - group.running, maxThreads - static_cast<int>(group.threads.size())});
+        if (extra <= 0) continue;
+        auto added = group.task->addWorkers(extra, completions, id, static_cast<int>(group.threads.size()));
+        auto now = std::chrono::high_resolution_clock::now();
+        for (auto& thread : added) {
+            group.threads.push_back(std::move(thread));
+            group.lentAt.push_back(now);
+        }
+        int addedCount = static_cast<int>(added.size());
+        group.running += addedCount;
+        group.lent += addedCount;
+        usedThreads += addedCount;
+    }
+}
+
 void Trigger::orchestratePipelineMultiThread3(int maxThreads) {
 
     auto start = std::chrono::high_resolution_clock::now();
@@ -366,59 +744,97 @@ void Trigger::orchestratePipelineMultiThread3(int maxThreads) {
     std::chrono::duration<double, std::milli> elapsed = end - start;
     // std::cout << "Tempo de execução de calculateThreadsDistribution: " << elapsed.count() << " ms.\n";
 
-    auto cmp = [this](auto const &a, auto const &b) {
-        const auto &wa = taskMap.at(a).finalWeight;
-        const auto &wb = taskMap.at(b).finalWeight;
+    auto cmp = [this](int a, int b) {
+        const auto &na = taskNodes[a];
+        const auto &nb = taskNodes[b];
 
-        return wa > wb || (wa == wb && taskMap.at(a).task->getTaskName() < taskMap.at(b).task->getTaskName());
+        return na.priority > nb.priority || (na.priority == nb.priority && na.nameRank < nb.nameRank);
     };
 
-    // 2) Crie o set com esse comparador
-    std::set<std::string, decltype(cmp)> tasksQueue(cmp);
+    // 2) Crie o set (de ids) com esse comparador
+    std::set<int, decltype(cmp)> tasksQueue(cmp);
+
+    // Anteriores ainda por terminar de cada task: entra na fila ao chegar a 0
+    std::vector<int> pendingPrevious = fanIn;
 
-    // std::queue<std::string> tasksQueue;
+    auto run = beginRun();
+    beginTrace(maxThreads);
+    // Quando cada task entrou na fila (só com a instrumentação ligada)
+    std::vector<PipelineTrace::Clock::time_point> readyAt;
+    if (currentTrace) readyAt.assign(taskNodes.size(), PipelineTrace::Clock::now());
 
-    for (auto& extractor : vExtractors) 
-        tasksQueue.insert(extractor->getTaskName());
+    for (size_t id = 0; id < taskNodes.size(); id++) {
+        if (pendingPrevious[id] == 0) tasksQueue.insert(id);
+    }
 
-    std::vector<ExecGroup> activeGroups;
+    // Grupos em execução, pelo identificador que as threads publicam ao terminar
+    std::map<uint32_t, ExecGroup> activeGroups;
+    uint32_t nextGroup = 0;
 
     int usedThreads = 0;
 
-    // mutex + condvar para orquestrador dormir/acordar
-    std::mutex orchestratorMutex;
-    std::condition_variable orchestratorCv;
+    // Cada thread publica o seu término aqui; o orquestrador dorme até chegar um e trata só os que chegaram
+    CompletionQueue completions(maxThreads);
+    // Primeira exceção de uma task: a execução é cancelada e, quando as threads saírem, ela é relançada
+    std::exception_ptr failure;
+    auto fail = [&](const std::shared_ptr<Task>& task, std::exception_ptr error) {
+        if (!failure) failure = error;
+        if (!run->isCancelled()) run->cancel("task " + task->getTaskName() + ": erro");
+    };
+
+    // Todas as threads da task terminaram: finaliza a Task e libera as próximas
+    auto finishGroup = [&](ExecGroup& group) {
+        if (currentTrace) measureSpan(group.task, group.span, group.threads.size());
+        if (taskProfile) {
+            std::chrono::duration<double, std::milli> taskElapsed = std::chrono::high_resolution_clock::now() - group.start;
+            // as threads emprestadas contam pela fração da execução em que estiveram na task
+            int threads = group.launched;
+            if (taskElapsed.count() > 0.0) threads += static_cast<int>(std::lround(group.lentMs / taskElapsed.count()));
+            recordTaskRuntime(group.task, taskElapsed.count(), group.rowsIn, std::max(threads, 1));
+        }
+        group.task->setCancellation(nullptr);
+        group.task->finishExecution();
+        auto end = std::chrono::high_resolution_clock::now();
+        if (currentTrace) {
+            group.span.end = PipelineTrace::Clock::now();
+            currentTrace->add(std::move(group.span));
+        }
+        std::chrono::duration<double, std::milli> elapsed = end - group.start;
+        // std::cout << "Tempo de execução do bloco " << group.task->getTaskName() << ": " << elapsed.count() << " milissegundos.\n";
+        // enfileira as próximas (leva em conta dependências)
+        for (size_t k = nextOffsets[group.id]; k < nextOffsets[group.id + 1]; k++) {
+            int nxt = nextIds[k];
+            if (--pendingPrevious[nxt] == 0) {
+                tasksQueue.insert(nxt);
+                if (currentTrace) readyAt[nxt] = PipelineTrace::Clock::now();
+            }
+        }
+    };
 
     while (!tasksQueue.empty() || !activeGroups.empty()) {
+        // Execução cancelada: nada mais é disparado; só espera as threads em execução saírem
+        if (run->isCancelled()) tasksQueue.clear();
+
         // Disparar tarefas quando houver threads disponíveis
-        while (!tasksQueue.empty() && usedThreads < maxThreads) {
+        while (!tasksQueue.empty() && usedThreads < maxThreads && !run->isCancelled()) {
             auto it = tasksQueue.begin();
-            std::string crrTaskName = *it;
+            int crrTaskId = *it;
             tasksQueue.erase(it);
 
-            const auto& crrNodeTask = taskMap[crrTaskName];
+            const auto& crrNodeTask = taskNodes[crrTaskId];
 
             const int availableThreads = maxThreads - usedThreads;
 
             // Decide quantas threads essa Task quer usar
             int crrTaskThreadsNum;
-            if(crrNodeTask.task->canBeParallel()) {
-                if(tasksQueue.empty()){
-                    crrTaskThreadsNum = std::min(availableThreads, 
-                                                 static_cast<int>(std::ceil(availableThreads * crrNodeTask.task->getMaxThreadsProportion()))
-                                                 );
-                }
-                else{
-                    auto itNxt = tasksQueue.begin();
-                    auto& nxtNodeTask = taskMap[*itNxt];
-
-
-                    double aux = crrNodeTask.finalWeight / (crrNodeTask.finalWeight + nxtNodeTask.finalWeight);
-                    crrTaskThreadsNum = static_cast<int>(std::ceil(aux * availableThreads));
-                }
-            } 
+            if(schedulingPolicy == SchedulingPolicy::CriticalPath) {
+                crrTaskThreadsNum = crrNodeTask.plannedThreads;
+            }
             else {
-                crrTaskThreadsNum = 1;
+                bool hasNext = !tasksQueue.empty();
+                double nxtWeight = hasNext ? taskNodes[*tasksQueue.begin()].finalWeight : 0.0;
+                crrTaskThreadsNum = weightedThreads(crrNodeTask.task->canBeParallel(), crrNodeTask.task->getMaxThreadsProportion(),
+                                                    crrNodeTask.finalWeight, hasNext, nxtWeight, availableThreads);
             }
 
             crrTaskThreadsNum = std::min(crrTaskThreadsNum, availableThreads);
@@ -428,98 +844,86 @@ void Trigger::orchestratePipelineMultiThread3(int maxThreads) {
                 crrTaskThreadsNum = 1;
             }
             auto start = std::chrono::high_resolution_clock::now();
-            auto flags = std::make_shared<std::vector<std::atomic<bool>>>(crrTaskThreadsNum);
-            for (auto &f : *flags) f.store(false, std::memory_order_relaxed);
-
-            // o que o executeMultiThread deve fazer
-            // cria as threads e as coloca em execução
-            // cada thread vai executar a tarefa e, ao final, vai
-            // sinaliza conclusão
-            // (*flags)[i].store(true, std::memory_order_release);
-            // notificar o orquestrador
-            // {
-            //    std::lock_guard<std::mutex> lk(orchestratorMutex);
-            //    orchestratorCv.notify_one();
-            // }
 
-            auto threadsList = crrNodeTask.task->executeMultiThread(crrTaskThreadsNum, (*flags), orchestratorCv, orchestratorMutex);
-            std::vector<bool> crrJoined(crrTaskThreadsNum, false);
-
-            // registra o grupo ativo
-            activeGroups.push_back(
-                ExecGroup{crrNodeTask.task, flags, std::move(threadsList), std::move(crrJoined), start}
-            );
-
-            usedThreads += crrTaskThreadsNum;
-
-        }
-
-        for (auto it = activeGroups.begin(); it != activeGroups.end(); ) {
-            auto& group = *it;
-
-            // percorre cada sub‑thread do grupo
-            for (size_t i = 0; i < group.threads.size(); ++i) {
-
-                // se terminou e ainda não chamou join()
-                if (!group.joined[i] && group.flags->at(i).load(std::memory_order_acquire)) {
-                    if (group.threads[i].joinable()) group.threads[i].join();
-
-                    usedThreads--;          // libera 1 slot
-                    group.joined[i] = true; // marca como joined
-                }
+            PipelineTrace::TaskSpan span;
+            if (currentTrace) span = startSpan(crrNodeTask.task, readyAt[crrTaskId]);
+            size_t rowsIn = taskProfile ? inputRows(crrNodeTask.task) : 0;
+            // um horário por slot possível, contando as threads que a task ainda pode receber emprestadas
+            crrNodeTask.task->resetThreadFinishTimes(elasticThreads ? maxThreads : crrTaskThreadsNum);
+            crrNodeTask.task->setCancellation(taskToken(run, crrNodeTask.task));
+            const uint32_t groupId = nextGroup++;
+            std::vector<std::thread> threadsList;
+            try {
+                threadsList = crrNodeTask.task->executeMultiThread(crrTaskThreadsNum, completions, groupId);
+            } catch (...) {
+                // Nenhuma thread foi criada (ex.: repositório que não abre)
+                fail(crrNodeTask.task, std::current_exception());
+                continue;
             }
+            // a task pode usar menos threads do que as reservadas (ex.: extrator em cache não cria nenhuma)
+            int launchedThreads = static_cast<int>(threadsList.size());
 
-            bool allJoined = true;
-            for (auto joined_ith : group.joined) {
-                if (!joined_ith) {
-                    allJoined = false;
-                    break;
-                }
+            ExecGroup group{crrTaskId, crrNodeTask.task, std::move(threadsList), launchedThreads, start, std::move(span), rowsIn, launchedThreads};
+            if (launchedThreads == 0) {
+                finishGroup(group); // nenhum término a esperar
+                continue;
             }
+            activeGroups.emplace(groupId, std::move(group));
+            usedThreads += launchedThreads;
+        }
 
-            if (allJoined) {
-                // finaliza a Task
-                group.task->finishExecution();
-                auto end = std::chrono::high_resolution_clock::now();
-                std::chrono::duration<double, std::milli> elapsed = end - group.start;
-                // std::cout << "Tempo de execução do bloco " << group.task->getTaskName() << ": " << elapsed.count() << " milissegundos.\n";
-                // enfileira nextTasks (leva em conta dependências)
-                for (auto& nxt : group.task->getNextTasks()) {
-                    nxt->incrementExecutedPreviousTasks();
-                    if (nxt->checkPreviousTasks())
-                        tasksQueue.insert(nxt->getTaskName());
+        if (activeGroups.empty()) continue;
+
+        if (elasticThreads && !run->isCancelled()) {
+            if (tasksQueue.empty() && usedThreads < maxThreads) {
+                // Nada na fila: as threads livres vão para as tasks em execução que ainda têm partes
+                // por processar, da maior prioridade para a menor
+                lendIdleThreads(activeGroups, completions, maxThreads, usedThreads);
+            } else if (!tasksQueue.empty() && usedThreads >= maxThreads) {
+                // Task esperando: as emprestadas voltam ao fim da parte atual
+                for (auto& [id, group] : activeGroups) {
+                    if (group.lent == 0) continue;
+                    group.task->releaseWorkers(group.lent);
+                    group.lent = 0;
                 }
-
-                // remove do vector de grupos ativos
-                it = activeGroups.erase(it);
-            } 
-            else {
-                ++it;
             }
         }
 
-        // Aguarda notificação
-        if (tasksQueue.empty() && !activeGroups.empty()) {
-            std::unique_lock<std::mutex> lock(orchestratorMutex);
-            // acorda sempre que:
-            //  - chegar nova Task em tasksQueue, ou
-            //  - algum grupo terminar e notificar
-            orchestratorCv.wait(lock, [&](){
-                bool anyThreadFinished = false;
-                for (auto& group : activeGroups) {
-                    for (size_t i = 0; i < group.threads.size(); ++i) {
-                        if (!group.joined[i] && group.flags->at(i).load(std::memory_order_acquire)) {
-                            anyThreadFinished = true;
-                            break;
-                        }
-                    }
-                    if (anyThreadFinished) break;
+        // Dorme até a próxima thread terminar e trata esse término e os que chegaram junto
+        CompletionQueue::Event event = completions.pop();
+        do {
+            auto it = activeGroups.find(event.group);
+            auto& group = it->second;
+            if (group.threads[event.slot].joinable()) group.threads[event.slot].join();
+            usedThreads--; // libera 1 slot
+            if (event.error) {
+                group.failed = true;
+                fail(group.task, event.error);
+            }
+            if (static_cast<int>(event.slot) >= group.launched) {
+                std::chrono::duration<double, std::milli> lentElapsed =
+                    std::chrono::high_resolution_clock::now() - group.lentAt[event.slot - group.launched];
+                group.lentMs += lentElapsed.count();
+            }
+            group.lent = std::min(group.lent, --group.running);
+            if (group.running == 0) {
+                // Task cancelada (pela execução ou pelo seu prazo): o resultado dela é descartado
+                auto token = group.task->getCancellation();
+                if (group.failed) {
+                    group.task->setCancellation(nullptr);
+                } else if (token->isCancelled()) {
+                    if (!run->isCancelled()) run->cancel("task " + group.task->getTaskName() + ": " + token->getReason());
+                } else {
+                    finishGroup(group);
                 }
-                
-                return !tasksQueue.empty() || anyThreadFinished;
-            });
-        }
+                activeGroups.erase(it);
+            }
+        } while (completions.tryPop(event));
     }
+    if (failure) failRun(failure);
+    if (run->isCancelled()) abortRun(run);
+    endTrace();
+    endRun();
 }
 
 
@@ -528,14 +932,20 @@ void Trigger::orchestratePipelineMultiThread3(int maxThreads) {
 // Implementação de RequestTrigger
 void RequestTrigger::start(int numThreads) {
     isBusy = true;
-    if(numThreads > 1) {
-        std::cout << "Executando a pipeline com " << numThreads << " threads.\n";
-        orchestratePipelineMultiThread3(numThreads);
-    }
+    try {
+        if(numThreads > 1) {
+            std::cout << "Executando a pipeline com " << numThreads << " threads.\n";
+            orchestratePipelineMultiThread3(numThreads);
+        }
 
-    else {
-        std::cout << "Executando a pipeline em uma única thread.\n";
-        orchestratePipelineMonoThread();
+        else {
+            std::cout << "Executando a pipeline em uma única thread.\n";
+            orchestratePipelineMonoThread();
+        }
+    } catch (...) {
+        // cancelada, erro numa task ou DAG inválido
+        isBusy = false;
+        throw;
     }
     isBusy = false;
 }
@@ -543,59 +953,264 @@ void RequestTrigger::start(int numThreads) {
 // ##################################################################################################
 // ##################################################################################################
 // Implementação de TimerTrigger
-TimerTrigger::TimerTrigger(unsigned int intervaloMs)
-    : intervalo(intervaloMs), stopFlag(false) {}
+TimerTrigger::TimerTrigger(unsigned int intervaloMs, MissedTickPolicy policy)
+    : intervalo(std::max(intervaloMs, 1u)), policy(policy) {}
 
 TimerTrigger::~TimerTrigger() {
     stop();
 }
 
 void TimerTrigger::start(int numThreads) {
-    stopFlag = false;
-    timerThread = std::thread([this]() {
-        while (!stopFlag) {
-            orchestratePipelineMonoThread();
-            std::this_thread::sleep_for(std::chrono::milliseconds(intervalo));
+    stop();
+    ensureCompiled(); // um DAG inválido é informado aqui, e não na thread do trigger
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopFlag = false;
+        stats = TimerStats();
+    }
+    timerThread = std::thread(&TimerTrigger::run, this, numThreads);
+}
+
+void TimerTrigger::run(int numThreads) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration period = std::chrono::milliseconds(intervalo);
+    const Clock::time_point origin = Clock::now();
+    uint64_t tick = 0; // disparo da grade da próxima execução
+    while (true) {
+        Clock::time_point deadline = origin + static_cast<Clock::rep>(tick) * period;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            if (stopCv.wait_until(lock, deadline, [this] { return stopFlag; })) return;
         }
-    });
+
+        auto start = Clock::now();
+        isBusy = true;
+        bool cancelled = false;
+        bool failed = false;
+        try {
+            if (numThreads > 1) {
+                orchestratePipelineMultiThread3(numThreads);
+            } else {
+                orchestratePipelineMonoThread();
+            }
+        } catch (const PipelineCancelled&) {
+            cancelled = true; // a execução é descartada e os disparos seguem
+        } catch (const std::exception& e) {
+            // Como no cancelamento: a execução já foi desfeita e a grade continua
+            std::cerr << "TimerTrigger: Erro na execução: " << e.what() << std::endl;
+            failed = true;
+        }
+        isBusy = false;
+        auto end = Clock::now();
+
+        // Próximo disparo da grade ainda no futuro; os que ficaram para trás foram perdidos
+        uint64_t nextTick = tick + 1;
+        uint64_t dueTick = static_cast<uint64_t>((end - origin) / period) + 1;
+        bool overrun = dueTick > nextTick;
+        uint64_t missed = overrun ? dueTick - nextTick : 0;
+        if (policy == MissedTickPolicy::Skip) {
+            tick = std::max(nextTick, dueTick);
+        } else {
+            // Os perdidos viram uma execução imediata (no último deles) e a grade continua depois
+            tick = overrun ? dueTick - 1 : nextTick;
+            if (missed > 0) missed--;
+        }
+
+        std::chrono::duration<double, std::milli> runMs = end - start;
+        std::chrono::duration<double, std::milli> lateness = start - deadline;
+        std::lock_guard<std::mutex> lock(mtx);
+        stats.runs++;
+        if (cancelled) stats.cancelled++;
+        if (failed) stats.failed++;
+        stats.lastRunMs = runMs.count();
+        stats.maxRunMs = std::max(stats.maxRunMs, runMs.count());
+        stats.meanRunMs += (runMs.count() - stats.meanRunMs) / stats.runs;
+        stats.maxLatenessMs = std::max(stats.maxLatenessMs, lateness.count());
+        if (overrun) {
+            stats.overruns++;
+            stats.missedTicks += missed;
+            std::cout << "TimerTrigger: execução de " << runMs.count() << " ms passou do intervalo de "
+                      << intervalo << " ms (" << missed << " disparo(s) perdido(s)).\n";
+        }
+    }
 }
 
 void TimerTrigger::stop() {
-    stopFlag = true;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopFlag = true;
+    }
+    stopCv.notify_all();
     if (timerThread.joinable()) {
         timerThread.join();
     }
 }
 
+TimerStats TimerTrigger::getStats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
+}
+
+// ##################################################################################################
+// ##################################################################################################
+// Implementação de FileWatchTrigger
+FileWatchTrigger::FileWatchTrigger(const std::string& directory, const std::string& pattern, std::shared_ptr<Extractor> target)
+    : directory(directory), pattern(pattern), target(std::move(target)) {
+    repository = this->target ? dynamic_cast<FileRepository*>(this->target->getRepo()) : nullptr;
+    if (!repository) {
+        throw std::invalid_argument("FileWatchTrigger: o extrator alvo precisa de um FileRepository.");
+    }
+}
+
+FileWatchTrigger::~FileWatchTrigger() {
+    stop();
+}
+
+void FileWatchTrigger::start(int numThreads) {
+    stop();
+    ensureCompiled(); // um DAG inválido é informado aqui, e não na thread do trigger
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        throw std::runtime_error(std::string("FileWatchTrigger: inotify_init1: ") + std::strerror(errno));
+    }
+    // Fechado após escrita (arquivo escrito na pasta) ou movido para ela (escrito fora e renomeado)
+    if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::string error = std::strerror(errno);
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        throw std::runtime_error("FileWatchTrigger: não foi possível observar " + directory + ": " + error);
+    }
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd < 0) {
+        std::string error = std::strerror(errno);
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        throw std::runtime_error("FileWatchTrigger: eventfd: " + error);
+    }
+    watchThread = std::thread(&FileWatchTrigger::watch, this, numThreads);
+}
+
+void FileWatchTrigger::watch(int numThreads) {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "FileWatchTrigger: poll: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[1].revents & POLLIN) return;
+
+        // Lê todos os eventos disponíveis antes de executar, para executar na ordem de chegada
+        std::vector<std::string> files;
+        auto noticed = std::chrono::steady_clock::now();
+        while (true) {
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) break;
+            for (char* ptr = buffer; ptr < buffer + length; ) {
+                auto* event = reinterpret_cast<inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    std::cerr << "FileWatchTrigger: fila do inotify cheia, eventos de " << directory << " perdidos." << std::endl;
+                    continue;
+                }
+                if (event->len == 0 || (event->mask & IN_ISDIR)) continue;
+                if (fnmatch(pattern.c_str(), event->name, 0) != 0) continue;
+                files.push_back((std::filesystem::path(directory) / event->name).string());
+            }
+        }
+        for (const auto& file : files) {
+            // stop() no meio de um lote: os arquivos seguintes não são executados
+            pollfd stopCheck{stopFd, POLLIN, 0};
+            if (poll(&stopCheck, 1, 0) > 0) return;
+            runFile(file, noticed, numThreads);
+        }
+    }
+}
+
+void FileWatchTrigger::runFile(const std::string& path, std::chrono::steady_clock::time_point noticed, int numThreads) {
+    isBusy = true;
+    try {
+        repository->setFile(path);
+        if (numThreads > 1) {
+            orchestratePipelineMultiThread3(numThreads);
+        } else {
+            orchestratePipelineMonoThread();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "FileWatchTrigger: Erro ao processar " << path << ": " << e.what() << std::endl;
+    }
+    isBusy = false;
+    runs++;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - noticed;
+    std::cout << "FileWatchTrigger: " << path << " processado em " << elapsed.count() << " ms.\n";
+    if (onFile) onFile(path, elapsed.count());
+}
+
+void FileWatchTrigger::stop() {
+    if (stopFd >= 0) {
+        uint64_t one = 1;
+        if (write(stopFd, &one, sizeof(one)) < 0) {
+            std::cerr << "FileWatchTrigger: eventfd: " << std::strerror(errno) << std::endl;
+        }
+    }
+    if (watchThread.joinable()) {
+        watchThread.join();
+    }
+    if (inotifyFd >= 0) ::close(inotifyFd);
+    if (stopFd >= 0) ::close(stopFd);
+    inotifyFd = -1;
+    stopFd = -1;
+}
+
 // ##################################################################################################
 // ##################################################################################################
 // Implementação de ServerTrigger
 std::thread ServerTrigger::start(int numThreads, std::shared_ptr<DataFrame> df) { // TODO: usar df
-    if(isBusy()) {
+    // Marca a pipeline como ocupada antes de criar a thread, para que quem despacha
+    // batches entre várias instâncias não escolha esta de novo enquanto ela inicia
+    if(busy.exchange(true)) {
         std::cout << "ServerTrigger: A pipeline já está ocupada." << std::endl;
         return std::thread(); // Retorna uma thread vazia se já estiver ocupada
     }
  
     std::shared_ptr<ExtractorNoop> noopExtractor = std::dynamic_pointer_cast<ExtractorNoop>(vExtractors[eIndex]);
-    noopExtractor->addOutput(df);
+    size_t rows = df ? df->size() : 0;
+    noopExtractor->addOutput(std::move(df));
 
-    std::thread orchestratorThread([this, numThreads]() {
-        busy.store(true, std::memory_order_relaxed); // Marca a pipeline como ocupada
-        
+    // As transações começam aqui, na thread que despacha os batches, e não no orquestrador: a senha
+    // de cada uma no StateStore segue a ordem dos batches, e o batch seguinte só toca o estado
+    // depois do commit deste
+    for (auto& store : stateStores) store->begin();
+
+    std::thread orchestratorThread([this, numThreads, rows]() {
         auto start = std::chrono::high_resolution_clock::now();
-        if(numThreads > 1) {
-            std::cout << "ServerTrigger: Executando a pipeline com " << numThreads << " threads." << std::endl;
-            orchestratePipelineMultiThread3(numThreads);
-        }
-        else {
-            std::cout << "ServerTrigger: Executando a pipeline em uma única thread." << std::endl;
-            orchestratePipelineMonoThread();
+        bool committed = false;
+        try {
+            if(numThreads > 1) {
+                std::cout << "ServerTrigger: Executando a pipeline com " << numThreads << " threads." << std::endl;
+                orchestratePipelineMultiThread3(numThreads);
+            }
+            else {
+                std::cout << "ServerTrigger: Executando a pipeline em uma única thread." << std::endl;
+                orchestratePipelineMonoThread();
+            }
+            for (auto& store : stateStores) store->commit();
+            committed = true;
+        } catch (const std::exception& e) {
+            // Batch com erro não deixa escritas parciais no estado
+            std::cerr << "ServerTrigger: Erro na pipeline, descartando o estado do batch: " << e.what() << std::endl;
+            for (auto& store : stateStores) store->rollback();
+        } catch (...) {
+            std::cerr << "ServerTrigger: Erro na pipeline, descartando o estado do batch." << std::endl;
+            for (auto& store : stateStores) store->rollback();
         }
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double, std::milli> elapsed = end - start;
         std::cout << "Tempo de execução da pipeline: " << elapsed.count() << " milissegundos.\n";
         
-        busy.store(false, std::memory_order_relaxed); // Marca a pipeline como livre
+        busy.store(false); // Marca a pipeline como livre
+        if(onFinish) onFinish(rows, elapsed.count(), committed);
     });
 
     return orchestratorThread;
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "triggerpolicy.hpp"
+
+namespace {
+double msBetween(TriggerPolicy::Clock::time_point from, TriggerPolicy::Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+}
+
+// ###############################################################################################
+// ###############################################################################################
+// Metodos da classe SizeTriggerPolicy
+
+bool SizeTriggerPolicy::shouldTrigger(const TriggerState& state) {
+    return state.freeInstances > 0 && state.pendingRows > 0 && state.pendingRows > minRows;
+}
+
+// ###############################################################################################
+// ###############################################################################################
+// Metodos da classe LatencySLOTriggerPolicy
+
+LatencySLOTriggerPolicy::LatencySLOTriggerPolicy(double targetLatencyMs, size_t minRows, size_t maxRows)
+    : targetMs(targetLatencyMs), minRows(std::max<size_t>(1, minRows)), maxRows(std::max(maxRows, this->minRows)) {}
+
+void LatencySLOTriggerPolicy::onArrival(size_t rows, Clock::time_point when) {
+    // Contador com decaimento exponencial: em regime, ratePerMs converge para a taxa de chegada
+    if (hasArrival) {
+        double dt = std::max(0.0, msBetween(lastArrival, when));
+        ratePerMs *= std::exp(-dt / rateWindowMs);
+    }
+    ratePerMs += rows / rateWindowMs;
+    lastArrival = when;
+    hasArrival = true;
+}
+
+double LatencySLOTriggerPolicy::arrivalRatePerMs(Clock::time_point now) const {
+    if (!hasArrival) return 0.0;
+    double dt = std::max(0.0, msBetween(lastArrival, now));
+    return ratePerMs * std::exp(-dt / rateWindowMs);
+}
+
+void LatencySLOTriggerPolicy::onRunFinished(size_t rows, double elapsedMs) {
+    double n = static_cast<double>(rows);
+    sumW  = sumW  * forgetting + 1.0;
+    sumN  = sumN  * forgetting + n;
+    sumT  = sumT  * forgetting + elapsedMs;
+    sumNN = sumNN * forgetting + n * n;
+    sumNT = sumNT * forgetting + n * elapsedMs;
+
+    double den = sumW * sumNN - sumN * sumN;
+    if (den > 1e-9 * sumW * sumNN) {
+        perRowMs = (sumW * sumNT - sumN * sumT) / den;
+        fixedMs = (sumT - perRowMs * sumN) / sumW;
+    } else {
+        // Execuções todas do mesmo tamanho não separam os dois custos: atribui tudo às linhas
+        perRowMs = sumN > 0 ? sumT / sumN : 0.0;
+        fixedMs = 0.0;
+    }
+    if (perRowMs < 0) {
+        perRowMs = 0.0;
+        fixedMs = sumT / sumW;
+    }
+    if (fixedMs < 0) {
+        fixedMs = 0.0;
+        perRowMs = sumNN > 0 ? sumNT / sumNN : 0.0;
+    }
+}
+
+double LatencySLOTriggerPolicy::predictRunMs(size_t rows) const {
+    return fixedMs + perRowMs * rows;
+}
+
+size_t LatencySLOTriggerPolicy::targetBatchRows(size_t totalInstances, Clock::time_point now) const {
+    double rate = arrivalRatePerMs(now);
+    if (rate <= 0.0) return minRows;
+    double k = static_cast<double>(std::max<size_t>(1, totalInstances));
+
+    // Maior batch cuja linha mais antiga ainda cumpre o alvo: acumular n linhas leva n/rate
+    // e executá-las leva fixedMs + perRowMs*n
+    double budget = targetMs - slackMs() - fixedMs;
+    double cap = budget > 0 ? budget / (1.0 / rate + perRowMs) : 0.0;
+
+    // Batch em que as k instâncias dão conta da chegada: n/rate = (fixedMs + perRowMs*n)/k.
+    // Abaixo dele o custo fixo por execução acumula fila; se nem batches infinitos dão conta, usa o teto.
+    double balanced = k > rate * perRowMs ? rate * fixedMs / (k - rate * perRowMs)
+                                          : std::numeric_limits<double>::infinity();
+
+    double rows = std::min(std::max(balanced, static_cast<double>(minRows)), cap);
+    rows = std::min(rows, static_cast<double>(maxRows));
+    return std::max(minRows, static_cast<size_t>(rows));
+}
+
+bool LatencySLOTriggerPolicy::shouldTrigger(const TriggerState& state) {
+    if (state.freeInstances == 0 || state.pendingRows == 0) return false;
+    if (state.pendingRows >= maxRows) return true;
+
+    // Esperar mais faria a linha mais antiga estourar o alvo
+    double waited = msBetween(state.oldestArrival, state.now);
+    if (waited + predictRunMs(state.pendingRows) >= targetMs - slackMs()) return true;
+
+    return state.pendingRows >= targetBatchRows(state.totalInstances, state.now);
+}
+
+TriggerPolicy::Clock::time_point LatencySLOTriggerPolicy::nextCheck(const TriggerState& state) {
+    if (state.pendingRows == 0) return Clock::time_point::max();
+    double remaining = targetMs - slackMs() - predictRunMs(state.pendingRows);
+    auto deadline = state.oldestArrival + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double, std::milli>(remaining));
+    return std::max(deadline, state.now + std::chrono::milliseconds(1));
+}